@@ -1,23 +1,26 @@
 #include <cmath>
+#include <limits>
 
 #include "arrow.hpp"
 #include "color.hpp"
 
 Arrow::Renderer::Renderer(RendererGL& rendererGL, Arrow& arrow, float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y, int layer,
-				 unsigned int begin, unsigned int end) : m_arrow(arrow), m_begin(begin), m_end(end)
+				 unsigned int begin, unsigned int end, unsigned int translation) : m_arrow(arrow), m_rendererGL(rendererGL), m_instance(rendererGL),
+				 m_begin(begin), m_end(end), m_translation(translation)
 {
 	float dx = p1x-p0x;
 	float dy = p1y-p0y;
 	float div = t1x*t0y-t1y*t0x;
 	
+	float c0x, c0y, c1x, c1y;
 	if (std::abs(div)>=1e-3) {
 		float t1 = (dy*t0x-dx*t0y)/div;
 		float t0 = (dy*t1x-dx*t1y)/div;
-		m_arrowBody = ShowableBezier(rendererGL, p0x, p0y, p0x+0.666666666667*t0*t0x, p0y+0.666666666667*t0*t0y,
-								   p1x+0.666666666667*t1*t1x, p1y+0.666666666667*t1*t1y, p1x, p1y);
+		c0x = p0x+0.666666666667*t0*t0x; c0y = p0y+0.666666666667*t0*t0y;
+		c1x = p1x+0.666666666667*t1*t1x; c1y = p1y+0.666666666667*t1*t1y;
 	} else {
-		m_arrowBody = ShowableBezier(rendererGL, p0x, p0y, p0x+0.333333333333*dx,     p0y+0.333333333333*dy,
-								   p1x-0.333333333333*dx,     p1y-0.333333333333*dy,     p1x, p1y);
+		c0x = p0x+0.333333333333*dx;     c0y = p0y+0.333333333333*dy;
+		c1x = p1x-0.333333333333*dx;     c1y = p1y-0.333333333333*dy;
 	}
 	
 	float tipFactor;
@@ -35,27 +38,21 @@ Arrow::Renderer::Renderer(RendererGL& rendererGL, Arrow& arrow, float p0x, float
 		t1x/=f; t1y/=f;
 	}
 	
-	m_tip[0] = ShowableLine(rendererGL, p1x, p1y, p1x+tipFactor*(t1x-t1y), p1y+tipFactor*(t1y+t1x));
-	m_tip[1] = ShowableLine(rendererGL, p1x, p1y, p1x+tipFactor*(t1x+t1y), p1y+tipFactor*(t1y-t1x));
-	
-	m_arrowBody.setColor(arrowColor.r, arrowColor.g, arrowColor.b);
-	m_arrowBody.setLayer(layer+1);
-	m_arrowBody.show(rendererGL);
-	
-	for (int i=0; i<2; i++) {
-		m_tip[i].setColor(arrowColor.r, arrowColor.g, arrowColor.b);
-		m_tip[i].setLayer(layer+1);
-		m_tip[i].show(rendererGL);
-	}
+	RendererGL::ArrowData data(p0x, p0y, c0x, c0y, c1x, c1y, p1x, p1y, tipFactor*t1x, tipFactor*t1y);
+	toLocal(data);
+	m_instance.setColor(arrowColor.r, arrowColor.g, arrowColor.b);
+	m_instance.setLayer(layer+1);
+	m_instance.setTranslation(m_translation);
+	m_instance.setDataWithSize(rendererGL, 1, &data);
 }
 
-void Arrow::Renderer::changePoints(float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y) {
+RendererGL::ArrowData Arrow::Renderer::getData(float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y) {
 	float dx = p1x-p0x;
 	float dy = p1y-p0y;
 	
 	float t = sqrt(dx*dx+dy*dy);
-	m_arrowBody.changePoints(p0x, p0y, p0x+t*t0x, p0y+t*t0y, p1x+t*t1x, p1y+t*t1y, p1x, p1y);
-	
+	float c0x = p0x+t*t0x, c0y = p0y+t*t0y;
+	float c1x = p1x+t*t1x, c1y = p1y+t*t1y;
 	
 	float tipFactor;
 	float dst = dx*dx+dy*dy;
@@ -72,12 +69,52 @@ void Arrow::Renderer::changePoints(float p0x, float p0y, float p1x, float p1y, f
 		t1x/=f; t1y/=f;
 	}
 	
-	m_tip[0].changePoints(p1x, p1y, p1x+tipFactor*(t1x-t1y), p1y+tipFactor*(t1y+t1x));
-	m_tip[1].changePoints(p1x, p1y, p1x+tipFactor*(t1x+t1y), p1y+tipFactor*(t1y-t1x));
+	return RendererGL::ArrowData(p0x, p0y, c0x, c0y, c1x, c1y, p1x, p1y, tipFactor*t1x, tipFactor*t1y);
+}
+
+void Arrow::Renderer::toLocal(RendererGL::ArrowData& data) const {
+	const GLfloat* translation = m_rendererGL.getTranslation(m_translation);
+	data.translate(-translation[0], -translation[1]);
+}
+
+void Arrow::Renderer::changePoints(float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y) {
+	RendererGL::ArrowData data(getData(p0x, p0y, p1x, p1y, t0x, t0y, t1x, t1y));
+	toLocal(data);
+	m_animation = 0;
+	m_instance.updateData(&data);
+}
+
+void Arrow::Renderer::animatePoints(unsigned int animation, float p0x0, float p0y0, float p1x0, float p1y0, float t0x0, float t0y0, float t1x0, float t1y0,
+									float p0x1, float p0y1, float p1x1, float p1y1, float t0x1, float t0y1, float t1x1, float t1y1) {
+	RendererGL::ArrowData data(getData(p0x0, p0y0, p1x0, p1y0, t0x0, t0y0, t1x0, t1y0));
+	data.setTarget(getData(p0x1, p0y1, p1x1, p1y1, t0x1, t0y1, t1x1, t1y1), animation);
+	toLocal(data);
+	m_animation = animation;
+	m_instance.updateData(&data);
 }
 
 void Arrow::Renderer::setLayer(int newLayer) {
-	m_arrowBody.setLayer(newLayer+1);
-	m_tip[0].setLayer(newLayer+1);
-	m_tip[1].setLayer(newLayer+1);
+	m_instance.setLayer(newLayer+1);
+}
+
+void Arrow::Renderer::setTranslation(unsigned int translation) {
+	const GLfloat* oldTranslation = m_rendererGL.getTranslation(m_translation);
+	const GLfloat* newTranslation = m_rendererGL.getTranslation(translation);
+	RendererGL::ArrowData* data = m_instance.editData();
+	if (data!=nullptr)
+		data->translate(oldTranslation[0]-newTranslation[0], oldTranslation[1]-newTranslation[1]);
+	
+	m_translation = translation;
+	m_instance.setTranslation(translation);
+}
+
+float Arrow::Renderer::getLocalX() const {
+	const RendererGL::ArrowData* data = m_instance.getData();
+	return (data!=nullptr) ? data->m_begin[0] : std::numeric_limits<float>::infinity();
+}
+
+void Arrow::Renderer::shift(float dx) {
+	RendererGL::ArrowData* data = m_instance.editData();
+	if (data!=nullptr)
+		data->translate(dx, 0.0);
 }
@@ -5,25 +5,43 @@
 #include <cassert>
 
 #include "draw_gl.hpp"
-#include "curves.hpp"
 
 class Arrow {
 public:
 	class Renderer {
 		Arrow& m_arrow;
-		ShowableBezier m_arrowBody;
-		ShowableLine m_tip[2];
+		RendererGL& m_rendererGL;
+		// Le corps et la pointe sont evalues par le vertex shader
+		RendererGL::PrimitiveData<RendererGL::ArrowData> m_instance;
 		unsigned int m_begin, m_end;
+		unsigned int m_animation = 0;
+		unsigned int m_translation;
+		
+		static RendererGL::ArrowData getData(float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y);
+		// Ramene les points dans les coordonnees de la translation de la fleche
+		void toLocal(RendererGL::ArrowData& data) const;
 		
 	public:
+		// Les points sont donnes dans les coordonnees de la structure, et gardes relatifs a la translation
 		Renderer(RendererGL& rendererGL, Arrow& arrow, float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y, int layer,
-				 unsigned int begin, unsigned int end);
+				 unsigned int begin, unsigned int end, unsigned int translation);
 		void changePoints(float p0x, float p0y, float p1x, float p1y, float t0x, float t0y, float t1x, float t1y);
+		// Le vertex shader deplace la fleche des premiers points aux seconds selon le temps du groupe animation,
+		// jusqu'au prochain changePoints
+		void animatePoints(unsigned int animation, float p0x0, float p0y0, float p1x0, float p1y0, float t0x0, float t0y0, float t1x0, float t1y0,
+						   float p0x1, float p0y1, float p1x1, float p1y1, float t0x1, float t0y1, float t1x1, float t1y1);
+		unsigned int getAnimation() const {return m_animation;}
 		void setBeginEnd(unsigned int begin, unsigned int end) {
 			m_begin = begin;
 			m_end = end;
 		}
 		void setLayer(int newLayer);
+		// La fleche reste a sa place: seuls ses points relatifs changent
+		void setTranslation(unsigned int translation);
+		// Abscisse du debut de la fleche dans les coordonnees de sa translation, infinie si elle n'est pas affichee
+		float getLocalX() const;
+		// Deplace la fleche de dx sans changer son animation
+		void shift(float dx);
 		
 		unsigned int begin()    const {return m_begin;}
 		unsigned int end()      const {return m_end;}
@@ -0,0 +1,64 @@
+#include "cancellation.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+#include <unistd.h>
+
+// Nombre d'appels a cancellationPoint entre deux mesures du temps et de la memoire
+#define BUDGET_CHECK_PERIOD 256
+
+static thread_local CancellationToken* currentToken = nullptr;
+static thread_local unsigned int pointsSinceCheck = 0;
+
+std::string WorkCancelled::what() const {
+	switch (m_reason) {
+		case TIME_BUDGET:
+			return "Time budget exceeded";
+		case MEMORY_BUDGET:
+			return "Memory budget exceeded";
+		default:
+			return "Cancelled";
+	}
+}
+
+void setCancellationToken(CancellationToken* token) {
+	currentToken = token;
+}
+
+CancellationToken* getCancellationToken() {
+	return currentToken;
+}
+
+// Memoire residente du processus, 0 si elle ne peut pas etre lue
+static size_t residentMemory() {
+	std::ifstream stream("/proc/self/statm");
+	size_t size, resident;
+	if (!(stream >> size >> resident))
+		return 0;
+	
+	return resident*static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void cancellationPoint() {
+	if (currentToken==nullptr)
+		return;
+	
+	if (currentToken->isRequested())
+		throw WorkCancelled(WorkCancelled::REQUESTED);
+	
+	if (++pointsSinceCheck < BUDGET_CHECK_PERIOD)
+		return;
+	pointsSinceCheck = 0;
+	
+	const WorkBudget& budget = currentToken->getBudget();
+	if (budget.maxSeconds>0.0) {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-currentToken->getStart();
+		if (elapsed.count() > budget.maxSeconds)
+			throw WorkCancelled(WorkCancelled::TIME_BUDGET);
+	}
+	
+	if (budget.maxMemory>0 && residentMemory() > budget.maxMemory)
+		throw WorkCancelled(WorkCancelled::MEMORY_BUDGET);
+}
@@ -0,0 +1,75 @@
+#ifndef __CANCELLATION_HPP__
+#define __CANCELLATION_HPP__
+
+#include <cstddef>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+// Lancee par cancellationPoint lorsque le travail en cours doit etre abandonne
+class WorkCancelled {
+public:
+	enum Reason {
+		REQUESTED,
+		TIME_BUDGET,
+		MEMORY_BUDGET
+	};
+	
+private:
+	Reason m_reason;
+	
+public:
+	WorkCancelled(Reason reason) : m_reason(reason) {}
+	
+	Reason getReason() const {return m_reason;}
+	std::string what() const;
+};
+
+// Budget d'une commande. Une valeur nulle signifie qu'il n'y a pas de limite.
+struct WorkBudget {
+	double maxSeconds;
+	size_t maxMemory; // En octets, memoire residente du processus
+	
+	WorkBudget() : maxSeconds(0.0), maxMemory(0) {}
+	WorkBudget(double seconds, size_t memory) : maxSeconds(seconds), maxMemory(memory) {}
+	
+	bool isLimited() const {return maxSeconds>0.0 || maxMemory>0;}
+};
+
+// Demande d'annulation et budget du travail d'une structure
+class CancellationToken {
+	std::atomic<bool> m_requested;
+	WorkBudget m_budget;
+	std::chrono::steady_clock::time_point m_start;
+	
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+	
+public:
+	CancellationToken() : m_requested(false) {}
+	
+	// Peut etre appele de n'importe quel thread
+	void request() {m_requested.store(true, std::memory_order_relaxed);}
+	// Remet la demande d'annulation a zero
+	void clear() {m_requested.store(false, std::memory_order_relaxed);}
+	bool isRequested() const {return m_requested.load(std::memory_order_relaxed);}
+	
+	// Demarre le budget de la prochaine commande
+	void begin(const WorkBudget& budget) {
+		m_budget = budget;
+		m_start = std::chrono::steady_clock::now();
+	}
+	
+	const WorkBudget& getBudget() const {return m_budget;}
+	std::chrono::steady_clock::time_point getStart() const {return m_start;}
+};
+
+// Jeton verifie par cancellationPoint dans le thread courant, nullptr si le travail ne peut pas etre annule
+void setCancellationToken(CancellationToken* token);
+CancellationToken* getCancellationToken();
+
+// Lance WorkCancelled si l'annulation a ete demandee ou si le budget est depasse.
+// Le temps et la memoire ne sont mesures qu'une fois toutes les quelques centaines d'appels.
+void cancellationPoint();
+
+#endif // __CANCELLATION_HPP__
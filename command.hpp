@@ -2,6 +2,9 @@
 #define __COMMAND_HPP__
 
 #include <string>
+#include <cstddef>
+
+#include "command_pool.hpp"
 
 template<class ... Types>
 class Command {
@@ -10,6 +13,9 @@ public:
 	virtual std::string name() const = 0;
 	virtual void clear() {delete this;}
 	virtual ~Command() {}
+	
+	static void* operator new(size_t size) {return allocateCommand(size);}
+	static void operator delete(void* ptr, size_t size) {deallocateCommand(ptr, size);}
 };
 
 #endif // __COMMAND_HPP__
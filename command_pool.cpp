@@ -0,0 +1,127 @@
+#include <new>
+#include <vector>
+
+#include <pthread.h>
+
+#include "command_pool.hpp"
+
+#define COMMAND_POOL_GRANULARITY 16
+#define COMMAND_POOL_MAX_SIZE    512
+#define COMMAND_POOL_NUM_CLASSES (COMMAND_POOL_MAX_SIZE/COMMAND_POOL_GRANULARITY)
+#define COMMAND_POOL_BATCH       64    // Nombre d'objets echanges d'un coup avec la reserve commune
+#define COMMAND_POOL_SLAB        65536 // Taille des blocs demandes au systeme
+
+struct FreeNode {
+	FreeNode* next;
+};
+
+struct FreeList {
+	FreeNode* head = nullptr;
+	size_t count = 0;
+	
+	void push(FreeNode* node) {
+		node->next = head;
+		head = node;
+		count++;
+	}
+	
+	FreeNode* pop() {
+		FreeNode* node = head;
+		head = node->next;
+		count--;
+		return node;
+	}
+	
+	// Detache les n premiers objets de la liste
+	FreeList split(size_t n) {
+		FreeList ret;
+		ret.head = head;
+		FreeNode* last = head;
+		for (size_t i=1; i<n; i++)
+			last = last->next;
+		head = last->next;
+		last->next = nullptr;
+		ret.count = n;
+		count -= n;
+		return ret;
+	}
+};
+
+// Lots d'objets libres partages entre les threads
+class Depot {
+	std::vector<FreeList> m_batches[COMMAND_POOL_NUM_CLASSES];
+	pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+	
+public:
+	void put(size_t sizeClass, FreeList batch) {
+		pthread_mutex_lock(&m_mutex);
+			m_batches[sizeClass].push_back(batch);
+		pthread_mutex_unlock(&m_mutex);
+	}
+	
+	bool take(size_t sizeClass, FreeList& batch) {
+		bool found = false;
+		pthread_mutex_lock(&m_mutex);
+			if (!m_batches[sizeClass].empty()) {
+				batch = m_batches[sizeClass].back();
+				m_batches[sizeClass].pop_back();
+				found = true;
+			}
+		pthread_mutex_unlock(&m_mutex);
+		return found;
+	}
+};
+
+static Depot depot;
+
+// Les objets restant dans les listes d'un thread qui se termine retournent a la reserve
+struct LocalCache {
+	FreeList lists[COMMAND_POOL_NUM_CLASSES];
+	
+	~LocalCache() {
+		for (size_t i=0; i<COMMAND_POOL_NUM_CLASSES; i++) {
+			if (lists[i].count>0)
+				depot.put(i, lists[i]);
+		}
+	}
+};
+
+static thread_local LocalCache localCache;
+
+static void refill(size_t sizeClass, FreeList& list) {
+	if (depot.take(sizeClass, list))
+		return;
+	
+	size_t size = (sizeClass+1)*COMMAND_POOL_GRANULARITY;
+	char* slab = static_cast<char*>(::operator new(COMMAND_POOL_SLAB));
+	for (size_t offset=0; offset+size<=COMMAND_POOL_SLAB; offset+=size)
+		list.push(reinterpret_cast<FreeNode*>(slab+offset));
+}
+
+void* allocateCommand(size_t size) {
+	if (size==0 || size>COMMAND_POOL_MAX_SIZE)
+		return ::operator new(size);
+	
+	size_t sizeClass = (size-1)/COMMAND_POOL_GRANULARITY;
+	FreeList& list = localCache.lists[sizeClass];
+	if (list.count==0)
+		refill(sizeClass, list);
+	
+	return list.pop();
+}
+
+void deallocateCommand(void* ptr, size_t size) {
+	if (ptr==nullptr)
+		return;
+	
+	if (size==0 || size>COMMAND_POOL_MAX_SIZE) {
+		::operator delete(ptr);
+		return;
+	}
+	
+	size_t sizeClass = (size-1)/COMMAND_POOL_GRANULARITY;
+	FreeList& list = localCache.lists[sizeClass];
+	list.push(static_cast<FreeNode*>(ptr));
+	if (list.count >= 2*COMMAND_POOL_BATCH)
+		depot.put(sizeClass, list.split(COMMAND_POOL_BATCH));
+}
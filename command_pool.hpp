@@ -0,0 +1,13 @@
+#ifndef __COMMAND_POOL_HPP__
+#define __COMMAND_POOL_HPP__
+
+#include <cstddef>
+
+// Allocation des commandes par classes de taille. Chaque thread garde une liste libre par classe;
+// les objets liberes par un autre thread que celui qui les a crees (ex. les commandes d'affichage
+// creees par le worker et liberees par le thread d'affichage) sont rendus par lots a une reserve commune.
+// La memoire n'est jamais rendue au systeme.
+void* allocateCommand(size_t size);
+void  deallocateCommand(void* ptr, size_t size);
+
+#endif // __COMMAND_POOL_HPP__
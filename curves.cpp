@@ -1,5 +1,6 @@
 #include <cassert>
 #include <cmath>
+#include <algorithm>
 
 #include "curves.hpp"
 
@@ -30,17 +31,20 @@ void Curve::getNormalToPoint(float& out_x, float& out_y, float t, float px, floa
 }
 
 void ShowableCurve::updateData() {
-	float delta = 2.0/m_data.size();
+	RendererGL::VertexData* data = m_primitiveData.editData();
+	if (data==nullptr) return;
+	
+	float delta = 2.0/m_numberOfVertex;
 	float newx, newy, oldx, oldy;
 	float t=0.0;
 	getCurve().getPoint(newx, newy, t);
-	for (size_t i=0; i<m_data.size()/2; i++) {
+	for (size_t i=0; i<m_numberOfVertex/2; i++) {
 		oldx = newx;
 		oldy = newy;
 		t+=delta;
 		getCurve().getPoint(newx, newy, t);
-		m_data[2*i]   = RendererGL::VertexData(oldx, oldy);
-		m_data[2*i+1] = RendererGL::VertexData(newx, newy);
+		data[2*i].setPosition(oldx, oldy, m_translation[0]);
+		data[2*i+1].setPosition(newx, newy, m_translation[(i+1==m_numberOfVertex/2) ? 1 : 0]);
 	}
 }
 
@@ -66,24 +70,35 @@ Bezier::Bezier(float p0x, float p0y, float c0x, float c0y, float p1x, float p1y,
 	changePoints(p0x, p0y, c0x, c0y, p1x, p1y, c1x, c1y);
 }
 
+// Gauss-Legendre a 8 points sur [-1, 1], noeuds positifs et poids
+static constexpr int gaussPoints = 4;
+static constexpr float gaussNodes[gaussPoints]   = {0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363};
+static constexpr float gaussWeights[gaussPoints] = {0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763};
+// Sous-intervalles de [0, 1] integres separement
+static constexpr int lenghtPanels = 2;
+
 float Bezier::getLenght() {
-	const int numStep = 100;
-	const float dt = 1.0/numStep;
-	
 	if (!m_calculatedLenght) {
+		// Differences des points de controle: la vitesse est 3*((1-t)^2*d0 + 2t(1-t)*d1 + t^2*d2)
+		float d[3][2];
+		for (int i=0; i<3; i++) {
+			d[i][0] = m_controlPoints[i+1][0]-m_controlPoints[i][0];
+			d[i][1] = m_controlPoints[i+1][1]-m_controlPoints[i][1];
+		}
+	
 		m_lenght = 0.0;
-		float old_x, old_y;
-		float new_x, new_y;
-		float dx, dy;
-		float t = 0.0;
-		getPoint(new_x, new_y, t);
-		for (int i=0; i<numStep; i++) {
-			t+=dt;
-			old_x = new_x; old_y = new_y;
-			getPoint(new_x, new_y, t);
-			dx = new_x - old_x;
-			dy = new_y - old_y;
-			m_lenght += sqrt(dx*dx+dy*dy);
+		const float halfWidth = 0.5/lenghtPanels;
+		for (int panel=0; panel<lenghtPanels; panel++) {
+			const float center = (2*panel+1)*halfWidth;
+			for (int i=0; i<gaussPoints; i++) {
+				for (int sign=-1; sign<=1; sign+=2) {
+					float t = center + sign*gaussNodes[i]*halfWidth;
+					float s = 1.0-t;
+					float dx = 3*(s*s*d[0][0] + 2*t*s*d[1][0] + t*t*d[2][0]);
+					float dy = 3*(s*s*d[0][1] + 2*t*s*d[1][1] + t*t*d[2][1]);
+					m_lenght += gaussWeights[i]*halfWidth*std::sqrt(dx*dx+dy*dy);
+				}
+			}
 		}
 		
 		m_calculatedLenght = true;
@@ -92,6 +107,17 @@ float Bezier::getLenght() {
 	return m_lenght;
 }
 
+float Bezier::getFlatnessStep(float tolerance) const {
+	float m = 0.0;
+	for (int i=0; i<2; i++) {
+		float dx = m_controlPoints[i][0] - 2*m_controlPoints[i+1][0] + m_controlPoints[i+2][0];
+		float dy = m_controlPoints[i][1] - 2*m_controlPoints[i+1][1] + m_controlPoints[i+2][1];
+		m = std::max(m, dx*dx+dy*dy);
+	}
+	
+	return std::sqrt(0.75*std::sqrt(m)/tolerance);
+}
+
 float Bezier::getPosComponent(float t, size_t component) const {
 	float c0 = (1.0-t)*(1.0-t)*(1.0-t);
 	float c1 = 3*t*(1.0-t)*(1.0-t);
@@ -128,6 +154,7 @@ void Bezier::changePoints(float p0x, float p0y, float c0x, float c0y, float p1x,
 	m_controlPoints[2][1] = p1y;
 	m_controlPoints[3][0] = c1x;
 	m_controlPoints[3][1] = c1y;
+	m_calculatedLenght = false;
 }
 
 /* Utilise l'algorithme de bissection-Newton pour approximer l'intersection
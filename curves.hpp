@@ -7,6 +7,11 @@
 
 #include "draw_gl.hpp"
 
+// Ecart maximal, en pixels, entre une courbe et ses segments a l'ecran
+#define CURVE_LOD_TOLERANCE 1.0
+// Nombre maximal de segments d'une courbe
+#define CURVE_LOD_MAX_STEP 64
+
 class Curve {
 protected:
 	virtual float getPosComponent(float t, size_t component) const =0;
@@ -22,31 +27,43 @@ public:
 
 class ShowableCurve {
 protected:
+	// Les sommets ne sont gardes que par le DrawData, et seulement quand la courbe est affichee
 	RendererGL::PrimitiveData<RendererGL::VertexData> m_primitiveData;
-	std::vector<RendererGL::VertexData> m_data;
+	size_t m_numberOfVertex;
+	// Translations du premier et du dernier point; les points interieurs suivent la premiere
+	unsigned int m_translation[2] = {0, 0};
 	
-	void updateData();
+	// Les classes derivees evaluent leur courbe sans appel virtuel par point
+	virtual void updateData();
 	
 public:
-	ShowableCurve(size_t num_step) : m_primitiveData(), m_data(2*num_step) {}
+	ShowableCurve(size_t num_step) : m_primitiveData(), m_numberOfVertex(2*num_step) {}
 	ShowableCurve(const ShowableCurve& other) = delete;
 	ShowableCurve(ShowableCurve&& other) = default;
 	
-	ShowableCurve(RendererGL& rendererGL, size_t num_step) : m_primitiveData(rendererGL), m_data(2*num_step) {}
+	ShowableCurve(RendererGL& rendererGL, size_t num_step) : m_primitiveData(rendererGL), m_numberOfVertex(2*num_step) {}
 	
 	ShowableCurve(RendererGL& rendererGL, const RendererGL::DisplayParam& displayParam, size_t num_step) : m_primitiveData(rendererGL, displayParam),
-			m_data(2*num_step) {}
+			m_numberOfVertex(2*num_step) {}
 	
 	ShowableCurve& operator=(ShowableCurve&& other) = default;
 	ShowableCurve& operator=(const ShowableCurve& other) = delete;
 	
 	virtual Curve& getCurve() =0;
 	virtual const Curve& getCurve() const =0;
-	virtual void show(RendererGL& rendererGL) {m_primitiveData.setDataWithSize(rendererGL, m_data.size(), m_data.data());}
+	virtual void show(RendererGL& rendererGL) {m_primitiveData.setDataWithSize(rendererGL, m_numberOfVertex, nullptr); updateData();}
 	virtual void hide() {m_primitiveData.remove();}
 	void setColor(float red, float green, float blue) {m_primitiveData.setColor(red, green, blue);}
 	void setLayer(int layer) {m_primitiveData.setLayer(layer);}
+	// Les points de la courbe deviennent relatifs aux translations: une ligne entre deux translations s'etire avec elles
+	void setTranslation(unsigned int begin, unsigned int end) {m_translation[0] = begin; m_translation[1] = end; updateData();}
+	unsigned int getTranslation(size_t end) const {return m_translation[end];}
 	float getLenght() {return getCurve().getLenght();}
+	// Groupe d'animation qui deplace les sommets, 0 si la courbe est immobile
+	unsigned int getAnimation() const {
+		const RendererGL::VertexData* data = m_primitiveData.getData();
+		return (data!=nullptr) ? data[0].m_animation : 0;
+	}
 	
 	void getPoint(float& out_x, float& out_y, float t) const {getCurve().getPoint(out_x, out_y, t);}
 	void getTangent(float& out_x, float& out_y, float t) const {getCurve().getTangent(out_x, out_y, t);}
@@ -57,7 +74,7 @@ template <class CURVE>
 class ShowableCurveTemplate : public ShowableCurve {
 protected:
 	CURVE m_curve;
-	void updateData();
+	virtual void updateData();
 	
 public:
 	ShowableCurveTemplate(size_t num_step) : ShowableCurve(num_step), m_curve() {}
@@ -65,17 +82,11 @@ public:
 	ShowableCurveTemplate(ShowableCurveTemplate<CURVE>&& other) = default;
 	
 	template<class ... ARGS>
-	ShowableCurveTemplate(RendererGL& rendererGL, size_t num_step, ARGS ... args) : ShowableCurve(rendererGL, num_step), m_curve(args...) {
-		updateData();
-		m_primitiveData.updateData(m_data.data());
-	}
+	ShowableCurveTemplate(RendererGL& rendererGL, size_t num_step, ARGS ... args) : ShowableCurve(rendererGL, num_step), m_curve(args...) {}
 	
 	template<class ... ARGS>
-	ShowableCurveTemplate(RendererGL& rendererGL, const RendererGL::DisplayParam& displayParam, size_t num_step, ARGS ... args) : ShowableCurve(rendererGL, displayParam),
-			m_curve(args...) {
-		updateData();
-		m_primitiveData.updateData(m_data.data());
-	}
+	ShowableCurveTemplate(RendererGL& rendererGL, const RendererGL::DisplayParam& displayParam, size_t num_step, ARGS ... args) : ShowableCurve(rendererGL, displayParam, num_step),
+			m_curve(args...) {}
 	
 	ShowableCurveTemplate& operator=(ShowableCurveTemplate&& other) = default;
 	ShowableCurveTemplate& operator=(const ShowableCurveTemplate& other) = delete;
@@ -87,14 +98,22 @@ public:
 	void changePoints(ARGS ... args) {
 		m_curve.changePoints(args...);
 		updateData();
-		m_primitiveData.updateData(m_data.data());
 	}
 	
 	void changePoints(const CURVE& curve) {
 		m_curve = curve;
 		updateData();
-		m_primitiveData.updateData(m_data.data());
 	}
+	
+	// Les sommets vont de la courbe courante a target selon le temps du groupe animation, sans etre renvoyes a chaque image
+	void startAnimation(const CURVE& target, unsigned int animation);
+	
+	// Change la courbe sans envoyer les sommets: l'affichage suit le groupe d'animation
+	template <class ... ARGS>
+	void setAnimatedPoints(ARGS ... args) {m_curve.changePoints(args...);}
+	
+	// Envoie les sommets de la courbe courante, immobiles
+	void stopAnimation() {updateData();}
 };
 
 template <class CURVE, size_t N>
@@ -110,38 +129,69 @@ public:
 		ShowableCurveTemplate<CURVE>(rendererGL, displayParam, N, args...) {}
 };
 
+// Le nombre de segments de chaque courbe suit sa taille a l'ecran. La courbe est inscrite aupres du renderer
+// qui l'affiche, et seul celui-ci la retessele (voir RendererGL::updateLevelOfDetail).
 template <class CURVE>
-class ShowableCurveVariableVertices : public ShowableCurveTemplate<CURVE> {
-	static size_t m_num_step;
-	static std::list<ShowableCurveVariableVertices<CURVE>*> m_listCurve;
-	
-	typename std::list<ShowableCurveVariableVertices<CURVE>*>::iterator m_it = m_listCurve.end();
+class ShowableCurveVariableVertices : public ShowableCurveTemplate<CURVE>, public RendererGL::LevelOfDetail {
+	RendererGL* m_renderer = nullptr; // nullptr si la courbe n'est pas inscrite
+	RendererGL::LevelOfDetailList::iterator m_it;
 	bool shown = false;
 	
+	// Puissance de 2 assez grande pour l'echelle pixelScale; currentStep est garde tant qu'il ne depasse pas 4 fois ce qu'il faut
+	size_t getLodStep(float pixelScale, size_t currentStep) const {
+		float ideal = this->m_curve.getFlatnessStep(CURVE_LOD_TOLERANCE/pixelScale);
+		size_t step = 1;
+		while (step<ideal && step<CURVE_LOD_MAX_STEP)
+			step *= 2;
+		return (currentStep>=step && currentStep<4*step) ? currentStep : step;
+	}
+	
+	void registerIn(RendererGL& rendererGL) {
+		m_renderer = &rendererGL;
+		RendererGL::LevelOfDetailList& list = rendererGL.getLevelOfDetailList();
+		m_it = list.insert(list.end(), this);
+	}
+	
+	void unregister() {
+		if (m_renderer!=nullptr)
+			m_renderer->getLevelOfDetailList().erase(m_it);
+		m_renderer = nullptr;
+	}
+	
+	// Prend l'inscription de other
+	void takeRegistration(ShowableCurveVariableVertices<CURVE>& other) {
+		m_renderer = other.m_renderer;
+		m_it = other.m_it;
+		if (m_renderer!=nullptr)
+			*m_it = this;
+		other.m_renderer = nullptr;
+	}
+	
 public:
-	ShowableCurveVariableVertices() : ShowableCurveTemplate<CURVE>(m_num_step) {}
-	ShowableCurveVariableVertices(ShowableCurveVariableVertices<CURVE>&& other) : ShowableCurveTemplate<CURVE>(std::move(other)), m_it(other.m_it) {
-		other.m_it = m_listCurve.end();
+	ShowableCurveVariableVertices() : ShowableCurveTemplate<CURVE>(1) {}
+	ShowableCurveVariableVertices(ShowableCurveVariableVertices<CURVE>&& other) : ShowableCurveTemplate<CURVE>(std::move(other)), shown(other.shown) {
+		takeRegistration(other);
 	}
 	
 	template<class ... ARGS>
-	ShowableCurveVariableVertices(RendererGL& rendererGL, ARGS ... args) : ShowableCurveTemplate<CURVE>(rendererGL, m_num_step, args...) {
-		m_listCurve.push_back(this);
-		m_it = --m_listCurve.end();
+	ShowableCurveVariableVertices(RendererGL& rendererGL, ARGS ... args) : ShowableCurveTemplate<CURVE>(rendererGL, 1, args...) {
+		this->m_numberOfVertex = 2*getLodStep(rendererGL.getPixelScale(), 0);
+		registerIn(rendererGL);
 	}
 	
 	template<class ... ARGS>
 	ShowableCurveVariableVertices(RendererGL& rendererGL, const RendererGL::DisplayParam& displayParam, ARGS ... args) :
-			ShowableCurveTemplate<CURVE>(rendererGL, displayParam, m_num_step, args...) {
-		m_listCurve.push_back(this);
-		m_it = --m_listCurve.end();
+			ShowableCurveTemplate<CURVE>(rendererGL, displayParam, 1, args...) {
+		this->m_numberOfVertex = 2*getLodStep(rendererGL.getPixelScale(), 0);
+		registerIn(rendererGL);
 	}
 	
-	~ShowableCurveVariableVertices() {if (m_it!=m_listCurve.end()) m_listCurve.erase(m_it);}
+	~ShowableCurveVariableVertices() {unregister();}
 	
 	ShowableCurveVariableVertices<CURVE>& operator=(ShowableCurveVariableVertices<CURVE>&& other) {
-		m_it = other.m_it;
-		other.m_it = m_listCurve.end();
+		unregister();
+		takeRegistration(other);
+		shown = other.shown;
 		ShowableCurveTemplate<CURVE>::operator=(std::move(other));
 		return *this;
 	}
@@ -149,7 +199,17 @@ public:
 	virtual void show(RendererGL& rendererGL) {shown = true; ShowableCurveTemplate<CURVE>::show(rendererGL);}
 	virtual void hide() {shown = false; ShowableCurveTemplate<CURVE>::hide();}
 	
-	static void changeNumStep(RendererGL& rendererGL, size_t new_num_step);
+	// Les courbes animees attendent la fin de l'animation
+	virtual bool updateLevelOfDetail(RendererGL& rendererGL, float pixelScale) {
+		if (!shown || this->getAnimation()!=0) return false;
+		
+		size_t step = getLodStep(pixelScale, this->m_numberOfVertex/2);
+		if (2*step==this->m_numberOfVertex) return false;
+		
+		this->m_numberOfVertex = 2*step;
+		show(rendererGL);
+		return true;
+	}
 };
 
 class Line : public Curve {
@@ -168,6 +228,16 @@ public:
 	
 	virtual float getLenght();
 	
+	// Appelle f(i, x, y) pour les points t = i/numStep, i=0..numStep
+	template <class F>
+	void forEachPoint(size_t numStep, F f) const {
+		float dx = (m_data[1][0]-m_data[0][0])/numStep;
+		float dy = (m_data[1][1]-m_data[0][1])/numStep;
+		for (size_t i=0; i<numStep; i++)
+			f(i, m_data[0][0]+i*dx, m_data[0][1]+i*dy);
+		f(numStep, m_data[1][0], m_data[1][1]);
+	}
+	
 	void changePoints(float p0x, float p0y, float p1x, float p1y) {
 		m_data[0][0] = p0x;
 		m_data[0][1] = p0y;
@@ -192,6 +262,13 @@ public:
 	Bezier(float p0x, float p0y, float c0x, float c0y, float p1x, float p1y, float c1x, float c1y);
 	
 	virtual float getLenght();
+	// Nombre de segments pour que la ligne brisee reste a moins de tolerance de la courbe (formule de Wang)
+	float getFlatnessStep(float tolerance) const;
+	
+	// Appelle f(i, x, y) pour les points t = i/numStep, i=0..numStep, par differences avancees.
+	// Le dernier point est exactement la fin de la courbe.
+	template <class F>
+	void forEachPoint(size_t numStep, F f) const;
 	
 	void changePoints(float p0x, float p0y, float c0x, float c0y, float p1x, float p1y, float c1x, float c1y);
 	float getIntersectionXCoordMatch(const Bezier& other) const;
@@ -199,40 +276,60 @@ public:
 	const float* getControlPoints() const {return &m_controlPoints[0][0];}
 };
 
-template <class CURVE>
-void ShowableCurveTemplate<CURVE>::updateData() {
-	float delta = 2.0/m_data.size();
-	float newx, newy, oldx, oldy;
-	float t=0.0;
-	m_curve.getPoint(newx, newy, t);
-	for (size_t i=0; i<m_data.size()/2; i++) {
-		oldx = newx;
-		oldy = newy;
-		t+=delta;
-		m_curve.getPoint(newx, newy, t);
-		m_data[2*i]   = RendererGL::VertexData(oldx, oldy);
-		m_data[2*i+1] = RendererGL::VertexData(newx, newy);
+template <class F>
+void Bezier::forEachPoint(size_t numStep, F f) const {
+	const float h = 1.0/numStep;
+	float p[2], d1[2], d2[2], d3[2];
+	for (int k=0; k<2; k++) {
+		// Coefficients de t^3, t^2 et t
+		float a = m_controlPoints[3][k] - 3*m_controlPoints[2][k] + 3*m_controlPoints[1][k] - m_controlPoints[0][k];
+		float b = 3*(m_controlPoints[2][k] - 2*m_controlPoints[1][k] + m_controlPoints[0][k]);
+		float c = 3*(m_controlPoints[1][k] - m_controlPoints[0][k]);
+		p[k]  = m_controlPoints[0][k];
+		d1[k] = ((a*h + b)*h + c)*h;
+		d2[k] = (6*a*h + 2*b)*h*h;
+		d3[k] = 6*a*h*h*h;
+	}
+	
+	for (size_t i=0; i<numStep; i++) {
+		f(i, p[0], p[1]);
+		for (int k=0; k<2; k++) {
+			p[k]  += d1[k];
+			d1[k] += d2[k];
+			d2[k] += d3[k];
+		}
 	}
+	f(numStep, m_controlPoints[3][0], m_controlPoints[3][1]);
 }
 
 template <class CURVE>
-size_t ShowableCurveVariableVertices<CURVE>::m_num_step = 10;
-
-template <class CURVE>
-std::list<ShowableCurveVariableVertices<CURVE>*> ShowableCurveVariableVertices<CURVE>::m_listCurve;
+void ShowableCurveTemplate<CURVE>::updateData() {
+	RendererGL::VertexData* data = m_primitiveData.editData();
+	if (data==nullptr) return;
+	
+	// Chaque point interieur termine un segment et commence le suivant
+	const size_t numStep = m_numberOfVertex/2;
+	const unsigned int begin = m_translation[0];
+	const unsigned int end   = m_translation[1];
+	m_curve.forEachPoint(numStep, [data, numStep, begin, end](size_t i, float x, float y) {
+		const unsigned int translation = (i==numStep) ? end : begin;
+		if (i>0)       data[2*i-1].setPosition(x, y, translation);
+		if (i<numStep) data[2*i].setPosition(x, y, translation);
+	});
+}
 
 template <class CURVE>
-void ShowableCurveVariableVertices<CURVE>::changeNumStep(RendererGL& rendererGL, size_t new_num_step) {
-		assert(new_num_step>0);
+void ShowableCurveTemplate<CURVE>::startAnimation(const CURVE& target, unsigned int animation) {
+	updateData();
 	
-	m_num_step = new_num_step;
-	for (auto it = m_listCurve.begin(); it!=m_listCurve.end(); it++) {
-		ShowableCurveVariableVertices<CURVE>& curve = **it;
-		curve.m_data.resize(2*m_num_step);
-		curve.updateData();
-		if (curve.shown)
-			curve.primitiveData.setDataWithSize(rendererGL, 2*m_num_step, curve.data);
-	}
+	RendererGL::VertexData* data = m_primitiveData.editData();
+	if (data==nullptr) return;
+	
+	const size_t numStep = m_numberOfVertex/2;
+	target.forEachPoint(numStep, [data, numStep, animation](size_t i, float x, float y) {
+		if (i>0)       data[2*i-1].setTarget(x, y, animation);
+		if (i<numStep) data[2*i].setTarget(x, y, animation);
+	});
 }
 
 typedef ShowableCurveVariableVertices<Bezier> ShowableBezier;
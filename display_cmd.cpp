@@ -1,23 +1,75 @@
 #include <queue>
 #include <vector>
 #include <map>
+#include <set>
+#include <limits>
 #include <cmath>
 #include <utility>
 #include <tuple>
 #include <cassert>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
 
 #include <pthread.h>
 
 #include "display_cmd.hpp"
 #include "command.hpp"
+#include "spsc_channel.hpp"
 #include "zero_handle.hpp"
 #include "one_handle.hpp"
 #include "arrow.hpp"
 
-static std::queue<Command<RendererGL&>*> displayQueue;
-static std::queue<Command<RendererGL&, float, float&>*> subCommandQueue;
-static pthread_mutex_t       displayMutex;
-static ZeroHandleRenderer* zeroHandleCurrent = nullptr;
+// Nombre de commandes en attente au dela duquel le thread de travail attend l'affichage
+#define DEFAULT_DISPLAY_QUEUE_CAPACITY 1024
+// Temps en secondes que le thread d'affichage passe au plus par image a executer des commandes instantanees
+#define DEFAULT_DISPLAY_FRAME_BUDGET 0.004
+
+// Contexte dont le thread d'affichage execute les commandes
+static DisplayContext* activeDisplay = nullptr;
+static thread_local DisplayContext* displayContext = nullptr;
+static thread_local DisplayCommandBuffer* displayBuffer = nullptr;
+
+// Rafraichissements retardes pendant l'avance rapide, appliques une seule fois par boite
+class DeferredRefresh {
+	std::map<OneHandleRenderer*, bool> m_oneHandles; // Longueur changee, replacer aussi les fleches
+	std::map<ArrowBox::Renderer*, std::pair<bool, bool>> m_arrowBoxes;
+	std::set<PermutationBox::Renderer*> m_permutationBoxes;
+	
+public:
+	void addLenght(OneHandleRenderer& oneHandle, bool updateArrows) {
+		bool& flag = m_oneHandles[&oneHandle];
+		flag = flag || updateArrows;
+	}
+	
+	void addArrowBox(ArrowBox::Renderer& arrowBox, bool refreshLenght, bool refreshTracks) {
+		std::pair<bool, bool>& flags = m_arrowBoxes[&arrowBox];
+		flags.first  = flags.first  || refreshLenght;
+		flags.second = flags.second || refreshTracks;
+	}
+	
+	void addPermutationBox(PermutationBox::Renderer& permutationBox) {m_permutationBoxes.insert(&permutationBox);}
+	bool empty() const {return m_oneHandles.empty() && m_arrowBoxes.empty() && m_permutationBoxes.empty();}
+	
+	void clear() {
+		m_oneHandles.clear();
+		m_arrowBoxes.clear();
+		m_permutationBoxes.clear();
+	}
+	
+	void apply() {
+		for (auto it=m_oneHandles.begin(); it!=m_oneHandles.end(); ++it)
+			it->first->updateLenght(it->second);
+		for (auto it=m_arrowBoxes.begin(); it!=m_arrowBoxes.end(); ++it) {
+			it->first->refreshArrows();
+			if (it->second.first)  it->first->refreshLenght();
+			if (it->second.second) it->first->refreshTracks();
+		}
+		for (auto it=m_permutationBoxes.begin(); it!=m_permutationBoxes.end(); ++it)
+			(*it)->refresh();
+		clear();
+	}
+};
 
 void AnimateMoveArrowInArrowBoxCommand::addArrow(Arrow::Renderer& arrow, float p0x0, float p0y0, float p1x0, float p1y0, float t0x0, float t0y0, float t1x0, float t1y0,
 								float p0x1, float p0y1, float p1x1, float p1y1, float t0x1, float t0y1, float t1x1, float t1y1) {
@@ -32,20 +84,118 @@ void AnimateMoveArrowInArrowBoxCommand::addArrow(Arrow::Renderer& arrow, float p
 								p0x1, p0y1, p1x1, p1y1, t0x1, t0y1, t1x1, t1y1));
 }
 
-void AnimateMoveArrowInArrowBoxCommand::run(RendererGL& rendererGL, float t) {
+AnimateMoveArrowInArrowBoxCommand::~AnimateMoveArrowInArrowBoxCommand() {
+	// Le decalage est termine avant de fixer les fleches de l'animation, qui peuvent arriver dans la plage.
+	// Seules les fleches choisies au debut sont fixees a leur position decalee.
+	if (m_shiftTranslation!=0) {
+		m_renderer->endTranslationShift(m_shiftTranslation);
+		m_shiftTranslation = 0;
+	}
+	if (!m_shiftedArrows.empty())
+		shift(1.0);
+	
+	if (m_animation==0) return;
+	
+	// Les fleches restent a leur position de la derniere image, sauf celles deplacees depuis par une autre commande.
+	// Si une fleche est ajoutee plusieurs fois, le dernier deplacement l'emporte.
+	for (size_t i=m_arrowsMoveData.size(); i-->0;) {
+		if (m_arrowsMoveData[i].first->getAnimation()==m_animation)
+			moveArrow(i, m_t);
+	}
+	m_renderer->endAnimation(m_animation);
+}
+
+void AnimateMoveArrowInArrowBoxCommand::moveArrow(size_t i, float t) {
 	const float x = m_arrowBox.getBasex();
 	const float y = m_arrowBox.getBasey();
 	float s = 1.0-t;
 	
+	MoveData& md = m_arrowsMoveData[i].second;
+	if (m_isAbsolute)
+		m_arrowsMoveData[i].first->changePoints(s*md.m_p0x0+t*md.m_p0x1, s*md.m_p0y0+t*md.m_p0y1, s*md.m_p1x0+t*md.m_p1x1, s*md.m_p1y0+t*md.m_p1y1, 
+							s*md.m_t0x0+t*md.m_t0x1, s*md.m_t0y0+t*md.m_t0y1, s*md.m_t1x0+t*md.m_t1x1, s*md.m_t1y0+t*md.m_t1y1);
+	else
+		m_arrowsMoveData[i].first->changePoints(x+(s*md.m_p0x0+t*md.m_p0x1), y-(s*md.m_p0y0+t*md.m_p0y1), x+(s*md.m_p1x0+t*md.m_p1x1), y-(s*md.m_p1y0+t*md.m_p1y1),
+							s*md.m_t0x0+t*md.m_t0x1, s*md.m_t0y0+t*md.m_t0y1, s*md.m_t1x0+t*md.m_t1x1, s*md.m_t1y0+t*md.m_t1y1);
+}
+
+void AnimateMoveArrowInArrowBoxCommand::animateArrow(size_t i) {
+	const float x = (m_isAbsolute) ? 0.0 : m_basex;
+	const float y = (m_isAbsolute) ? 0.0 : m_basey;
+	const float sgn = (m_isAbsolute) ? 1.0 : -1.0;
+	
+	MoveData& md = m_arrowsMoveData[i].second;
+	m_arrowsMoveData[i].first->animatePoints(m_animation,
+			x+md.m_p0x0, y+sgn*md.m_p0y0, x+md.m_p1x0, y+sgn*md.m_p1y0, md.m_t0x0, md.m_t0y0, md.m_t1x0, md.m_t1y0,
+			x+md.m_p0x1, y+sgn*md.m_p0y1, x+md.m_p1x1, y+sgn*md.m_p1y1, md.m_t0x1, md.m_t0y1, md.m_t1x1, md.m_t1y1);
+}
+
+// Les fleches a decaler sont choisies avant que celles de l'animation ne soient deplacees, et sans elles.
+// Sans groupe d'animation, les fleches de l'animation restent dans le groupe 0 et le vertex shader les decalerait aussi:
+// chaque fleche est alors deplacee depuis son abscisse de depart.
+void AnimateMoveArrowInArrowBoxCommand::startShift(RendererGL& rendererGL, float t) {
+	std::vector<Arrow::Renderer*> arrows;
+	m_arrowBox.getArrowsInRange(m_shiftStart, m_shiftEnd, arrows);
+	m_shiftedArrows.reserve(arrows.size());
+	for (size_t i=0; i<arrows.size(); i++) {
+		bool isMoved = false;
+		for (size_t j=0; j<m_arrowsMoveData.size() && !isMoved; j++)
+			isMoved = (m_arrowsMoveData[j].first==arrows[i]);
+		if (!isMoved)
+			m_shiftedArrows.emplace_back(arrows[i], arrows[i]->getLocalX());
+	}
+	
+	const unsigned int translation = m_arrowBox.getTranslation();
+	if (t<1.0 && m_animation!=0 && rendererGL.startTranslationShift(translation)) {
+		m_renderer = &rendererGL;
+		m_shiftTranslation = translation;
+	}
+}
+
+// Le vertex shader decale la plage, ou chaque fleche est replacee depuis son abscisse de depart:
+// la boite a pu les rafraichir entre temps
+void AnimateMoveArrowInArrowBoxCommand::shift(float t) {
+	if (m_shiftTranslation!=0) {
+		m_renderer->setTranslationShift(m_shiftTranslation, m_arrowBox.toTranslationX(m_shiftStart), m_arrowBox.toTranslationX(m_shiftEnd), t*m_shiftDx);
+		return;
+	}
+	
+	for (size_t i=0; i<m_shiftedArrows.size(); i++)
+		m_shiftedArrows[i].first->shift(m_shiftedArrows[i].second+t*m_shiftDx-m_shiftedArrows[i].first->getLocalX());
+}
+
+void AnimateMoveArrowInArrowBoxCommand::run(RendererGL& rendererGL, float t) {
+	bool first = false;
+	if (!m_started) {
+		m_started = first = true;
+		if (t<1.0) {
+			m_renderer = &rendererGL;
+			m_animation = rendererGL.startAnimation();
+		}
+		if (m_hasShift)
+			startShift(rendererGL, t);
+	}
+	
+	m_t = t;
+	if (m_hasShift)
+		shift(t);
+	if (m_animation==0) {
+		for (size_t i=0; i<m_arrowsMoveData.size(); i++)
+			moveArrow(i, t);
+		return;
+	}
+	
+	// Les positions de depart et d'arrivee sont envoyees une fois, puis seul le temps du groupe change.
+	// Elles sont renvoyees si la boite se deplace ou si une fleche a ete replacee entre temps.
+	const bool rebased = !m_isAbsolute && (m_arrowBox.getBasex()!=m_basex || m_arrowBox.getBasey()!=m_basey);
+	m_basex = m_arrowBox.getBasex();
+	m_basey = m_arrowBox.getBasey();
 	for (size_t i=0; i<m_arrowsMoveData.size(); i++) {
-		MoveData& md = m_arrowsMoveData[i].second;
-		if (m_isAbsolute)
-			m_arrowsMoveData[i].first->changePoints(s*md.m_p0x0+t*md.m_p0x1, s*md.m_p0y0+t*md.m_p0y1, s*md.m_p1x0+t*md.m_p1x1, s*md.m_p1y0+t*md.m_p1y1, 
-								s*md.m_t0x0+t*md.m_t0x1, s*md.m_t0y0+t*md.m_t0y1, s*md.m_t1x0+t*md.m_t1x1, s*md.m_t1y0+t*md.m_t1y1);
-		else
-			m_arrowsMoveData[i].first->changePoints(x+(s*md.m_p0x0+t*md.m_p0x1), y-(s*md.m_p0y0+t*md.m_p0y1), x+(s*md.m_p1x0+t*md.m_p1x1), y-(s*md.m_p1y0+t*md.m_p1y1),
-								s*md.m_t0x0+t*md.m_t0x1, s*md.m_t0y0+t*md.m_t0y1, s*md.m_t1x0+t*md.m_t1x1, s*md.m_t1y0+t*md.m_t1y1);
+		const unsigned int animation = m_arrowsMoveData[i].first->getAnimation();
+		if (first || animation==0 || (rebased && animation==m_animation))
+			animateArrow(i);
 	}
+	rendererGL.setAnimationTime(m_animation, t);
 }
 
 void AnimateMoveTrackLineArrowBox::addTrack(TrackLine& track, float p0x0, float p0y0, float p1x0, float p1y0, float p0x1, float p0y1, float p1x1, float p1y1) {
@@ -56,12 +206,46 @@ void AnimateMoveTrackLineArrowBox::addTrack(TrackLine& track, float p0x0, float
 							   std::forward_as_tuple(x+p0x0, y-p0y0, x+p1x0, y-p1y0, x+p0x1, y-p0y1, x+p1x1, y-p1y1));
 }
 
+AnimateMoveTrackLineArrowBox::~AnimateMoveTrackLineArrowBox() {
+	if (m_animation==0) return;
+	
+	for (size_t i=m_trackMoveData.size(); i-->0;) {
+		if (m_trackMoveData[i].first->getCurve().getAnimation()==m_animation)
+			m_trackMoveData[i].first->stopAnimation();
+	}
+	m_renderer->endAnimation(m_animation);
+}
+
 void AnimateMoveTrackLineArrowBox::run(RendererGL& rendererGL, float t) {
 	float s = 1.0-t;
 	
+	bool first = false;
+	if (!m_started) {
+		m_started = first = true;
+		if (t<1.0) {
+			m_renderer = &rendererGL;
+			m_animation = rendererGL.startAnimation();
+		}
+	}
+	
+	// Une voie replacee depuis par une autre commande est reprise par le groupe
+	for (size_t i=0; m_animation!=0 && i<m_trackMoveData.size(); i++) {
+		MoveData& md = m_trackMoveData[i].second;
+		if (first || m_trackMoveData[i].first->getCurve().getAnimation()==0)
+			m_trackMoveData[i].first->startAnimation(md.m_p0x0, md.m_p0y0, md.m_p1x0, md.m_p1y0, md.m_p0x1, md.m_p0y1, md.m_p1x1, md.m_p1y1, m_animation);
+	}
+	
+	if (m_animation!=0)
+		rendererGL.setAnimationTime(m_animation, t);
+	
+	// Les voies restent a jour pour les calculs de position, sans que leurs sommets soient renvoyes
 	for (unsigned int i=0; i<m_trackMoveData.size(); i++) {
 		MoveData& md = m_trackMoveData[i].second;
-		m_trackMoveData[i].first->changePoints(s*md.m_p0x0+t*md.m_p0x1, s*md.m_p0y0+t*md.m_p0y1, s*md.m_p1x0+t*md.m_p1x1, s*md.m_p1y0+t*md.m_p1y1);
+		const unsigned int animation = m_trackMoveData[i].first->getCurve().getAnimation();
+		if (m_animation!=0 && animation==m_animation)
+			m_trackMoveData[i].first->setAnimatedPoints(s*md.m_p0x0+t*md.m_p0x1, s*md.m_p0y0+t*md.m_p0y1, s*md.m_p1x0+t*md.m_p1x1, s*md.m_p1y0+t*md.m_p1y1);
+		else if (m_animation==0 || animation==0) // Voie cachee: aucun sommet a envoyer
+			m_trackMoveData[i].first->changePoints(s*md.m_p0x0+t*md.m_p0x1, s*md.m_p0y0+t*md.m_p0y1, s*md.m_p1x0+t*md.m_p1x1, s*md.m_p1y0+t*md.m_p1y1);
 	}
 }
 
@@ -110,9 +294,39 @@ void AnimateInterpolateShowableBezierCurve::addCurve(ShowableBezier& curve, Bezi
 	m_curves.emplace_back(std::piecewise_construct, std::forward_as_tuple(&curve), std::forward_as_tuple(curve0, curve1));
 }
 	
+AnimateInterpolateShowableBezierCurve::~AnimateInterpolateShowableBezierCurve() {
+	if (m_animation==0) return;
+	
+	for (size_t i=m_curves.size(); i-->0;) {
+		if (m_curves[i].first->getAnimation()==m_animation)
+			m_curves[i].first->stopAnimation();
+	}
+	m_renderer->endAnimation(m_animation);
+}
+
 void AnimateInterpolateShowableBezierCurve::run(RendererGL& rendererGL, float t) {
 	float s = 1.0-t;
 	
+	bool first = false;
+	if (!m_started) {
+		m_started = first = true;
+		if (t<1.0) {
+			m_renderer = &rendererGL;
+			m_animation = rendererGL.startAnimation();
+		}
+	}
+	
+	for (size_t i=0; m_animation!=0 && i<m_curves.size(); i++) {
+		if (first || m_curves[i].first->getAnimation()==0) {
+			const float* c0 = m_curves[i].second.m_curve0.getControlPoints();
+			m_curves[i].first->setAnimatedPoints(c0[0], c0[1], c0[2], c0[3], c0[4], c0[5], c0[6], c0[7]);
+			m_curves[i].first->startAnimation(m_curves[i].second.m_curve1, m_animation);
+		}
+	}
+	
+	if (m_animation!=0)
+		rendererGL.setAnimationTime(m_animation, t);
+	
 	for (size_t i=0; i<m_curves.size(); i++) {
 		const float* c0 = m_curves[i].second.m_curve0.getControlPoints();
 		const float* c1 = m_curves[i].second.m_curve1.getControlPoints();
@@ -120,7 +334,11 @@ void AnimateInterpolateShowableBezierCurve::run(RendererGL& rendererGL, float t)
 		for (int j=0; j<4*2; j++)
 			c[j] = s*c0[j] + t*c1[j];
 		
-		m_curves[i].first->changePoints(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7]);
+		const unsigned int animation = m_curves[i].first->getAnimation();
+		if (m_animation!=0 && animation==m_animation)
+			m_curves[i].first->setAnimatedPoints(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7]);
+		else if (m_animation==0 || animation==0)
+			m_curves[i].first->changePoints(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7]);
 	}
 }
 
@@ -241,16 +459,20 @@ void AsynchronousSubTaskCommand::run(RendererGL& rendererGL, float dt, float& pa
 	pastTime = m_t-m_duration;
 	
 	if (pastTime>=0.0) {
-		while (!m_cmd.empty()) {
-			delete m_cmd.top().m_cmd;
-			m_cmd.pop();
-		}
-		
+		// Les sous-taches restantes sont amenees a leur etat final: certaines changent un etat
+		// (calque d'une fleche, longueur d'une boite) qu'aucun rafraichissement ne retablit
 		auto it=m_executingCmd.begin();
 		while (it!=m_executingCmd.end()) {
+			it->m_cmd->run(rendererGL, 1.0);
 			delete it->m_cmd;
 			it = m_executingCmd.erase(it);
 		}
+		
+		while (!m_cmd.empty()) {
+			m_cmd.top().m_cmd->run(rendererGL, 1.0);
+			delete m_cmd.top().m_cmd;
+			m_cmd.pop();
+		}
 	} else {
 		while (!m_cmd.empty() && m_cmd.top().m_taskBegin <= m_t) {
 			m_executingCmd.emplace_back(m_cmd.top().m_cmd, m_cmd.top().m_taskBegin, m_cmd.top().m_taskEnd);
@@ -408,6 +630,16 @@ public:
 	virtual std::string name() const {return "DeleteZeroHandleCommand";}
 };
 
+// Fin d'une etape de l'algorithme: l'avance rapide s'arrete apres cette commande
+class KeyframeCommand : public Command<RendererGL&> {
+public:
+	static Command<RendererGL&>* create() {return new KeyframeCommand;}
+	
+	virtual void run(RendererGL& rendererGL) {activeDisplay->reachKeyframe();}
+	
+	virtual std::string name() const {return "KeyframeCommand";}
+};
+
 class DrawZeroHandleCommand : public Command<RendererGL&> {
 private:
 	const Pairing m_pairing;
@@ -485,7 +717,7 @@ private:
 		ArrowBox::ArrowInArrowBox& newArrow, unsigned int from, unsigned int to, bool genAfter) :
 			m_arrowBox(arrowBox), m_movingArrow(movingArrow), m_targetArrow(targetArrow), m_newArrow(newArrow), m_from(from), m_to(to), m_genAfter(genAfter)
 	{assert(movingArrow.second != targetArrow.second);}
-
+	
 public:
 	static Command<RendererGL&>* create(ArrowBox& arrowBox, ArrowInArrowBoxIndexed movingArrow, ArrowInArrowBoxIndexed targetArrow,
 		ArrowBox::ArrowInArrowBox& newArrow, unsigned int from, unsigned int to, bool genAfter) {
@@ -888,13 +1120,39 @@ void MoveArrowsAcrossZeroHandle::run(RendererGL& rendererGL) {
 	AsynchronousSubTaskCommand* cmd = AsynchronousSubTaskCommand::create();
 	MoveData moveData(std::move(m_arrows.top())); m_arrows.pop();
 	moveArrow(cmd, moveData, 0.0, 0, 0, 0.0);
-	subCommandQueue.push(cmd);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getVoidHandle().getFirstArrowBox(), false, true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getVoidHandle().getSecondArrowBox(), false, true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getFullHandle().getFirstArrowBox(), false, true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getFullHandle().getSecondArrowBox(), false, true));
+	activeDisplay->pushSubCommand(cmd);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getVoidHandle().getFirstArrowBox(), false, true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getVoidHandle().getSecondArrowBox(), false, true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getFullHandle().getFirstArrowBox(), false, true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(m_zeroHandle.getRenderer().getFullHandle().getSecondArrowBox(), false, true));
 }
 
+class RestorePermutationBoxesCommand : public Command<RendererGL&> {
+	OneHandle& m_oneHandle;
+	Permutation m_preInvPer;
+	Permutation m_invPer;
+	Permutation m_postInvPer;
+	
+	RestorePermutationBoxesCommand(OneHandle& oneHandle, const BiPermutation& prePermutation, const BiPermutation& permutation,
+			const BiPermutation& postPermutation) : m_oneHandle(oneHandle), m_preInvPer(prePermutation.getInversePermutation()),
+			m_invPer(permutation.getInversePermutation()), m_postInvPer(postPermutation.getInversePermutation()) {}
+	
+public:
+	static Command<RendererGL&>* create(OneHandle& oneHandle, const BiPermutation& prePermutation, const BiPermutation& permutation,
+			const BiPermutation& postPermutation) {
+		return new RestorePermutationBoxesCommand(oneHandle, prePermutation, permutation, postPermutation);
+	}
+	
+	virtual void run(RendererGL& rendererGL) {
+		OneHandleRenderer& oneHandle = m_oneHandle.getRenderer();
+		oneHandle.getPrePermutation().setInversePermutation(m_preInvPer);
+		oneHandle.getPermutation().setInversePermutation(m_invPer);
+		oneHandle.getPostPermutation().setInversePermutation(m_postInvPer);
+	}
+	
+	virtual std::string name() const {return "RestorePermutationBoxesCommand";}
+};
+
 class PushArrowCommand : public Command<RendererGL&> {
 	ArrowBox& m_arrowBox;
 	ArrowBox::ArrowInArrowBox& m_newArrow;
@@ -923,6 +1181,19 @@ public:
 
 
 
+void UpdateArrowBoxLenghtCommand::run(RendererGL& rendererGL, float t) {
+	const float lenght = t*m_newLenght + (1.0-t)*m_oldLenght;
+	DeferredRefresh* deferredRefresh = activeDisplay->getDeferredRefresh();
+	if (deferredRefresh!=nullptr) {
+		// La 1-anse n'est replacee qu'une fois, a la fin de l'avance rapide
+		m_arrowBox.resizeWithoutLayout(lenght);
+		deferredRefresh->addLenght(m_arrowBox.getOneHandle(), m_updateArrows);
+		return;
+	}
+	
+	m_arrowBox.setLenght(lenght, m_updateArrows);
+}
+
 void SynchronousSubTaskCommand::run(RendererGL& rendererGL, float dt, float& pastTime) {
 	m_t+=dt;
 	pastTime = m_t-m_duration;
@@ -935,6 +1206,13 @@ void SynchronousSubTaskCommand::run(RendererGL& rendererGL, float dt, float& pas
 }
 
 void RefreshArrowBoxCommand::run(RendererGL& rendererGL, float dt, float& pastTime) {
+	DeferredRefresh* deferredRefresh = activeDisplay->getDeferredRefresh();
+	if (deferredRefresh!=nullptr) {
+		deferredRefresh->addArrowBox(m_arrowBox, m_refreshLenght, m_refreshTracks);
+		pastTime = 0.0;
+		return;
+	}
+	
 	m_arrowBox.refreshArrows();
 	if (m_refreshLenght) m_arrowBox.refreshLenght();
 	if (m_refreshTracks) m_arrowBox.refreshTracks();
@@ -942,6 +1220,13 @@ void RefreshArrowBoxCommand::run(RendererGL& rendererGL, float dt, float& pastTi
 }
 
 void RefreshPermutationBoxCommand::run(RendererGL& rendererGL, float dt, float& pastTime) {
+	DeferredRefresh* deferredRefresh = activeDisplay->getDeferredRefresh();
+	if (deferredRefresh!=nullptr) {
+		deferredRefresh->addPermutationBox(m_permutationBox);
+		pastTime = 0.0;
+		return;
+	}
+	
 	m_permutationBox.refresh();
 	pastTime = 0.0;
 }
@@ -976,7 +1261,7 @@ std::pair<int, bool> pushMoveSubcommand(ArrowBox& arrowBox, ArrowInArrowBoxIndex
 		AnimateMoveArrowInArrowBoxCommand* anim = AnimateMoveArrowInArrowBoxCommand::create(arrowBox.getRenderer(), false);
 		cmd->addCommand(anim);
 		arrowBox.getRenderer().moveArrow(movingArrow.first.get().getArrowRendererInList(), movingArrow.second, n, anim);
-		subCommandQueue.push(cmd);
+		activeDisplay->pushSubCommand(cmd);
 	}
 	
 	return std::make_pair(n, forward);
@@ -984,15 +1269,16 @@ std::pair<int, bool> pushMoveSubcommand(ArrowBox& arrowBox, ArrowInArrowBoxIndex
 
 void DeleteZeroHandleCommand::run(RendererGL& rendererGL) {
 	ZeroHandleRenderer& zeroHandle = m_zeroHandle.getRenderer();
-	assert(&m_zeroHandle.getRenderer() == zeroHandleCurrent);
+	assert(&m_zeroHandle.getRenderer() == activeDisplay->getZeroHandleRenderer());
 	delete &zeroHandle;
 	delete &m_zeroHandle;
-	zeroHandleCurrent = nullptr;
+	activeDisplay->setZeroHandleRenderer(nullptr);
 }
 
 void DrawZeroHandleCommand::run(RendererGL& rendererGL) {
-	assert(zeroHandleCurrent == nullptr);
-	zeroHandleCurrent = new ZeroHandleRenderer(rendererGL, m_pairing, m_zeroHandle, m_voidArrowsData, m_voidArrows, m_fullArrowsData, m_fullArrows);
+	assert(activeDisplay->getZeroHandleRenderer() == nullptr);
+	activeDisplay->setZeroHandleRenderer(new ZeroHandleRenderer(rendererGL, m_pairing, m_zeroHandle, m_voidArrowsData, m_voidArrows,
+			m_fullArrowsData, m_fullArrows));
 }
 
 void PermuteArrowBoxCommand::run(RendererGL& rendererGL) {
@@ -1015,10 +1301,10 @@ void PermuteArrowBoxCommand::run(RendererGL& rendererGL) {
 	permutation.permute(m_permutation, animPermutation, !m_isFirstArrowBox);
 	if (m_isFirstArrowBox) m_permutation.inverse();
 	
-	subCommandQueue.push(cmd);
-	subCommandQueue.push(RefreshPermutationBoxCommand::create(sidePermutation));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(arrowBox, false, true));
-	subCommandQueue.push(RefreshPermutationBoxCommand::create(permutation));
+	activeDisplay->pushSubCommand(cmd);
+	activeDisplay->pushSubCommand(RefreshPermutationBoxCommand::create(sidePermutation));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(arrowBox, false, true));
+	activeDisplay->pushSubCommand(RefreshPermutationBoxCommand::create(permutation));
 }
 
 void MoveArrowInArrowBoxCommand::run(RendererGL& rendererGL) {
@@ -1030,8 +1316,8 @@ void MoveArrowInArrowBoxCommand::run(RendererGL& rendererGL) {
 	cmd->addCommand(anim);
 	
 	arrowBox.moveArrow(m_movingArrow.first.get().getArrowRendererInList(), m_movingArrow.second, n, anim);
-	subCommandQueue.push(cmd);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(arrowBox, false));
+	activeDisplay->pushSubCommand(cmd);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(arrowBox, false));
 }
 
 void GenArrowAfterMoveCrossingCommand::run(RendererGL& rendererGL) {
@@ -1056,9 +1342,9 @@ void GenArrowAfterMoveCrossingCommand::run(RendererGL& rendererGL) {
 		arrowBox.spawnArrowAfterCrossingBackward(rendererGL, m_targetArrow.first.get().getArrowRendererInList(), m_newArrow, m_targetArrow.second,
 				m_from, m_to, anim0, anim1, lenAnim1, m_genAfter);
 	
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(cmd1);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(arrowBox, true));
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(cmd1);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(arrowBox, true));
 }
 
 void MoveMergeArrowsCommand::run(RendererGL& rendererGL) {
@@ -1078,11 +1364,11 @@ void MoveMergeArrowsCommand::run(RendererGL& rendererGL) {
 	
 	arrowBox.mergeArrows(rendererGL, m_targetArrow.first.get().getArrowRendererInList(), m_targetArrow.second, anim0, lenAnim0, anim1, lenAnim1, forward);
 	
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(RemoveArrowCommand::create(arrowBox, m_movingArrow.first));
-	subCommandQueue.push(RemoveArrowCommand::create(arrowBox, m_targetArrow.first));
-	subCommandQueue.push(cmd1);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(arrowBox, true));
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(RemoveArrowCommand::create(arrowBox, m_movingArrow.first));
+	activeDisplay->pushSubCommand(RemoveArrowCommand::create(arrowBox, m_targetArrow.first));
+	activeDisplay->pushSubCommand(cmd1);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(arrowBox, true));
 }
 
 void RemoveArrowFromArrowBoxCommand::run(RendererGL& rendererGL) {
@@ -1097,9 +1383,9 @@ void RemoveArrowFromArrowBoxCommand::run(RendererGL& rendererGL) {
 	
 	arrowBox.removeArrow(rendererGL, arrowInList, index, anim0, lenAnim0);
 	
-	subCommandQueue.push(RemoveArrowCommand::create(arrowBox, m_arrow.first));
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(arrowBox, true));
+	activeDisplay->pushSubCommand(RemoveArrowCommand::create(arrowBox, m_arrow.first));
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(arrowBox, true));
 }
 
 void MoveArrowGenCrossingCommand::run(RendererGL& rendererGL) {
@@ -1125,14 +1411,14 @@ void MoveArrowGenCrossingCommand::run(RendererGL& rendererGL) {
 			anim0, anim1, anims2, anim3, m_crossingI, m_crossingJ);
 	cmd1->addCommand(anim1);
 	
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(RemoveArrowCommand::create(arrowBox, m_movingArrow.first));
-	subCommandQueue.push(cmd1);
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(RemoveArrowCommand::create(arrowBox, m_movingArrow.first));
+	activeDisplay->pushSubCommand(cmd1);
 	
 	for (size_t i=0; i<anims2.size(); i++) {
 		SynchronousSubTaskCommand* cmd = SynchronousSubTaskCommand::create(1.0/3.0);
 		cmd->addCommand(anims2[i]);
-		subCommandQueue.push(cmd);
+		activeDisplay->pushSubCommand(cmd);
 	}
 	
 	SynchronousSubTaskCommand*      cmd3  = SynchronousSubTaskCommand::create(1.0/3.0);
@@ -1141,9 +1427,9 @@ void MoveArrowGenCrossingCommand::run(RendererGL& rendererGL) {
 	AnimateMoveTrackPermutationBox* animPer3 = AnimateMoveTrackPermutationBox::create(arrowBox.getOneHandle().getPermutation());
 	arrowBox.getOneHandle().getPermutation().permute(std::make_pair(m_crossingI, m_crossingJ), animPer3, false);
 	cmd3->addCommand(animLen3); cmd3->addCommand(animPer3); cmd3->addCommand(anim3);
-	subCommandQueue.push(cmd3);
-	subCommandQueue.push(RemoveCrossingCommand::create(arrowBox));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(arrowBox, true));
+	activeDisplay->pushSubCommand(cmd3);
+	activeDisplay->pushSubCommand(RemoveCrossingCommand::create(arrowBox));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(arrowBox, true));
 }
 
 void MoveArrowToFirstArrowBoxCommand::run(RendererGL& rendererGL) {
@@ -1162,9 +1448,9 @@ void MoveArrowToFirstArrowBoxCommand::run(RendererGL& rendererGL) {
 	cmd0->addCommand(animLen0, 0.0, duration); cmd0->addCommand(animLen1, 0.0, duration);
 	
 	oneHandle.transferArrowsToFirstArrowBox(cmd0, duration);
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(firstBox, true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(secondBox, true));
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(firstBox, true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(secondBox, true));
 }
 
 void MoveArrowToOtherArrowBoxCommand::run(RendererGL& rendererGL) {
@@ -1208,11 +1494,11 @@ void MoveArrowToOtherArrowBoxCommand::run(RendererGL& rendererGL) {
 	cmd2->addCommand(anim2);
 	arrowRen->setBeginEnd(m_targetI, m_targetJ);
 	
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(cmd1);
-	subCommandQueue.push(cmd2);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(box, true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(otherBox, true));
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(cmd1);
+	activeDisplay->pushSubCommand(cmd2);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(box, true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(otherBox, true));
 	
 	if (isFirstArrowBox)
 		otherBox.moveArrowFromBegin(arrowRen, 0, box, anim2);
@@ -1312,15 +1598,15 @@ void MoveArrowToOtherArrowBoxResolveCrossingCommand::run(RendererGL& rendererGL)
 		box.moveArrowFromBeginWithOthers(newArrowRen, 0, box, anim5);
 	}
 	
-	subCommandQueue.push(cmd0);
-	subCommandQueue.push(cmd1);
-	subCommandQueue.push(cmd2);
-	subCommandQueue.push(cmd3);
-	subCommandQueue.push(RefreshPermutationBoxCommand::create(permutation));
-	subCommandQueue.push(cmd4);
-	subCommandQueue.push(cmd5);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(box, true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(otherBox, true));
+	activeDisplay->pushSubCommand(cmd0);
+	activeDisplay->pushSubCommand(cmd1);
+	activeDisplay->pushSubCommand(cmd2);
+	activeDisplay->pushSubCommand(cmd3);
+	activeDisplay->pushSubCommand(RefreshPermutationBoxCommand::create(permutation));
+	activeDisplay->pushSubCommand(cmd4);
+	activeDisplay->pushSubCommand(cmd5);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(box, true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(otherBox, true));
 }
 
 void PassArrowsThroughtZeroHandleCommand::run(RendererGL& rendererGL) {
@@ -1521,11 +1807,11 @@ void PassArrowsThroughtZeroHandleCommand::run(RendererGL& rendererGL) {
 		}
 	}
 	
-	subCommandQueue.push(cmd);
-	subCommandQueue.push(RefreshArrowBoxCommand::create(zeroHandle.getFullHandle().getFirstArrowBox(),  true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(zeroHandle.getVoidHandle().getSecondArrowBox(), true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(zeroHandle.getFullHandle().getSecondArrowBox(), true));
-	subCommandQueue.push(RefreshArrowBoxCommand::create(zeroHandle.getFullHandle().getFirstArrowBox(),  true));
+	activeDisplay->pushSubCommand(cmd);
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(zeroHandle.getFullHandle().getFirstArrowBox(),  true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(zeroHandle.getVoidHandle().getSecondArrowBox(), true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(zeroHandle.getFullHandle().getSecondArrowBox(), true));
+	activeDisplay->pushSubCommand(RefreshArrowBoxCommand::create(zeroHandle.getFullHandle().getFirstArrowBox(),  true));
 }
 
 
@@ -1536,141 +1822,333 @@ void PassArrowsThroughtZeroHandleCommand::run(RendererGL& rendererGL) {
 
 
 
-void initDisplayCmd() {
-	pthread_mutex_init(&displayMutex, NULL);
-}
+DisplayContext::DisplayContext() : m_zeroHandle(nullptr), m_capacity(DEFAULT_DISPLAY_QUEUE_CAPACITY), m_backpressureReleased(false),
+		m_batchBegin(0), m_batchEnd(0), m_processed(0), m_maxDepth(0), m_producerWaits(0), m_producerWaitTime(0.0), m_fastForward(false),
+		m_frameBudget(DEFAULT_DISPLAY_FRAME_BUDGET), m_deferredRefresh(new DeferredRefresh),
+		m_deferring(false), m_keyframeReached(false) {}
 
+DisplayContext::~DisplayContext() {
+	Command<RendererGL&>* cmd;
+	while ((cmd = pop())!=nullptr)
+		cmd->clear();
+	
+	while (!m_subCommandQueue.empty()) {
+		m_subCommandQueue.front()->clear();
+		m_subCommandQueue.pop();
+	}
+	
+	// Les boites a rafraichir sont detruites avec la structure
+	delete m_deferredRefresh;
+	delete m_zeroHandle;
+}
 
-void destroyDisplayCmd() {
-	pthread_mutex_destroy(&displayMutex);
-	while (!displayQueue.empty()) {
-		displayQueue.front()->clear();
-		displayQueue.pop();
+// Retire un lot du canal lorsque le precedent est epuise
+Command<RendererGL&>* DisplayContext::pop() {
+	if (m_batchBegin==m_batchEnd) {
+		m_batchBegin = 0;
+		m_batchEnd   = m_channel.popBatch(m_batch, DISPLAY_CONSUME_BATCH);
+		if (m_batchEnd==0) return nullptr;
 	}
 	
-	while (!subCommandQueue.empty()) {
-		subCommandQueue.front()->clear();
-		subCommandQueue.pop();
+	Command<RendererGL&>* cmd = m_batch[m_batchBegin++];
+	m_processed.fetch_add(1, std::memory_order_seq_cst);
+	m_notFull.notify();
+	return cmd;
+}
+
+// Termine les sous-commandes en cours sans les animer. Pendant l'avance rapide, les boites dont elles changent
+// la longueur ou qu'elles rafraichissent sont seulement notees, et replacees une fois a la fin.
+void DisplayContext::finishSubCommands(RendererGL& rendererGL) {
+	float pastTime;
+	while (!m_subCommandQueue.empty()) {
+		m_subCommandQueue.front()->run(rendererGL, std::numeric_limits<float>::infinity(), pastTime);
+		m_subCommandQueue.front()->clear();
+		m_subCommandQueue.pop();
+	}
+}
+
+// Ces commandes ne modifient qu'une boite de fleches et ne lisent pas la geometrie des autres elements:
+// on peut retarder le rafraichissement des boites jusqu'a la fin de l'avance rapide.
+// Les autres (croisements, passage par l'anse 0, permutations) calculent des intersections
+// a partir de la position courante des courbes, qui doit donc etre a jour.
+static bool canDeferRefresh(Command<RendererGL&>* cmd) {
+	return dynamic_cast<MoveArrowInArrowBoxCommand*>(cmd)!=nullptr || dynamic_cast<GenArrowAfterMoveCrossingCommand*>(cmd)!=nullptr ||
+			dynamic_cast<MoveMergeArrowsCommand*>(cmd)!=nullptr || dynamic_cast<RemoveArrowFromArrowBoxCommand*>(cmd)!=nullptr ||
+			dynamic_cast<KeyframeCommand*>(cmd)!=nullptr;
+}
+
+// Applique sans animation les commandes jusqu'a la prochaine image cle (ou jusqu'a ce que la file soit vide),
+// puis rafraichit une seule fois chaque boite modifiee. Si le budget de l'image est epuise avant, les rafraichissements
+// restent en attente et l'avance rapide reprend a l'image suivante, pour que la fenetre continue de repondre.
+void DisplayContext::fastForward(RendererGL& rendererGL) {
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()+
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_frameBudget));
+	
+	m_deferring = true;
+	m_keyframeReached = false;
+	
+	finishSubCommands(rendererGL);
+	bool first = true;
+	while (!m_keyframeReached) {
+		if (!first && std::chrono::steady_clock::now()>=deadline) {
+			m_deferring = false;
+			return;
+		}
+		first = false;
+		
+		Command<RendererGL&>* cmd = pop();
+		if (cmd==nullptr) break;
+		
+		if (!canDeferRefresh(cmd))
+			m_deferredRefresh->apply();
+		cmd->run(rendererGL);
+		cmd->clear();
+		finishSubCommands(rendererGL);
 	}
 	
-	delete zeroHandleCurrent;
+	m_deferring = false;
+	m_deferredRefresh->apply();
 }
 
-void processDisplayCommand(RendererGL& rendererGL, float dt) {
+// Avance les animations de dt, puis execute les commandes suivantes tant qu'aucune animation n'est en cours
+// et que le budget de l'image n'est pas epuise. Une sous-tache qui n'a pas fini rend la main jusqu'a l'image suivante.
+// Au moins une commande est executee par image, pour que l'affichage avance meme si une commande depasse le budget.
+void DisplayContext::animate(RendererGL& rendererGL, float dt) {
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()+
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_frameBudget));
+	
 	Command<RendererGL&, float, float&>* subTask;
 	float pastTime;
-	while (!subCommandQueue.empty()) {
-		subTask = subCommandQueue.front();
-		subTask->run(rendererGL, dt, pastTime);
-		if (pastTime<0.0) return;
-		subTask->clear();
-		subCommandQueue.pop();
-		dt-=pastTime;
+	bool first = true;
+	while (true) {
+		while (!m_subCommandQueue.empty()) {
+			subTask = m_subCommandQueue.front();
+			subTask->run(rendererGL, dt, pastTime);
+			if (pastTime<0.0) return;
+			subTask->clear();
+			m_subCommandQueue.pop();
+			dt-=pastTime;
+		}
+	
+		if (!first && std::chrono::steady_clock::now()>=deadline) return;
+		first = false;
+		
+		Command<RendererGL&>* cmd = pop();
+		if (cmd==nullptr) return;
+		cmd->run(rendererGL);
+		cmd->clear();
+	}
+}
+
+void DisplayContext::process(RendererGL& rendererGL, float dt) {
+	DisplayContext* previous = activeDisplay;
+	activeDisplay = this;
+	if (m_fastForward)
+		fastForward(rendererGL);
+	else {
+		// Fin d'une avance rapide interrompue par le budget de l'image
+		if (!m_deferredRefresh->empty())
+			m_deferredRefresh->apply();
+		animate(rendererGL, dt);
 	}
+	activeDisplay = previous;
+}
+
+// Nombre de commandes que le producteur peut encore publier, 0 si la file est pleine
+size_t DisplayContext::room() {
+	size_t capacity = m_capacity.load(std::memory_order_seq_cst);
+	if (capacity==0 || m_backpressureReleased.load(std::memory_order_seq_cst))
+		return std::numeric_limits<size_t>::max();
+	
+	size_t depth = m_channel.published()-m_processed.load(std::memory_order_seq_cst);
+	return (depth<capacity) ? capacity-depth : 0;
+}
+
+size_t DisplayContext::waitRoom() {
+	size_t available = room();
+	if (available!=0) return available;
 	
-	Command<RendererGL&>* cmd = nullptr;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (true) {
+		unsigned int epoch = m_notFull.prepareWait();
+		available = room();
+		if (available!=0) {
+			m_notFull.cancelWait();
+			break;
+		}
+		m_notFull.wait(epoch);
+	}
 	
-	pthread_mutex_lock(&displayMutex);
-	if (!displayQueue.empty()) {
-		cmd = displayQueue.front();
-		displayQueue.pop();
+	std::chrono::duration<double> waited = std::chrono::steady_clock::now()-start;
+	m_producerWaits.store(m_producerWaits.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+	m_producerWaitTime.store(m_producerWaitTime.load(std::memory_order_relaxed)+waited.count(), std::memory_order_relaxed);
+	return available;
+}
+
+void DisplayContext::enqueue(Command<RendererGL&>* const* begin, Command<RendererGL&>* const* end) {
+	while (begin!=end) {
+		size_t count = std::min(waitRoom(), static_cast<size_t>(end-begin));
+		m_channel.pushBatch(begin, begin+count);
+		begin += count;
+		
+		size_t depth = m_channel.published()-m_processed.load(std::memory_order_relaxed);
+		if (depth>m_maxDepth.load(std::memory_order_relaxed))
+			m_maxDepth.store(depth, std::memory_order_relaxed);
 	}
-	pthread_mutex_unlock(&displayMutex);
+}
+
+void DisplayContext::setQueueCapacity(size_t capacity) {
+	m_capacity = capacity;
+	m_notFull.notify();
+}
+
+void DisplayContext::releaseBackpressure() {
+	m_backpressureReleased = true;
+	m_notFull.notify();
+}
+
+DisplayQueueMetrics DisplayContext::getMetrics() const {
+	DisplayQueueMetrics ret;
+	ret.capacity         = m_capacity.load();
+	ret.processed        = m_processed.load();
+	ret.pushed           = m_channel.published();
+	ret.depth            = ret.pushed-ret.processed;
+	ret.maxDepth         = m_maxDepth.load();
+	ret.producerWaits    = m_producerWaits.load();
+	ret.producerWaitTime = m_producerWaitTime.load();
+	return ret;
+}
+
+static void pushDisplayCommand(Command<RendererGL&>* cmd) {
+	if (displayBuffer!=nullptr) {
+		displayBuffer->push(cmd);
+	} else {
+		assert(displayContext!=nullptr);
+		displayContext->enqueue(cmd);
+	}
+}
+
+void setDisplayContext(DisplayContext* context) {
+	displayContext = context;
+}
+
+DisplayContext* getDisplayContext() {
+	return displayContext;
+}
+
+void setDisplayCommandBuffer(DisplayCommandBuffer* buffer) {
+	displayBuffer = buffer;
+}
+
+DisplayCommandBuffer::DisplayCommandBuffer(DisplayContext& context) : m_context(context), m_released(false) {
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init (&m_releasedCond, NULL);
+}
+
+DisplayCommandBuffer::~DisplayCommandBuffer() {
+	assert(m_commands.empty());
+	pthread_cond_destroy(&m_releasedCond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void DisplayCommandBuffer::push(Command<RendererGL&>* cmd) {
+	size_t capacity = m_context.getQueueCapacity();
 	
-	if (cmd!=nullptr) {
-		cmd->run(rendererGL);
-		cmd->clear();
+	pthread_mutex_lock(&m_mutex);
+		while (!m_released && capacity!=0 && m_commands.size()>=capacity)
+			pthread_cond_wait(&m_releasedCond, &m_mutex);
+		bool released = m_released;
+	pthread_mutex_unlock(&m_mutex);
+	
+	if (released) {
+		flush();
+		m_context.enqueue(cmd);
+	} else {
+		m_commands.push_back(cmd);
 	}
 }
 
+void DisplayCommandBuffer::release() {
+	pthread_mutex_lock(&m_mutex);
+		m_released = true;
+		pthread_cond_signal(&m_releasedCond);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void DisplayCommandBuffer::flush() {
+	m_context.enqueue(m_commands.data(), m_commands.data()+m_commands.size());
+	m_commands.clear();
+}
+
 void postDrawZeroHandle(Pairing handlePairing, ZeroHandle& zeroHandle,
 		std::list<std::pair<unsigned int, unsigned int>>&& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>&& voidArrows,
 		std::list<std::pair<unsigned int, unsigned int>>&& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>&& fullArrows) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(DrawZeroHandleCommand::create(handlePairing, zeroHandle, std::move(voidArrowsData), std::move(voidArrows),
+	pushDisplayCommand(DrawZeroHandleCommand::create(handlePairing, zeroHandle, std::move(voidArrowsData), std::move(voidArrows),
 				std::move(fullArrowsData), std::move(fullArrows)));
-	pthread_mutex_unlock(&displayMutex);
 }
 
 void postDeleteZeroHandle(ZeroHandle& zeroHandle) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(DeleteZeroHandleCommand::create(zeroHandle));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(DeleteZeroHandleCommand::create(zeroHandle));
 }
 
 void postPermuteArrowBoxCommand(const BiPermutation& permutation, OneHandle& oneHandle, bool isFirstArrowBox) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(PermuteArrowBoxCommand::create(permutation, oneHandle, isFirstArrowBox));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(PermuteArrowBoxCommand::create(permutation, oneHandle, isFirstArrowBox));
 }
 
 void postMoveArrowInArrowBox(ArrowBox& arrowBox, ArrowInArrowBoxIndexed movingArrow, ArrowInArrowBoxIndexed targetArrow) {
 	if (movingArrow.second != targetArrow.second) {
-		pthread_mutex_lock(&displayMutex);
-			displayQueue.push(MoveArrowInArrowBoxCommand::create(arrowBox, movingArrow, targetArrow));
-		pthread_mutex_unlock(&displayMutex);
+		pushDisplayCommand(MoveArrowInArrowBoxCommand::create(arrowBox, movingArrow, targetArrow));
 	}
 }
 
 void postGenArrowAfterMoveCrossing(ArrowBox& arrowBox, ArrowInArrowBoxIndexed movingArrow, ArrowInArrowBoxIndexed targetArrow,
 		ArrowBox::ArrowInArrowBox& newArrow, unsigned int from, unsigned int to, bool genAfter) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(GenArrowAfterMoveCrossingCommand::create(arrowBox, movingArrow, targetArrow, newArrow, from, to, genAfter));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(GenArrowAfterMoveCrossingCommand::create(arrowBox, movingArrow, targetArrow, newArrow, from, to, genAfter));
 }
 
 void postMoveMergeArrowsCommand(ArrowBox& arrowBox, ArrowInArrowBoxIndexed movingArrow, ArrowInArrowBoxIndexed targetArrow) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(MoveMergeArrowsCommand::create(arrowBox, movingArrow, targetArrow));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(MoveMergeArrowsCommand::create(arrowBox, movingArrow, targetArrow));
 }
 
 void postRemoveArrowFromArrowBoxCommand(ArrowBox& arrowBox, ArrowInArrowBoxIndexed arrow) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(RemoveArrowFromArrowBoxCommand::create(arrowBox, arrow));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(RemoveArrowFromArrowBoxCommand::create(arrowBox, arrow));
 }
 
 void postMoveArrowGenCrossingCommand(ArrowBox& arrowBox, ArrowInArrowBoxIndexed movingArrow, ArrowInArrowBoxIndexed targetArrow,
 		unsigned int crossingI, unsigned int crossingJ) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(MoveArrowGenCrossingCommand::create(arrowBox, movingArrow, targetArrow, crossingI, crossingJ));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(MoveArrowGenCrossingCommand::create(arrowBox, movingArrow, targetArrow, crossingI, crossingJ));
 }
 
 void postMoveArrowToFirstArrowBoxCommand(OneHandle& oneHandle) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(MoveArrowToFirstArrowBoxCommand::create(oneHandle));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(MoveArrowToFirstArrowBoxCommand::create(oneHandle));
 }
 
 void postMoveArrowToOtherArrowBoxCommand(OneHandle& oneHandle, ArrowBox& arrowBox, ArrowInArrowBoxIndexed arrow, unsigned int targetI, unsigned int targetJ) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(MoveArrowToOtherArrowBoxCommand::create(oneHandle, arrowBox, arrow, targetI, targetJ));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(MoveArrowToOtherArrowBoxCommand::create(oneHandle, arrowBox, arrow, targetI, targetJ));
 }
 
 void postMoveArrowToOtherArrowBoxResolveCrossingCommand(OneHandle& oneHandle, ArrowBox& arrowBox, ArrowInArrowBoxIndexed arrow, ArrowBox::ArrowInArrowBox& newArrow,
 		unsigned int targetI, unsigned int targetJ) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(MoveArrowToOtherArrowBoxResolveCrossingCommand::create(oneHandle, arrowBox, arrow, newArrow, targetI, targetJ));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(MoveArrowToOtherArrowBoxResolveCrossingCommand::create(oneHandle, arrowBox, arrow, newArrow, targetI, targetJ));
 }
 
 void postPassArrowsThroughtZeroHandleCommand(PassArrowsThroughtZeroHandleCommand* cmd) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(cmd);
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(cmd);
 }
 
 void postMoveArrowsAcrossZeroHandle(MoveArrowsAcrossZeroHandle* cmd) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(cmd);
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(cmd);
 }
 
 void postPushArrowCommand(ArrowBox& arrowBox, ArrowBox::ArrowInArrowBox& newArrow, unsigned int from, unsigned int to) {
-	pthread_mutex_lock(&displayMutex);
-		displayQueue.push(PushArrowCommand::create(arrowBox, newArrow, from, to));
-	pthread_mutex_unlock(&displayMutex);
+	pushDisplayCommand(PushArrowCommand::create(arrowBox, newArrow, from, to));
+}
+
+void postRestorePermutationBoxesCommand(OneHandle& oneHandle, const BiPermutation& prePermutation, const BiPermutation& permutation,
+		const BiPermutation& postPermutation) {
+	pushDisplayCommand(RestorePermutationBoxesCommand::create(oneHandle, prePermutation, permutation, postPermutation));
+}
+
+void postKeyframeCommand() {
+	pushDisplayCommand(KeyframeCommand::create());
 }
@@ -2,7 +2,11 @@
 #define __DISPLAY_CMD_HPP__
 
 #include <queue>
+#include <vector>
 #include <functional>
+#include <atomic>
+
+#include <pthread.h>
 
 class AnimateMoveArrowInArrowBoxCommand;
 
@@ -12,6 +16,7 @@ class AnimateMoveArrowInArrowBoxCommand;
 #include "one_handle.hpp"
 #include "command.hpp"
 #include "arrow.hpp"
+#include "spsc_channel.hpp"
 
 typedef std::pair<std::reference_wrapper<ArrowBox::ArrowInArrowBox>, int> ArrowInArrowBoxIndexed;
 static inline ArrowInArrowBoxIndexed makeArrowInArrowBoxIndexed(ArrowBox::ArrowInArrowBox& arrow, int index) {
@@ -45,15 +50,48 @@ private:
 	ArrowBox::Renderer& m_arrowBox;
 	bool m_isAbsolute;
 	
+	// Interpolation par le vertex shader, 0 si les fleches sont deplacees a chaque image
+	RendererGL* m_renderer = nullptr;
+	unsigned int m_animation = 0;
+	bool m_started = false;
+	float m_t = 0.0;
+	float m_basex = 0.0;
+	float m_basey = 0.0;
+	
+	// Decalage de m_shiftDx des fleches fixes dont le debut, relatif a la boite, est dans [m_shiftStart, m_shiftEnd)
+	bool m_hasShift = false;
+	float m_shiftStart = 0.0;
+	float m_shiftEnd = 0.0;
+	float m_shiftDx = 0.0;
+	// Translation decalee par le vertex shader, 0 si les fleches sont deplacees a chaque image depuis leur abscisse de depart
+	unsigned int m_shiftTranslation = 0;
+	// Fleches a decaler, choisies au debut avec leur abscisse de depart, et fixees a leur position decalee a la fin
+	std::vector<std::pair<Arrow::Renderer*, float>> m_shiftedArrows;
+	
 	AnimateMoveArrowInArrowBoxCommand(ArrowBox::Renderer& arrowBox, bool isAbsolute) : m_arrowBox(arrowBox), m_isAbsolute(isAbsolute) {}
 	
+	void moveArrow(size_t i, float t);
+	void animateArrow(size_t i);
+	void startShift(RendererGL& rendererGL, float t);
+	void shift(float t);
+	
 public:
+	~AnimateMoveArrowInArrowBoxCommand();
+	
 	static AnimateMoveArrowInArrowBoxCommand* create(ArrowBox::Renderer& arrowBox, bool isAbsolute) {
 		return new AnimateMoveArrowInArrowBoxCommand(arrowBox, isAbsolute);
 	}
 	
 	void addArrow(Arrow::Renderer& arrow, float p0x0, float p0y0, float p1x0, float p1y0, float t0x0, float t0y0, float t1x0, float t1y0,
 										  float p0x1, float p0y1, float p1x1, float p1y1, float t0x1, float t0y1, float t1x1, float t1y1);
+	// Deplace de dx toutes les fleches fixes de la boite dont l'abscisse relative est dans [start, end) au debut de l'animation,
+	// sans les ajouter une par une. Les fleches de l'animation ne sont pas decalees.
+	void shiftArrows(float start, float end, float dx) {
+		m_hasShift = true;
+		m_shiftStart = start;
+		m_shiftEnd = end;
+		m_shiftDx = dx;
+	}
 	
 	virtual void run(RendererGL& rendererGL, float t);
 	
@@ -73,9 +111,15 @@ private:
 	std::vector<std::pair<TrackLine*, MoveData>> m_trackMoveData;
 	ArrowBox::Renderer& m_arrowBox;
 	
+	RendererGL* m_renderer = nullptr;
+	unsigned int m_animation = 0;
+	bool m_started = false;
+	
 	AnimateMoveTrackLineArrowBox(ArrowBox::Renderer& arrowBox) : m_arrowBox(arrowBox) {}
 	
 public:
+	~AnimateMoveTrackLineArrowBox();
+	
 	static AnimateMoveTrackLineArrowBox* create(ArrowBox::Renderer& arrowBox) {return new AnimateMoveTrackLineArrowBox(arrowBox);}
 	
 	void addTrack(TrackLine& track, float p0x0, float p0y0, float p1x0, float p1y0, float p0x1, float p0y1, float p1x1, float p1y1);
@@ -165,7 +209,13 @@ private:
 	
 	std::vector<std::pair<ShowableBezier*, MoveData>> m_curves;
 	
+	RendererGL* m_renderer = nullptr;
+	unsigned int m_animation = 0;
+	bool m_started = false;
+	
 public:
+	~AnimateInterpolateShowableBezierCurve();
+	
 	static AnimateInterpolateShowableBezierCurve* create() {return new AnimateInterpolateShowableBezierCurve();}
 	
 	void addCurve(ShowableBezier& curve, Bezier curve0, Bezier curve1);
@@ -193,9 +243,7 @@ public:
 		m_newLenght = newLenght;
 	}
 	
-	virtual void run(RendererGL& rendererGL, float t) {
-		m_arrowBox.setLenght(t*m_newLenght + (1.0-t)*m_oldLenght, m_updateArrows);
-	}
+	virtual void run(RendererGL& rendererGL, float t);
 	
 	virtual std::string name() const {return "UpdateArrowBoxLenghtCommand";}
 };
@@ -501,9 +549,119 @@ public:
 	virtual std::string name() const {return "MoveArrowsAcrossZeroHandle";}
 };
 
-void initDisplayCmd();
-void destroyDisplayCmd();
-void processDisplayCommand(RendererGL& rendererGL, float dt);
+// Nombre maximal de commandes retirees du canal a la fois par le thread d'affichage
+#define DISPLAY_CONSUME_BATCH 64
+
+struct DisplayQueueMetrics {
+	size_t capacity; // 0 si la file n'est pas bornee
+	size_t depth;
+	size_t maxDepth;
+	unsigned long long pushed;
+	unsigned long long processed;
+	unsigned long long producerWaits;
+	double producerWaitTime; // En secondes
+};
+
+class DeferredRefresh;
+
+// Affichage d'une structure: commandes venant du thread de travail, sous-commandes en cours d'animation
+// et rendu de l'anse 0. Un seul thread publie a la fois: celui qui traite la structure, ou le thread
+// de l'anse pleine une fois que le premier lui a cede la main (voir DisplayCommandBuffer).
+class DisplayContext {
+	SpscChannel<Command<RendererGL&>*> m_channel;
+	std::queue<Command<RendererGL&, float, float&>*> m_subCommandQueue;
+	ZeroHandleRenderer* m_zeroHandle;
+	EventCount m_notFull;
+	std::atomic<size_t> m_capacity;
+	std::atomic<bool>   m_backpressureReleased;
+	
+	// Commandes retirees du canal mais pas encore executees, propres au thread d'affichage
+	Command<RendererGL&>* m_batch[DISPLAY_CONSUME_BATCH];
+	size_t m_batchBegin;
+	size_t m_batchEnd;
+	std::atomic<unsigned long long> m_processed;
+	
+	// Ecrits par le producteur seulement
+	std::atomic<size_t> m_maxDepth;
+	std::atomic<unsigned long long> m_producerWaits;
+	std::atomic<double> m_producerWaitTime;
+	
+	bool m_fastForward;
+	double m_frameBudget; // Temps en secondes passe au plus par image a executer des commandes instantanees
+	DeferredRefresh* m_deferredRefresh; // Rafraichissements de l'avance rapide pas encore appliques
+	bool m_deferring;       // Vrai pendant l'avance rapide
+	bool m_keyframeReached;
+	
+	DisplayContext(const DisplayContext&) = delete;
+	DisplayContext& operator=(const DisplayContext&) = delete;
+	
+	Command<RendererGL&>* pop();
+	void finishSubCommands(RendererGL& rendererGL);
+	void fastForward(RendererGL& rendererGL);
+	void animate(RendererGL& rendererGL, float dt);
+	size_t room();
+	size_t waitRoom();
+	
+public:
+	DisplayContext();
+	~DisplayContext();
+	
+	// Thread d'affichage
+	void process(RendererGL& rendererGL, float dt);
+	// Avance rapide: les commandes jusqu'a la prochaine image cle sont appliquees sans animation
+	// et chaque boite n'est rafraichie qu'une fois. Une image n'y passe pas plus que m_frameBudget.
+	void setFastForward(bool fastForward) {m_fastForward = fastForward;}
+	// Au moins une commande est executee par image, meme si le budget est nul
+	void setFrameBudget(double seconds) {m_frameBudget = seconds;}
+	double getFrameBudget() const {return m_frameBudget;}
+	
+	// Producteur
+	void enqueue(Command<RendererGL&>* cmd) {enqueue(&cmd, &cmd+1);}
+	// Publie les commandes par lots aussi grands que la place restante le permet
+	void enqueue(Command<RendererGL&>* const* begin, Command<RendererGL&>* const* end);
+	
+	// Le producteur attend lorsque la file atteint sa capacite. 0 pour une file non bornee.
+	void setQueueCapacity(size_t capacity);
+	// 0 si le producteur n'attend plus
+	size_t getQueueCapacity() const {return (m_backpressureReleased) ? 0 : m_capacity.load();}
+	// Ne plus faire attendre le producteur, pour que son travail puisse s'arreter
+	void releaseBackpressure();
+	DisplayQueueMetrics getMetrics() const;
+	
+	// Appeles par les commandes pendant process
+	void pushSubCommand(Command<RendererGL&, float, float&>* cmd) {m_subCommandQueue.push(cmd);}
+	ZeroHandleRenderer* getZeroHandleRenderer() const {return m_zeroHandle;}
+	// Non nul pendant l'avance rapide: les commandes y marquent leurs boites au lieu de les rafraichir
+	DeferredRefresh* getDeferredRefresh() const {return (m_deferring) ? m_deferredRefresh : nullptr;}
+	void reachKeyframe() {m_keyframeReached = true;}
+	void setZeroHandleRenderer(ZeroHandleRenderer* zeroHandle) {m_zeroHandle = zeroHandle;}
+};
+
+// Commandes retenues par un thread de travail tant que celles qui doivent les preceder n'ont pas ete envoyees.
+// Le thread proprietaire attend release() lorsque le tampon atteint la capacite de la file d'affichage,
+// puis envoie directement a l'affichage.
+class DisplayCommandBuffer {
+	DisplayContext& m_context;
+	std::vector<Command<RendererGL&>*> m_commands;
+	bool m_released;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t  m_releasedCond;
+	
+	DisplayCommandBuffer(const DisplayCommandBuffer&) = delete;
+	DisplayCommandBuffer& operator=(const DisplayCommandBuffer&) = delete;
+	
+public:
+	DisplayCommandBuffer(DisplayContext& context);
+	~DisplayCommandBuffer();
+	
+	// Appele par le thread proprietaire
+	void push(Command<RendererGL&>* cmd);
+	// Appele par un autre thread lorsque les commandes precedentes ont ete envoyees
+	void release();
+	// Envoie les commandes retenues. Le thread proprietaire ne doit plus ecrire dans le tampon.
+	void flush();
+};
+
 void postDrawZeroHandle(Pairing handlePairing, ZeroHandle& zeroHandle,
 		std::list<std::pair<unsigned int, unsigned int>>&& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>&& voidArrows,
 		std::list<std::pair<unsigned int, unsigned int>>&& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>&& fullArrows);
@@ -523,5 +681,13 @@ void postMoveArrowToOtherArrowBoxResolveCrossingCommand(OneHandle& oneHandle, Ar
 void postPassArrowsThroughtZeroHandleCommand(PassArrowsThroughtZeroHandleCommand* cmd);
 void postMoveArrowsAcrossZeroHandle(MoveArrowsAcrossZeroHandle* cmd);
 void postPushArrowCommand(ArrowBox& arrowBox, ArrowBox::ArrowInArrowBox& newArrow, unsigned int from, unsigned int to);
+void postRestorePermutationBoxesCommand(OneHandle& oneHandle, const BiPermutation& prePermutation, const BiPermutation& permutation,
+		const BiPermutation& postPermutation);
+void postKeyframeCommand();
+
+// Contexte auquel les fonctions post* du thread courant envoient leurs commandes
+void setDisplayContext(DisplayContext* context);
+DisplayContext* getDisplayContext();
+void setDisplayCommandBuffer(DisplayCommandBuffer* buffer);
 
 #endif /* __DISPLAY_CMD_HPP__ */
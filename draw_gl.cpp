@@ -1,6 +1,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <cstddef>
 
 #include <GL/glew.h>
 
@@ -14,19 +15,120 @@ static constexpr float pixelFactor = 600.0;
 static constexpr float maxScale    = 1000.0;
 static constexpr float minScale    = 0.001;
 
-void RendererGL::DisplayParam::setUniforms(const ProgramsGL::Program& program) const {
-	glUniform3f(program.getUniform(ProgramsGL::COLOR), m_color[0], m_color[1], m_color[2]);
+template <>
+void RendererGL::DrawData<RendererGL::VertexData>::loadAttributes(size_t first) {
+	size_t base = first*sizeof(VertexData);
+	GLint position  = m_program.getAttribute(ProgramsGL::POSITION);
+	GLint target    = m_program.getAttribute(ProgramsGL::TARGET);
+	GLint animation = m_program.getAttribute(ProgramsGL::ANIMATION);
+	GLint color     = m_program.getAttribute(ProgramsGL::COLOR);
+	GLint layer     = m_program.getAttribute(ProgramsGL::LAYER);
+	GLint translation = m_program.getAttribute(ProgramsGL::VERTEX_TRANSLATION);
+	
+	glEnableVertexAttribArray(position);
+	glVertexAttribPointer(position,  2, GL_FLOAT, GL_FALSE, sizeof(VertexData), reinterpret_cast<const GLvoid*>(base+offsetof(VertexData, m_pos)));
+	glEnableVertexAttribArray(target);
+	glVertexAttribPointer(target,    2, GL_FLOAT, GL_FALSE, sizeof(VertexData), reinterpret_cast<const GLvoid*>(base+offsetof(VertexData, m_target)));
+	glEnableVertexAttribArray(animation);
+	glVertexAttribPointer(animation, 1, GL_FLOAT, GL_FALSE, sizeof(VertexData), reinterpret_cast<const GLvoid*>(base+offsetof(VertexData, m_animation)));
+	glEnableVertexAttribArray(color);
+	glVertexAttribPointer(color,     3, GL_FLOAT, GL_FALSE, sizeof(VertexData), reinterpret_cast<const GLvoid*>(base+offsetof(VertexData, m_color)));
+	glEnableVertexAttribArray(layer);
+	glVertexAttribPointer(layer,     1, GL_FLOAT, GL_FALSE, sizeof(VertexData), reinterpret_cast<const GLvoid*>(base+offsetof(VertexData, m_layer)));
+	glEnableVertexAttribArray(translation);
+	glVertexAttribPointer(translation, 1, GL_FLOAT, GL_FALSE, sizeof(VertexData), reinterpret_cast<const GLvoid*>(base+offsetof(VertexData, m_translation)));
 }
 
 template <>
-void RendererGL::DrawData<RendererGL::VertexData>::loadAttributes() {
-	glEnableVertexAttribArray(m_program.getAttribute(ProgramsGL::POSITION));
-	glVertexAttribPointer(ProgramsGL::POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(VertexData), 0);
+void RendererGL::DrawData<RendererGL::ArrowData>::loadAttributes(size_t first) {
+	size_t base = first*sizeof(ArrowData);
+	GLint begin = m_program.getAttribute(ProgramsGL::ARROW_BEGIN);
+	GLint end   = m_program.getAttribute(ProgramsGL::ARROW_END);
+	GLint tip   = m_program.getAttribute(ProgramsGL::ARROW_TIP);
+	GLint targetBegin = m_program.getAttribute(ProgramsGL::ARROW_TARGET_BEGIN);
+	GLint targetEnd   = m_program.getAttribute(ProgramsGL::ARROW_TARGET_END);
+	GLint targetTip   = m_program.getAttribute(ProgramsGL::ARROW_TARGET_TIP);
+	GLint animation   = m_program.getAttribute(ProgramsGL::ARROW_ANIMATION);
+	GLint color       = m_program.getAttribute(ProgramsGL::ARROW_COLOR);
+	GLint layer       = m_program.getAttribute(ProgramsGL::ARROW_LAYER);
+	GLint translation = m_program.getAttribute(ProgramsGL::ARROW_TRANSLATION);
+	
+	glEnableVertexAttribArray(begin);
+	glVertexAttribPointer(begin, 4, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_begin)));
+	glVertexAttribDivisor(begin, 1);
+	glEnableVertexAttribArray(end);
+	glVertexAttribPointer(end,   4, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_end)));
+	glVertexAttribDivisor(end, 1);
+	glEnableVertexAttribArray(tip);
+	glVertexAttribPointer(tip,   2, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_tip)));
+	glVertexAttribDivisor(tip, 1);
+	glEnableVertexAttribArray(targetBegin);
+	glVertexAttribPointer(targetBegin, 4, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_targetBegin)));
+	glVertexAttribDivisor(targetBegin, 1);
+	glEnableVertexAttribArray(targetEnd);
+	glVertexAttribPointer(targetEnd,   4, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_targetEnd)));
+	glVertexAttribDivisor(targetEnd, 1);
+	glEnableVertexAttribArray(targetTip);
+	glVertexAttribPointer(targetTip,   2, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_targetTip)));
+	glVertexAttribDivisor(targetTip, 1);
+	glEnableVertexAttribArray(animation);
+	glVertexAttribPointer(animation,   1, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_animation)));
+	glVertexAttribDivisor(animation, 1);
+	glEnableVertexAttribArray(color);
+	glVertexAttribPointer(color,       3, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_color)));
+	glVertexAttribDivisor(color, 1);
+	glEnableVertexAttribArray(layer);
+	glVertexAttribPointer(layer,       1, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_layer)));
+	glVertexAttribDivisor(layer, 1);
+	glEnableVertexAttribArray(translation);
+	glVertexAttribPointer(translation, 1, GL_FLOAT, GL_FALSE, sizeof(ArrowData), reinterpret_cast<const GLvoid*>(base+offsetof(ArrowData, m_translation)));
+	glVertexAttribDivisor(translation, 1);
+}
+
+// Corps de la fleche en ARROW_NUM_STEP segments, puis les deux segments de la pointe
+// Sans glDrawArraysInstancedBaseInstance (OpenGL 4.2), chaque plage visible deplace le debut des attributs
+template <>
+void RendererGL::DrawData<RendererGL::ArrowData>::draw(const BoundingBox& view, const GLfloat* translations, const GLfloat* shifts) {
+	CHECK_THREAD();
+	findVisibleSpans(view, translations, shifts, 1);
+	if (m_firsts.empty()) return;
+	
+	bindVBO();
+	for (size_t i=0; i<m_firsts.size(); i++) {
+		loadAttributes(m_firsts[i]);
+		glDrawArraysInstanced(m_mode, 0, 2*ARROW_NUM_STEP+4, m_counts[i]);
+	}
+	unbindVBO();
+}
+
+template <>
+void RendererGL::DrawLists<RendererGL::ArrowData>::setUniforms(const RendererGL& rendererGL) {
+	glUniformMatrix4fv(m_program->getUniform(ProgramsGL::MATRIX), 1, GL_FALSE, rendererGL.m_matrix);
+	glUniform1fv(m_program->getUniform(ProgramsGL::ANIMATION_TIME), ANIMATION_GROUPS, rendererGL.m_animationTime);
+	glUniform1i(m_program->getUniform(ProgramsGL::NUM_STEP), ARROW_NUM_STEP);
+	glUniform2fv(m_program->getUniform(ProgramsGL::TRANSLATION), BOX_TRANSLATIONS, rendererGL.m_translations);
+	glUniform3fv(m_program->getUniform(ProgramsGL::TRANSLATION_SHIFT), BOX_TRANSLATIONS, rendererGL.m_translationShifts);
 }
 
 template <>
 RendererGL::DrawLists<RendererGL::VertexData>& RendererGL::getDrawLists() {return m_drawLists;}
 
+template <>
+RendererGL::DrawLists<RendererGL::ArrowData>& RendererGL::getDrawLists() {return m_arrowLists;}
+
+// Les couches sont ordonnees par le test de profondeur (GL_LEQUAL): dans une meme couche, le dernier dessine reste au-dessus
+void RendererGL::draw() {
+	m_drawLists.draw(*this);
+	m_arrowLists.draw(*this);
+}
+
+BoundingBox RendererGL::getViewBounds() const {
+	float margin = CULL_MARGIN/getPixelScale();
+	float halfWidth  = 1.0/m_matrix[0*4+0] + margin;
+	float halfHeight = 1.0/m_matrix[1*4+1] + margin;
+	return BoundingBox(-m_trans[0]-halfWidth, -m_trans[1]-halfHeight, -m_trans[0]+halfWidth, -m_trans[1]+halfHeight);
+}
+
 void RendererGL::updateDisplayMatrix() {
 	m_matrix[0*4+0] = m_scl*m_sizeFactorx;
 	m_matrix[1*4+1] = m_scl*m_sizeFactory;
@@ -49,6 +151,25 @@ void RendererGL::scale(float factor) {
 	updateDisplayMatrix();
 }
 
+float RendererGL::getPixelScale() const {
+	return m_scl*pixelFactor/2;
+}
+
+void RendererGL::updateLevelOfDetail() {
+	CHECK_THREAD();
+	float pixelScale = getPixelScale();
+	size_t budget = CURVE_LOD_BUDGET;
+	
+	for (size_t i=0; i<CURVE_LOD_CHECKS && i<m_levelOfDetail.size() && budget>0; i++) {
+		// La primitive verifiee passe en fin de liste, les iterateurs restent valides
+		LevelOfDetail* primitive = m_levelOfDetail.front();
+		m_levelOfDetail.splice(m_levelOfDetail.end(), m_levelOfDetail, m_levelOfDetail.begin());
+		
+		if (primitive->updateLevelOfDetail(*this, pixelScale))
+			budget--;
+	}
+}
+
 void RendererGL::resize(int x, int y) {
 	m_sizeFactorx = pixelFactor/x;
 	m_sizeFactory = pixelFactor/y;
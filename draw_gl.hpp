@@ -6,6 +6,8 @@
 #include <cstring>
 #include <cassert>
 #include <map>
+#include <list>
+#include <vector>
 #include <limits>
 #include <tuple>
 #include <algorithm>
@@ -18,6 +20,23 @@
 #endif
 
 #include "prog_gl.hpp"
+#include "spatial_grid.hpp"
+
+// Nombre de segments de la courbe d'une fleche, evaluee par le vertex shader
+#define ARROW_NUM_STEP 10
+// Nombre de groupes d'animation interpoles par les vertex shaders (taille de animationTime dans les shaders)
+#define ANIMATION_GROUPS 64
+// Les couches [0, RENDER_LAYERS] sont ordonnees par le test de profondeur (constante layerCount des shaders)
+#define RENDER_LAYERS 64
+// Marge, en pixels, autour de la fenetre pour la selection des elements visibles
+#define CULL_MARGIN 4.0
+// Elements invisibles dessines plutot que de couper une plage de dessin
+#define CULL_SPAN_GAP 8
+// Nombre de translations appliquees aux fleches et aux sommets par les vertex shaders (taille de translation dans les shaders)
+#define BOX_TRANSLATIONS 16
+// Primitives verifiees et primitives retessellees au plus a chaque image par updateLevelOfDetail
+#define CURVE_LOD_CHECKS 1024
+#define CURVE_LOD_BUDGET 256
 
 #ifndef NDEBUG
 	extern pthread_t displayThread;
@@ -34,31 +53,129 @@ private:
 	class DrawLists;
 
 public:
-	struct VertexData {
-		GLfloat m_pos[2];
-		
-		VertexData() = default;
-		VertexData(GLfloat x, GLfloat y) : m_pos{x, y} {}
-	};
-
 	enum PrimitiveType {
 		TRIANGLES = 0,
 		LINES = 1
 	};
-
+	
+	// La couleur et la couche sont copiees dans les sommets de la primitive, la translation dans les instances de fleches.
+	// Les sommets recoivent leur translation avec leur position.
 	struct DisplayParam {
 		int m_layer;
 		PrimitiveType m_primitiveType;
 		GLfloat m_color[3];
+		unsigned int m_translation;
 		
-		DisplayParam() : m_layer(0), m_primitiveType(LINES), m_color{1.0, 1.0, 1.0} {}
+		DisplayParam() : m_layer(0), m_primitiveType(LINES), m_color{1.0, 1.0, 1.0}, m_translation(0) {}
+	};
+	
+	// Le vertex shader interpole de m_pos a m_target selon le temps du groupe d'animation m_animation.
+	// Le groupe 0 n'est jamais anime. Les positions sont relatives a la translation m_translation.
+	struct VertexData {
+		GLfloat m_pos[2];
+		GLfloat m_target[2];
+		GLfloat m_animation;
+		GLfloat m_color[3];
+		GLfloat m_layer;
+		GLfloat m_translation;
 		
-		void setUniforms(const ProgramsGL::Program& program) const;
+		VertexData() = default;
 		
-		bool operator<(const DisplayParam& other) const {
-			return std::tie(m_layer, m_primitiveType, m_color[0], m_color[1], m_color[2]) 
-					< std::tie(other.m_layer, other.m_primitiveType, other.m_color[0], other.m_color[1], other.m_color[2]);
+		// Ne change pas la couleur ni la couche
+		void setPosition(GLfloat x, GLfloat y, unsigned int translation = 0) {
+			m_pos[0] = m_target[0] = x;
+			m_pos[1] = m_target[1] = y;
+			m_animation = 0.0;
+			m_translation = translation;
 		}
+		
+		void setTarget(GLfloat x, GLfloat y, unsigned int animation) {
+			m_target[0] = x;
+			m_target[1] = y;
+			m_animation = animation;
+		}
+		
+		void setDisplayParam(const DisplayParam& displayParam) {
+			std::copy_n(displayParam.m_color, 3, m_color);
+			m_layer = displayParam.m_layer;
+		}
+		
+		// Positions de depart et d'arrivee: tout le trajet de l'animation est couvert
+		void extendBounds(BoundingBox& box) const {
+			box.extend(m_pos[0], m_pos[1]);
+			box.extend(m_target[0], m_target[1]);
+		}
+		
+		unsigned int getTranslation() const {return m_translation;}
+	};
+	
+	// Primitive dont le nombre de sommets suit l'echelle de l'affichage (voir ShowableCurveVariableVertices)
+	class LevelOfDetail {
+	public:
+		virtual ~LevelOfDetail() = default;
+		// Renvoie true si la primitive a ete retessellee
+		virtual bool updateLevelOfDetail(RendererGL& rendererGL, float pixelScale) =0;
+	};
+	
+	typedef std::list<LevelOfDetail*> LevelOfDetailList;
+	
+	// Une instance par fleche: points de controle du corps et vecteur de la pointe, au depart et a l'arrivee de l'animation.
+	// Les points sont relatifs a la translation m_translation.
+	struct ArrowData {
+		GLfloat m_begin[4]; // p0, c0
+		GLfloat m_end[4];   // c1, p1
+		GLfloat m_tip[2];
+		GLfloat m_targetBegin[4];
+		GLfloat m_targetEnd[4];
+		GLfloat m_targetTip[2];
+		GLfloat m_animation;
+		GLfloat m_color[3];
+		GLfloat m_layer;
+		GLfloat m_translation;
+		
+		ArrowData() = default;
+		ArrowData(GLfloat p0x, GLfloat p0y, GLfloat c0x, GLfloat c0y, GLfloat c1x, GLfloat c1y, GLfloat p1x, GLfloat p1y, GLfloat tipx, GLfloat tipy) :
+				m_begin{p0x, p0y, c0x, c0y}, m_end{c1x, c1y, p1x, p1y}, m_tip{tipx, tipy},
+				m_targetBegin{p0x, p0y, c0x, c0y}, m_targetEnd{c1x, c1y, p1x, p1y}, m_targetTip{tipx, tipy}, m_animation(0.0) {}
+		
+		void setTarget(const ArrowData& target, unsigned int animation) {
+			std::copy_n(target.m_begin, 4, m_targetBegin);
+			std::copy_n(target.m_end,   4, m_targetEnd);
+			std::copy_n(target.m_tip,   2, m_targetTip);
+			m_animation = animation;
+		}
+
+		// Deplace les points de controle, au depart et a l'arrivee
+		void translate(GLfloat dx, GLfloat dy) {
+			GLfloat* points[4] = {m_begin, m_end, m_targetBegin, m_targetEnd};
+			for (int i=0; i<4; i++) {
+				points[i][0] += dx; points[i][1] += dy;
+				points[i][2] += dx; points[i][3] += dy;
+			}
+		}
+		
+		void setDisplayParam(const DisplayParam& displayParam) {
+			std::copy_n(displayParam.m_color, 3, m_color);
+			m_layer = displayParam.m_layer;
+			m_translation = displayParam.m_translation;
+		}
+		
+		// Points de controle et pointe, au depart et a l'arrivee
+		void extendBounds(BoundingBox& box) const {
+			const GLfloat* points[2][3] = {{m_begin, m_end, m_tip}, {m_targetBegin, m_targetEnd, m_targetTip}};
+			for (int i=0; i<2; i++) {
+				const GLfloat* end = points[i][1];
+				const GLfloat* tip = points[i][2];
+				box.extend(points[i][0][0], points[i][0][1]);
+				box.extend(points[i][0][2], points[i][0][3]);
+				box.extend(end[0], end[1]);
+				box.extend(end[2], end[3]);
+				box.extend(end[2]+tip[0]-tip[1], end[3]+tip[1]+tip[0]);
+				box.extend(end[2]+tip[0]+tip[1], end[3]+tip[1]-tip[0]);
+			}
+		}
+		
+		unsigned int getTranslation() const {return m_translation;}
 	};
 
 
@@ -74,6 +191,13 @@ public:
 		
 		void getDrawData();
 		
+		// Ecrit la couleur et la couche dans les sommets, sans changer de DrawData
+		void applyDisplayParam() {
+			VERTEX_DATA* data = editData();
+			for (size_t i=0; data!=nullptr && i<m_numberOfVertex; i++)
+				data[i].setDisplayParam(m_displayParam);
+		}
+		
 		void changeLocation(size_t new_location) {m_location = new_location;}
 		size_t getLocation() {return m_location;}
 		
@@ -132,8 +256,9 @@ public:
 				m_drawData->removeElement(m_location);
 			
 			m_numberOfVertex = numberOfVertex;
-			m_drawData = &(m_drawList->getDrawData(m_numberOfVertex, m_displayParam));
+			m_drawData = &(m_drawList->getDrawData(m_numberOfVertex, m_displayParam.m_primitiveType));
 			m_drawData->pushElement(data, *this);
+			applyDisplayParam();
 		}
 		
 		void remove() {
@@ -145,17 +270,28 @@ public:
 		
 		const DisplayParam& getDisplayParam() {return m_displayParam;}
 		
-		void updateData(VERTEX_DATA* data) {if (m_drawData!=nullptr) m_drawData->changeElement(data, m_location);}
+		void updateData(VERTEX_DATA* data) {
+			if (m_drawData!=nullptr) {
+				m_drawData->changeElement(data, m_location);
+				applyDisplayParam();
+			}
+		}
+		
+		// Sommets gardes par le DrawData, nullptr si la primitive n'est pas affichee.
+		// editData marque les sommets pour l'envoi de la prochaine image; la couleur et la couche doivent y etre gardees.
+		VERTEX_DATA* editData() {return (m_drawData!=nullptr) ? m_drawData->editElement(m_location) : nullptr;}
+		const VERTEX_DATA* getData() const {return (m_drawData!=nullptr) ? m_drawData->getElement(m_location) : nullptr;}
 		
 		void setColor(GLfloat red, GLfloat green, GLfloat blue) {
 			m_displayParam.m_color[0] = red;
 			m_displayParam.m_color[1] = green;
 			m_displayParam.m_color[2] = blue;
-			if (m_drawData!=nullptr)
-				getDrawData();
+			applyDisplayParam();
 		}
 		
-		void setLayer(int layer) {m_displayParam.m_layer = layer; if (m_drawData!=nullptr) getDrawData();}
+		void setLayer(int layer) {m_displayParam.m_layer = layer; applyDisplayParam();}
+		// Les sommets deja ecrits ne sont pas deplaces
+		void setTranslation(unsigned int translation) {m_displayParam.m_translation = translation; applyDisplayParam();}
 		void setPrimitiveType(PrimitiveType type) {m_displayParam.m_primitiveType = type; if (m_drawData!=nullptr) getDrawData();}
 		
 		friend DrawData<VERTEX_DATA>;
@@ -177,8 +313,21 @@ private:
 		GLuint m_vao;
 		GLuint m_vbo;
 		const ProgramsGL::Program& m_program;
+		// Seule copie des sommets cote CPU, envoyee par flush avant de dessiner
 		VERTEX_DATA* m_data;
 		std::vector<PrimitiveData<VERTEX_DATA>*> m_primitives;
+		// Elements modifies depuis le dernier envoi, [m_dirtyBegin, m_dirtyEnd)
+		size_t m_dirtyBegin = std::numeric_limits<size_t>::max();
+		size_t m_dirtyEnd = 0;
+		bool m_reallocated = false;
+		// Rectangles englobants des elements envoyes, relatifs a leur translation et indexes par la grille de celle-ci
+		std::vector<BoundingBox> m_bounds;
+		std::vector<unsigned int> m_boundsTranslation;
+		std::map<unsigned int, SpatialGrid> m_grids;
+		// Plages visibles de la derniere image, en sommets ou en instances
+		std::vector<size_t> m_visible;
+		std::vector<GLint> m_firsts;
+		std::vector<GLsizei> m_counts;
 		
 		void bindVBO() {
 			glBindVertexArray(m_vao);
@@ -190,20 +339,37 @@ private:
 			glBindBuffer(GL_ARRAY_BUFFER, 0);
 		}
 		
-		void loadAttributes();
+		// first: premier element, pour les instances qui n'ont pas d'indice de base en OpenGL 3.3
+		void loadAttributes(size_t first);
+		
+		void insertInGrid(size_t i) {m_grids[m_boundsTranslation[i]].insert(i, m_bounds[i]);}
+		void removeFromGrid(size_t i);
+		void updateBounds(size_t i);
+		// Remplit m_firsts et m_counts, en multiples de unit, avec les elements qui touchent view
+		void findVisibleSpans(const BoundingBox& view, const GLfloat* translations, const GLfloat* shifts, size_t unit);
+		
+		void setDirty(size_t i) {
+			m_dirtyBegin = std::min(m_dirtyBegin, i);
+			m_dirtyEnd   = std::max(m_dirtyEnd, i+1);
+		}
 		
 	public:
 		DrawData(GLenum mode, size_t vertexPerPrimitive, const ProgramsGL::Program& program);
 		DrawData(const DrawData& other) = delete;
 		~DrawData();
 		
+		// data peut etre nullptr: les sommets sont alors ecrits ensuite par editElement
 		void pushElement(const VERTEX_DATA* data, PrimitiveData<VERTEX_DATA>& element);
 		void removeElement(size_t i);
 		void changeElement(VERTEX_DATA* newElement, size_t i);
-		const VERTEX_DATA* getElement(size_t i) {return m_data + i*m_vertexPerPrimitive;}
+		VERTEX_DATA* editElement(size_t i) {assert(i<m_size); setDirty(i); return m_data + i*m_vertexPerPrimitive;}
+		const VERTEX_DATA* getElement(size_t i) const {return m_data + i*m_vertexPerPrimitive;}
 		bool empty() {return m_size==0;}
 		
-		void draw();
+		// Envoie en une fois les elements modifies depuis la derniere image et met la grille a jour
+		void flush();
+		// Ne dessine que les elements qui touchent view, une fois translates et decales
+		void draw(const BoundingBox& view, const GLfloat* translations, const GLfloat* shifts);
 		
 		friend PrimitiveData<VERTEX_DATA>;
 	};
@@ -211,16 +377,20 @@ private:
 	template <class VERTEX_DATA>
 	class DrawLists {
 	private:
+		// Un seul DrawData par type de primitive et nombre de sommets: la couleur et la couche sont des attributs
+		typedef std::map<std::pair<PrimitiveType, size_t>, DrawData<VERTEX_DATA>> DrawDataMap;
+		
 		const ProgramsGL::Program* m_program = nullptr;
-		std::map<DisplayParam, std::map<size_t, DrawData<VERTEX_DATA>>> m_displayMap;
+		DrawDataMap m_drawDataMap;
 		
 	public:
 		DrawLists() = default;
 		DrawLists(const ProgramsGL::Program& program) : m_program(&program) {}
 		
-		void draw(const ProgramsGL& programs, const RendererGL& rendererGL);
+		void setUniforms(const RendererGL& rendererGL);
+		void draw(const RendererGL& rendererGL);
 		
-		DrawData<VERTEX_DATA>& getDrawData(size_t numberOfVertex, const DisplayParam& displayParam);
+		DrawData<VERTEX_DATA>& getDrawData(size_t numberOfVertex, PrimitiveType primitiveType);
 	};
 	
 	
@@ -231,21 +401,34 @@ private:
 	
 private:
 	DrawLists<VertexData> m_drawLists;
+	DrawLists<ArrowData> m_arrowLists;
 	const ProgramsGL* m_programs = nullptr;
 	GLfloat m_matrix[16];
 	GLfloat m_scl         = 1.0;
 	GLfloat m_trans[2]    = {0.0, 0.0};
 	GLfloat m_sizeFactorx = 1.0;
 	GLfloat m_sizeFactory = 1.0;
+	GLfloat m_animationTime[ANIMATION_GROUPS] = {0.0};
+	std::vector<unsigned int> m_freeAnimations;
+	GLfloat m_translations[2*BOX_TRANSLATIONS] = {0.0};
+	std::vector<unsigned int> m_freeTranslations;
+	// Debut, fin et decalage de la plage de chaque translation
+	GLfloat m_translationShifts[3*BOX_TRANSLATIONS] = {0.0};
+	bool m_shiftedTranslations[BOX_TRANSLATIONS] = {false};
+	// Primitives de ce renderer seulement: elles sont retessellees dans son contexte OpenGL
+	LevelOfDetailList m_levelOfDetail;
 	
 	template <typename VERTEX_DATA>
 	DrawLists<VERTEX_DATA>& getDrawLists();
 	
 	void updateDisplayMatrix();
+	// Partie de la structure visible dans la fenetre, avec la marge CULL_MARGIN
+	BoundingBox getViewBounds() const;
 	
 public:
 	RendererGL() = default;
-	RendererGL(const ProgramsGL& programs) : m_drawLists(programs.getProgram(ProgramsGL::DEFAULT_PROGRAM)), m_programs(&programs) {
+	RendererGL(const ProgramsGL& programs) : m_drawLists(programs.getProgram(ProgramsGL::DEFAULT_PROGRAM)),
+			m_arrowLists(programs.getProgram(ProgramsGL::ARROW_PROGRAM)), m_programs(&programs) {
 #ifndef NDEBUG
 		displayThread = pthread_self();
 #endif
@@ -255,18 +438,92 @@ public:
 			}
 		}
 		updateDisplayMatrix();
+		
+		for (unsigned int i=ANIMATION_GROUPS-1; i>0; i--)
+			m_freeAnimations.push_back(i);
+		for (unsigned int i=BOX_TRANSLATIONS-1; i>0; i--)
+			m_freeTranslations.push_back(i);
+	}
+	
+	void draw();
+	
+	// Groupes d'animation: seul le temps du groupe change a chaque image, les sommets ne sont envoyes qu'une fois.
+	// startAnimation renvoie 0 si tous les groupes sont utilises.
+	unsigned int startAnimation() {
+		if (m_freeAnimations.empty()) return 0;
+		unsigned int animation = m_freeAnimations.back();
+		m_freeAnimations.pop_back();
+		m_animationTime[animation] = 0.0;
+		return animation;
 	}
 	
-	void draw() {m_drawLists.draw(*m_programs, *this);}
+	void setAnimationTime(unsigned int animation, float t) {assert(animation!=0); m_animationTime[animation] = t;}
+	void endAnimation(unsigned int animation) {assert(animation!=0); m_freeAnimations.push_back(animation);}
+	
+	// Translations de boite: deplacer une boite ne change que sa translation, pas les fleches ni les sommets qui la suivent.
+	// La translation 0 reste nulle; allocateTranslation la renvoie si toutes les autres sont utilisees.
+	unsigned int allocateTranslation() {
+		if (m_freeTranslations.empty()) return 0;
+		unsigned int translation = m_freeTranslations.back();
+		m_freeTranslations.pop_back();
+		m_translations[2*translation] = m_translations[2*translation+1] = 0.0;
+		return translation;
+	}
+	
+	void setTranslation(unsigned int translation, float x, float y) {
+		assert(translation!=0);
+		m_translations[2*translation]   = x;
+		m_translations[2*translation+1] = y;
+	}
+	
+	const GLfloat* getTranslation(unsigned int translation) const {return m_translations+2*translation;}
+	void freeTranslation(unsigned int translation) {assert(translation!=0); m_freeTranslations.push_back(translation);}
+	
+	// Decalage d'une plage: les fleches fixes (groupe 0) de la translation dont le debut est dans [start, end)
+	// sont deplacees de dx par le vertex shader, sans etre renvoyees.
+	// Une seule plage par translation; startTranslationShift renvoie false si elle est deja prise ou si la translation est 0.
+	bool startTranslationShift(unsigned int translation) {
+		if (translation==0 || m_shiftedTranslations[translation]) return false;
+		m_shiftedTranslations[translation] = true;
+		return true;
+	}
+	
+	void setTranslationShift(unsigned int translation, float start, float end, float dx) {
+		assert(m_shiftedTranslations[translation]);
+		m_translationShifts[3*translation]   = start;
+		m_translationShifts[3*translation+1] = end;
+		m_translationShifts[3*translation+2] = dx;
+	}
+	
+	void endTranslationShift(unsigned int translation) {
+		assert(m_shiftedTranslations[translation]);
+		std::fill_n(m_translationShifts+3*translation, 3, 0.0);
+		m_shiftedTranslations[translation] = false;
+	}
 	
 	void translate(int dx, int dy);
 	void scale(float factor);
 	void resize(int x, int y);
+	// Pixels par unite de la structure
+	float getPixelScale() const;
+	
+	LevelOfDetailList& getLevelOfDetailList() {return m_levelOfDetail;}
+	// A appeler a chaque image: verifie au plus CURVE_LOD_CHECKS primitives, a tour de role,
+	// et en retessele au plus CURVE_LOD_BUDGET.
+	void updateLevelOfDetail();
 	
 	friend DrawLists<VertexData>;
+	friend DrawLists<ArrowData>;
 	friend PrimitiveData<VertexData>;
+	friend PrimitiveData<ArrowData>;
 };
 
+template <>
+void RendererGL::DrawData<RendererGL::ArrowData>::draw(const BoundingBox& view, const GLfloat* translations, const GLfloat* shifts);
+
+template <>
+void RendererGL::DrawLists<RendererGL::ArrowData>::setUniforms(const RendererGL& rendererGL);
+
 
 
 
@@ -279,12 +536,13 @@ void RendererGL::PrimitiveData<VERTEX_DATA>::getDrawData() {
 	CHECK_THREAD();
 	assert(m_drawList!=nullptr);
 	
-	DrawData<VERTEX_DATA>* newDrawData = &(m_drawList->getDrawData(m_numberOfVertex, m_displayParam));
+	DrawData<VERTEX_DATA>* newDrawData = &(m_drawList->getDrawData(m_numberOfVertex, m_displayParam.m_primitiveType));
 	if (newDrawData!=m_drawData) {
-		size_t old_location = m_location;
+		// removeElement remplace les sommets par ceux du dernier element
 		const VERTEX_DATA* data = m_drawData->getElement(m_location);
-		m_drawData->removeElement(old_location);
-		newDrawData->pushElement(data, *this);
+		std::vector<VERTEX_DATA> copy(data, data+m_numberOfVertex);
+		m_drawData->removeElement(m_location);
+		newDrawData->pushElement(copy.data(), *this);
 		m_drawData = newDrawData;
 	}
 }
@@ -303,7 +561,7 @@ RendererGL::DrawData<VERTEX_DATA>::DrawData(GLenum mode, size_t vertexPerPrimiti
 	m_data = new VERTEX_DATA[m_vertexPerPrimitive];
 	glBufferData(GL_ARRAY_BUFFER, m_capacity*m_vertexPerPrimitive*sizeof(VERTEX_DATA), m_data, GL_DYNAMIC_DRAW);
 	
-	loadAttributes();
+	loadAttributes(0);
 	
 	unbindVBO();
 }
@@ -311,7 +569,7 @@ RendererGL::DrawData<VERTEX_DATA>::DrawData(GLenum mode, size_t vertexPerPrimiti
 template <typename VERTEX_DATA>
 RendererGL::DrawData<VERTEX_DATA>::~DrawData() {
 	CHECK_THREAD();
-	free(m_data);
+	delete [] m_data;
 	glDeleteVertexArrays (1, &m_vao);
 	glDeleteBuffers (1, &m_vbo);
 }
@@ -322,6 +580,7 @@ void RendererGL::DrawData<VERTEX_DATA>::removeElement(size_t i) {
 	assert(i<m_size);
 	
 	m_primitives[i]->changeLocation(std::numeric_limits<size_t>::max());
+	removeFromGrid(i);
 	m_size--;
 	if (i!=m_size) {
 		VERTEX_DATA* last_ptr = m_data + m_size*m_vertexPerPrimitive;
@@ -330,19 +589,21 @@ void RendererGL::DrawData<VERTEX_DATA>::removeElement(size_t i) {
 		
 		m_primitives.back()->changeLocation(i);
 		m_primitives[i] = m_primitives.back();
-		
-		bindVBO();
-		glBufferSubData(GL_ARRAY_BUFFER, i*m_vertexPerPrimitive*sizeof(VERTEX_DATA), m_vertexPerPrimitive*sizeof(VERTEX_DATA), ptr);
-		unbindVBO();
+		removeFromGrid(m_size);
+		m_bounds[i] = m_bounds[m_size];
+		m_boundsTranslation[i] = m_boundsTranslation[m_size];
+		insertInGrid(i);
+		setDirty(i);
 	}
 	m_primitives.pop_back();
+	m_bounds.pop_back();
+	m_boundsTranslation.pop_back();
 }
 
 template <typename VERTEX_DATA>
 void RendererGL::DrawData<VERTEX_DATA>::pushElement(const VERTEX_DATA* vert_data, PrimitiveData<VERTEX_DATA>& element) {
 	CHECK_THREAD();
 	
-	bool resized = false;
 	if (++m_size > m_capacity) {
 		size_t old_capacity = m_capacity;
 		VERTEX_DATA* old_data = m_data;
@@ -351,23 +612,16 @@ void RendererGL::DrawData<VERTEX_DATA>::pushElement(const VERTEX_DATA* vert_data
 		m_data = new VERTEX_DATA[m_capacity*m_vertexPerPrimitive];
 		std::copy(old_data, old_data + old_capacity*m_vertexPerPrimitive, m_data);
 		delete [] old_data;
-		resized = true;
+		m_reallocated = true;
 	}
 	
-	VERTEX_DATA* ptr = m_data + (m_size-1)*m_vertexPerPrimitive;
-	std::copy_n(vert_data, m_vertexPerPrimitive, ptr);
+	if (vert_data!=nullptr)
+		std::copy_n(vert_data, m_vertexPerPrimitive, m_data + (m_size-1)*m_vertexPerPrimitive);
 	m_primitives.push_back(&element);
+	m_bounds.push_back(BoundingBox());
+	m_boundsTranslation.push_back(0);
 	element.changeLocation(m_size-1);
-	
-	bindVBO();
-	if (resized) {
-		glBufferData(GL_ARRAY_BUFFER, m_capacity*m_vertexPerPrimitive*sizeof(VERTEX_DATA), m_data, GL_DYNAMIC_DRAW);
-	}
-	else {
-		glBufferSubData(GL_ARRAY_BUFFER, (m_size-1)*m_vertexPerPrimitive*sizeof(VERTEX_DATA), m_vertexPerPrimitive*sizeof(VERTEX_DATA), vert_data);
-	}
-	
-	unbindVBO();
+	setDirty(m_size-1);
 }
 
 template <typename VERTEX_DATA>
@@ -375,18 +629,110 @@ void RendererGL::DrawData<VERTEX_DATA>::changeElement(VERTEX_DATA* new_element,
 	CHECK_THREAD();
 	assert(i<m_size);
 	
-	VERTEX_DATA* ptr = m_data + i*m_vertexPerPrimitive;
-	std::copy_n(new_element, m_vertexPerPrimitive, ptr);
+	std::copy_n(new_element, m_vertexPerPrimitive, m_data + i*m_vertexPerPrimitive);
+	setDirty(i);
+}
+
+template <typename VERTEX_DATA>
+void RendererGL::DrawData<VERTEX_DATA>::flush() {
+	CHECK_THREAD();
+	
+	m_dirtyEnd = std::min(m_dirtyEnd, m_size);
+	if (!m_reallocated && m_dirtyBegin>=m_dirtyEnd) return;
+	
+	for (size_t i=m_dirtyBegin; i<m_dirtyEnd; i++)
+		updateBounds(i);
+	
 	bindVBO();
-	glBufferSubData(GL_ARRAY_BUFFER, i*m_vertexPerPrimitive*sizeof(VERTEX_DATA), m_vertexPerPrimitive*sizeof(VERTEX_DATA), ptr);
+	if (m_reallocated)
+		glBufferData(GL_ARRAY_BUFFER, m_capacity*m_vertexPerPrimitive*sizeof(VERTEX_DATA), m_data, GL_DYNAMIC_DRAW);
+	else
+		glBufferSubData(GL_ARRAY_BUFFER, m_dirtyBegin*m_vertexPerPrimitive*sizeof(VERTEX_DATA), (m_dirtyEnd-m_dirtyBegin)*m_vertexPerPrimitive*sizeof(VERTEX_DATA),
+						m_data + m_dirtyBegin*m_vertexPerPrimitive);
 	unbindVBO();
+	
+	m_dirtyBegin = std::numeric_limits<size_t>::max();
+	m_dirtyEnd = 0;
+	m_reallocated = false;
+}
+
+template <typename VERTEX_DATA>
+void RendererGL::DrawData<VERTEX_DATA>::removeFromGrid(size_t i) {
+	auto it = m_grids.find(m_boundsTranslation[i]);
+	if (it==m_grids.end()) return;
+	
+	it->second.remove(i, m_bounds[i]);
+	if (it->second.empty())
+		m_grids.erase(it);
+}
+
+template <typename VERTEX_DATA>
+void RendererGL::DrawData<VERTEX_DATA>::updateBounds(size_t i) {
+	BoundingBox box;
+	for (size_t j=0; j<m_vertexPerPrimitive; j++)
+		m_data[i*m_vertexPerPrimitive+j].extendBounds(box);
+	
+	unsigned int translation = m_data[i*m_vertexPerPrimitive].getTranslation();
+	for (size_t j=1; j<m_vertexPerPrimitive; j++) {
+		// Primitive etiree entre deux translations: toujours dessinee
+		if (m_data[i*m_vertexPerPrimitive+j].getTranslation()!=translation) {
+			const float inf = std::numeric_limits<float>::infinity();
+			box = BoundingBox(-inf, -inf, inf, inf);
+			translation = 0;
+			break;
+		}
+	}
+	
+	if (!(box==m_bounds[i]) || translation!=m_boundsTranslation[i]) {
+		removeFromGrid(i);
+		m_bounds[i] = box;
+		m_boundsTranslation[i] = translation;
+		insertInGrid(i);
+	}
+}
+
+template <typename VERTEX_DATA>
+void RendererGL::DrawData<VERTEX_DATA>::findVisibleSpans(const BoundingBox& view, const GLfloat* translations, const GLfloat* shifts, size_t unit) {
+	m_firsts.clear();
+	m_counts.clear();
+	
+	// Chaque grille est interrogee avec la fenetre ramenee dans les coordonnees de sa translation,
+	// elargie du decalage en cours de la translation
+	m_visible.clear();
+	for (auto& grid : m_grids) {
+		const GLfloat* t = translations+2*grid.first;
+		const GLfloat dx = shifts[3*grid.first+2];
+		BoundingBox local(view.m_min[0]-t[0]-std::max(dx, GLfloat(0.0)), view.m_min[1]-t[1],
+				view.m_max[0]-t[0]-std::min(dx, GLfloat(0.0)), view.m_max[1]-t[1]);
+		
+		size_t begin = m_visible.size();
+		grid.second.query(local, m_visible);
+		m_visible.erase(std::remove_if(m_visible.begin()+begin, m_visible.end(), [&](size_t i) {return !m_bounds[i].intersects(local);}),
+						m_visible.end());
+	}
+	std::sort(m_visible.begin(), m_visible.end());
+	m_visible.erase(std::unique(m_visible.begin(), m_visible.end()), m_visible.end());
+	
+	size_t end = 0;
+	for (size_t i : m_visible) {
+		if (!m_firsts.empty() && i<=end+CULL_SPAN_GAP)
+			m_counts.back() = (i+1)*unit - m_firsts.back();
+		else {
+			m_firsts.push_back(i*unit);
+			m_counts.push_back(unit);
+		}
+		end = i+1;
+	}
 }
 
 template <typename VERTEX_DATA>
-void RendererGL::DrawData<VERTEX_DATA>::draw() {
+void RendererGL::DrawData<VERTEX_DATA>::draw(const BoundingBox& view, const GLfloat* translations, const GLfloat* shifts) {
 	CHECK_THREAD();
+	findVisibleSpans(view, translations, shifts, m_vertexPerPrimitive);
+	if (m_firsts.empty()) return;
+	
 	glBindVertexArray(m_vao);
-	glDrawArrays(m_mode, 0, m_size*m_vertexPerPrimitive);
+	glMultiDrawArrays(m_mode, m_firsts.data(), m_counts.data(), m_firsts.size());
 	glBindVertexArray(0);
 }
 
@@ -395,50 +741,47 @@ void RendererGL::DrawData<VERTEX_DATA>::draw() {
 
 
 template <typename VERTEX_DATA>
-void RendererGL::DrawLists<VERTEX_DATA>::draw(const ProgramsGL& programs, const RendererGL& rendererGL) {
+void RendererGL::DrawLists<VERTEX_DATA>::draw(const RendererGL& rendererGL) {
 	CHECK_THREAD();
 	
-	m_program->use();
-	glUniformMatrix4fv(m_program->getUniform(ProgramsGL::MATRIX), 1, GL_FALSE, rendererGL.m_matrix);
+	if (m_drawDataMap.empty()) return;
 	
-	for (auto it0 = m_displayMap.begin(); it0!=m_displayMap.end();) {
-		std::map<size_t, DrawData<VERTEX_DATA>>& map = it0->second;
-		if (!map.empty()) {
-			it0->first.setUniforms(*m_program);
-			
-			for (auto it1 = map.begin(); it1!=map.end();) {
-				DrawData<VERTEX_DATA>& drawData = it1->second;
-				if (!drawData.empty()) {
-					drawData.draw();
-					it1++;
-				}
-				else {
-					it1 = map.erase(it1);
-				}
-			}
-			
-			if (map.empty()) {
-				it0 = m_displayMap.erase(it0);
-			}
-			else
-				it0++;
+	m_program->use();
+	setUniforms(rendererGL);
+	BoundingBox view = rendererGL.getViewBounds();
+	
+	for (auto it = m_drawDataMap.begin(); it!=m_drawDataMap.end();) {
+		DrawData<VERTEX_DATA>& drawData = it->second;
+		if (!drawData.empty()) {
+			drawData.flush();
+			drawData.draw(view, rendererGL.m_translations, rendererGL.m_translationShifts);
+			it++;
+		}
+		else {
+			it = m_drawDataMap.erase(it);
 		}
-		else
-			it0 = m_displayMap.erase(it0);
 	}
 	m_program->unuse();
 }
 
 template <typename VERTEX_DATA>
-RendererGL::DrawData<VERTEX_DATA>& RendererGL::DrawLists<VERTEX_DATA>::getDrawData(size_t num_vertex, const DisplayParam& displayParam) {
+void RendererGL::DrawLists<VERTEX_DATA>::setUniforms(const RendererGL& rendererGL) {
+	glUniformMatrix4fv(m_program->getUniform(ProgramsGL::MATRIX), 1, GL_FALSE, rendererGL.m_matrix);
+	glUniform1fv(m_program->getUniform(ProgramsGL::ANIMATION_TIME), ANIMATION_GROUPS, rendererGL.m_animationTime);
+	glUniform2fv(m_program->getUniform(ProgramsGL::TRANSLATION), BOX_TRANSLATIONS, rendererGL.m_translations);
+}
+
+template <typename VERTEX_DATA>
+RendererGL::DrawData<VERTEX_DATA>& RendererGL::DrawLists<VERTEX_DATA>::getDrawData(size_t num_vertex, PrimitiveType primitiveType) {
 	CHECK_THREAD();
 	
-	std::map<size_t, DrawData<VERTEX_DATA>>& map = m_displayMap[displayParam];
-	if (map.find(num_vertex) != map.end())
-		return map.at(num_vertex);
+	auto key = std::make_pair(primitiveType, num_vertex);
+	auto it = m_drawDataMap.find(key);
+	if (it != m_drawDataMap.end())
+		return it->second;
 	else {
-		GLenum mode = (displayParam.m_primitiveType==LINES) ? GL_LINES : GL_TRIANGLES;
-		return map.emplace(std::piecewise_construct, std::forward_as_tuple(num_vertex), std::forward_as_tuple(mode, num_vertex, *m_program)).first->second;
+		GLenum mode = (primitiveType==LINES) ? GL_LINES : GL_TRIANGLES;
+		return m_drawDataMap.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(mode, num_vertex, *m_program)).first->second;
 	}
 }
 
@@ -1,4 +1,6 @@
-#include "io.hpp" 
+#include <algorithm>
+
+#include "io.hpp"
 
 void readMatrixText(std::istream& stream, FUMatrix& val) {
 	val.m_data = new FUOver2[val.m_size*val.m_size];
@@ -166,3 +168,116 @@ return_error:
 	return stream;
 
 }
+
+// Format binaire des points de reprise: entiers de 32 bits petit-boutistes, precedes d'un en-tete
+static const char checkpointMagic[4] = {'T', 'T', 'C', 'P'};
+static const unsigned int checkpointVersion = 1;
+
+static void writeUInt(std::ostream& stream, unsigned int val) {
+	char bytes[4] = {static_cast<char>(val & 0xff), static_cast<char>((val>>8) & 0xff),
+			static_cast<char>((val>>16) & 0xff), static_cast<char>((val>>24) & 0xff)};
+	stream.write(bytes, 4);
+}
+
+static bool readUInt(std::istream& stream, unsigned int& val) {
+	unsigned char bytes[4];
+	stream.read(reinterpret_cast<char*>(bytes), 4);
+	val = bytes[0] | (bytes[1]<<8) | (bytes[2]<<16) | (static_cast<unsigned int>(bytes[3])<<24);
+	return stream.good();
+}
+
+static void writeArrows(std::ostream& stream, const std::list<Arrow>& arrows) {
+	writeUInt(stream, arrows.size());
+	for (auto it=arrows.begin(); it!=arrows.end(); it++) {
+		writeUInt(stream, it->begin());
+		writeUInt(stream, it->end());
+	}
+}
+
+static bool readArrows(std::istream& stream, std::list<Arrow>& arrows, unsigned int numberOfTracks) {
+	unsigned int size;
+	if (!readUInt(stream, size)) return false;
+	
+	arrows.clear();
+	for (unsigned int i=0; i<size; i++) {
+		unsigned int begin, end;
+		if (!readUInt(stream, begin) || !readUInt(stream, end)) return false;
+		if (begin>=numberOfTracks || end>=numberOfTracks || begin==end) return false;
+		arrows.push_back(Arrow(begin, end));
+	}
+	return true;
+}
+
+static void writePermutation(std::ostream& stream, const std::vector<unsigned int>& permutation) {
+	for (size_t i=0; i<permutation.size(); i++)
+		writeUInt(stream, permutation[i]);
+}
+
+static bool readPermutation(std::istream& stream, std::vector<unsigned int>& permutation, unsigned int numberOfTracks) {
+	std::vector<bool> seen(numberOfTracks, false);
+	permutation.resize(numberOfTracks);
+	for (unsigned int i=0; i<numberOfTracks; i++) {
+		if (!readUInt(stream, permutation[i])) return false;
+		if (permutation[i]>=numberOfTracks || seen[permutation[i]]) return false;
+		seen[permutation[i]] = true;
+	}
+	return true;
+}
+
+static void writeOneHandle(std::ostream& stream, const OneHandle::Checkpoint& val) {
+	writePermutation(stream, val.prePermutation);
+	writePermutation(stream, val.permutation);
+	writePermutation(stream, val.postPermutation);
+	writeArrows(stream, val.arrows0);
+	writeArrows(stream, val.arrows1);
+}
+
+static bool readOneHandle(std::istream& stream, OneHandle::Checkpoint& val, unsigned int numberOfTracks) {
+	return readPermutation(stream, val.prePermutation, numberOfTracks) && readPermutation(stream, val.permutation, numberOfTracks) &&
+			readPermutation(stream, val.postPermutation, numberOfTracks) &&
+			readArrows(stream, val.arrows0, numberOfTracks) && readArrows(stream, val.arrows1, numberOfTracks);
+}
+
+void writeCheckpointBinary(std::ostream& stream, const ZeroHandle::Checkpoint& val) {
+	stream.write(checkpointMagic, 4);
+	writeUInt(stream, checkpointVersion);
+	writeUInt(stream, val.k);
+	writeUInt(stream, val.matrix.size());
+	for (unsigned int i=0; i<val.matrix.size(); i++) {
+		for (unsigned int j=0; j<val.matrix.size(); j++) {
+			stream.put(static_cast<char>((val.matrix(i, j).getU() ? 2 : 0) | (val.matrix(i, j).getCst() ? 1 : 0)));
+		}
+	}
+	writeUInt(stream, val.depth);
+	writeOneHandle(stream, val.voidHandle);
+	writeOneHandle(stream, val.fullHandle);
+}
+
+void readCheckpointBinary(std::istream& stream, ZeroHandle::Checkpoint& val) {
+	char magic[4];
+	unsigned int version;
+	unsigned int size;
+	
+	stream.read(magic, 4);
+	if (!stream.good() || !std::equal(magic, magic+4, checkpointMagic)) goto return_error;
+	if (!readUInt(stream, version) || version!=checkpointVersion) goto return_error;
+	if (!readUInt(stream, val.k) || !readUInt(stream, size)) goto return_error;
+	if (size > 10000 || size%2!=0 || val.k > size/2) goto return_error;
+	
+	val.matrix = FUMatrix(size);
+	for (unsigned int i=0; i<size; i++) {
+		for (unsigned int j=0; j<size; j++) {
+			int c = stream.get();
+			if (!stream.good() || (c & ~0x03)!=0) goto return_error;
+			val.matrix(i, j) = FUOver2((c & 0x02)!=0, (c & 0x01)!=0);
+		}
+	}
+	
+	if (!readUInt(stream, val.depth)) goto return_error;
+	if (!readOneHandle(stream, val.voidHandle, size/2-val.k)) goto return_error;
+	if (!readOneHandle(stream, val.fullHandle, val.k)) goto return_error;
+	
+	return;
+return_error:
+	stream.setstate(std::istream::failbit);
+}
@@ -3,10 +3,13 @@
 
 #include <utility>
 #include "matrix.hpp"
+#include "zero_handle.hpp"
 
 std::ostream& operator<<(std::ostream& stream, const FUOver2& val);
 std::istream& operator>>(std::istream& stream, FUOver2& val);
 std::ostream& operator<<(std::ostream& stream, const std::pair<FUMatrix, unsigned int>& val);
 std::istream& operator>>(std::istream& stream, std::pair<FUMatrix, unsigned int>& val);
+void writeCheckpointBinary(std::ostream& stream, const ZeroHandle::Checkpoint& val);
+void readCheckpointBinary(std::istream& stream, ZeroHandle::Checkpoint& val);
 
 #endif // __IO_HPP__
@@ -8,6 +8,7 @@
 
 #include "matrix.hpp"
 #include "util.hpp"
+#include "cancellation.hpp"
 
 FUMatrix FUMatrix::operator*(const FUMatrix& other) const {
 	assert(m_size == other.m_size);
@@ -83,6 +84,7 @@ static void doLemma23(FUSubMatrix& m, unsigned int km, unsigned int nm, std::lis
 		return;
 	
 	for (FUSubMatrix::Index offset(m.firstIndex()); offset!=m.endIndex(); offset++) {
+		cancellationPoint();
 		i = m.firstIndex();
 		for (j = offset; j!=m.endIndex(); i++, j++) {
 			
@@ -1,15 +1,25 @@
 #include <cassert>
+#include <vector>
+#include <algorithm>
 #include <limits>
+#include <set>
+#include <unordered_map>
 
 #include "one_handle.hpp"
 #include "display_cmd.hpp"
+#include "statistics.hpp"
+#include "cancellation.hpp"
 
 ArrowBox::Renderer::Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float basex, float basey, int layer, OneHandleRenderer& oneHandle,
 	std::list<std::pair<unsigned int, unsigned int>>& arrowsData, std::list<ArrowBox::ArrowInArrowBox*>& arrows) :
-	m_basex(basex), m_basey(basey), m_lenght(arrows.size()*0.055), m_oneHandle(oneHandle), m_layer(layer)
+	m_basex(basex), m_basey(basey), m_lenght(arrows.size()*0.055), m_oneHandle(oneHandle), m_rendererGL(rendererGL),
+	m_translation(rendererGL.allocateTranslation()), m_layer(layer)
 {
 	assert(arrowsData.size() == arrows.size());
 	
+	if (m_translation!=0)
+		rendererGL.setTranslation(m_translation, m_basex, m_basey);
+	
 	m_tracks.reserve(m_oneHandle.numberOfTracks());
 	for (unsigned int i=0; i<m_oneHandle.numberOfTracks(); i++) {
 		m_tracks.emplace_back(rendererGL, m_basex, m_basey-(1.0*(i+1))/(m_oneHandle.numberOfTracks()+1), m_basex+m_lenght,
@@ -28,7 +38,7 @@ ArrowBox::Renderer::Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float b
 		float p1y = m_basey - (it0->second+1)*delta;
 		float t0y = (it0->second > it0->first) ? -1.0 : 1.0;
 		
-		m_arrow.emplace_back(rendererGL, (*it1)->getArrow(), px, p0y, px, p1y, 0.0, t0y, 0.0, -t0y, m_layer, it0->first, it0->second);
+		m_arrow.emplace_back(rendererGL, (*it1)->m_arrow, px, p0y, px, p1y, 0.0, t0y, 0.0, -t0y, m_layer, it0->first, it0->second, m_translation);
 		(*it1)->setArrowRendererInList(--m_arrow.end());
 	}
 	
@@ -36,8 +46,12 @@ ArrowBox::Renderer::Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float b
 }
 
 ArrowBox::Renderer::Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float basex, float basey, int layer, OneHandleRenderer& oneHandle) :
-	m_basex(basex), m_basey(basey), m_lenght(0.0), m_oneHandle(oneHandle), m_layer(layer)
+	m_basex(basex), m_basey(basey), m_lenght(0.0), m_oneHandle(oneHandle), m_rendererGL(rendererGL),
+	m_translation(rendererGL.allocateTranslation()), m_layer(layer)
 {
+	if (m_translation!=0)
+		rendererGL.setTranslation(m_translation, m_basex, m_basey);
+	
 	m_tracks.reserve(m_oneHandle.numberOfTracks());
 	for (unsigned int i=0; i<m_oneHandle.numberOfTracks(); i++) {
 		m_tracks.emplace_back(rendererGL, m_basex, m_basey-(1.0*(i+1))/(m_oneHandle.numberOfTracks()+1),
@@ -47,10 +61,19 @@ ArrowBox::Renderer::Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float b
 	arrowBox.m_renderer = this;
 }
 
+ArrowBox::Renderer::~Renderer() {
+	if (m_translation!=0)
+		m_rendererGL.freeTranslation(m_translation);
+}
+
 void ArrowBox::Renderer::changeBasePoints(float basex, float basey, bool updateArrows) {
 	m_basex = basex; m_basey = basey;
 	if (updateArrows) {
-		refreshArrows();
+		// Les fleches suivent la translation sans etre renvoyees
+		if (m_translation!=0)
+			m_rendererGL.setTranslation(m_translation, m_basex, m_basey);
+		else
+			refreshArrows();
 	}
 	refreshTracks();
 }
@@ -157,6 +180,9 @@ void ArrowBox::Renderer::doMoveArrow(std::list<Arrow::Renderer>::iterator it, st
 		assert(n==0);
 		m_arrow.splice(it1, src.m_arrow, it);
 	}
+	
+	if (&src!=this)
+		it->setTranslation(m_translation);
 }
 
 void ArrowBox::Renderer::spawnArrowAfterCrossingForward(RendererGL& rendererGL, ArrowBox::ArrowRendererInList it1, ArrowInArrowBox& newArrow, int index,
@@ -200,7 +226,7 @@ void ArrowBox::Renderer::spawnArrowAfterCrossingForward(RendererGL& rendererGL,
 	
 	m_arrow.splice(it, m_arrow, it1);
 	if (!spawnAfter) {
-		it1 = m_arrow.emplace(it, rendererGL, newArrow.getArrow(), 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to);
+		it1 = m_arrow.emplace(it, rendererGL, newArrow.m_arrow, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to, m_translation);
 		newArrow.setArrowRendererInList(it1);
 		
 		if (anim1!=nullptr) {
@@ -225,7 +251,7 @@ void ArrowBox::Renderer::spawnArrowAfterCrossingForward(RendererGL& rendererGL,
 	} else {
 		it1 = it;
 		it1++;
-		it1 = m_arrow.emplace(it1, rendererGL, newArrow.getArrow(), 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to);
+		it1 = m_arrow.emplace(it1, rendererGL, newArrow.m_arrow, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to, m_translation);
 		newArrow.setArrowRendererInList(it1);
 		
 		if (anim1!=nullptr) {
@@ -247,19 +273,9 @@ void ArrowBox::Renderer::spawnArrowAfterCrossingForward(RendererGL& rendererGL,
 		}
 	}
 	
-	if (anim1!=nullptr) {
-		++index;
-		while (++it1 != m_arrow.end()) {
-			++index;
-			float t0y = (it1->end() > it1->begin()) ? -1.0 : 1.0;
-			float p0y = (it1->begin()+1)*delta;
-			float p1y = (it1->end()+1)*delta;
-			
-			float px0 = index*0.055-0.0275;
-			float px1 = index*0.055+0.0275;
-			anim1->addArrow(*it1, px0, p0y, px0, p1y, 0.0, t0y, 0.0, -t0y, px1, p0y, px1, p1y, 0.0, t0y, 0.0, -t0y);
-		}
-	}
+	// Les fleches suivantes, de (index+1)*0.055+0.0275, avancent d'une place
+	if (anim1!=nullptr)
+		anim1->shiftArrows((index+1)*0.055, m_arrow.size()*0.055, 0.055);
 }
 
 void ArrowBox::Renderer::spawnArrowAfterCrossingBackward(RendererGL& rendererGL, ArrowBox::ArrowRendererInList it1, ArrowInArrowBox& newArrow, int index,
@@ -303,7 +319,7 @@ void ArrowBox::Renderer::spawnArrowAfterCrossingBackward(RendererGL& rendererGL,
 	
 	m_arrow.splice(it1, m_arrow, it);
 	if (!spawnAfter) {
-		it1 = m_arrow.emplace(it1, rendererGL, newArrow.getArrow(), 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to);
+		it1 = m_arrow.emplace(it1, rendererGL, newArrow.m_arrow, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to, m_translation);
 		newArrow.setArrowRendererInList(it1);
 		
 		if (anim1!=nullptr) {
@@ -326,7 +342,7 @@ void ArrowBox::Renderer::spawnArrowAfterCrossingBackward(RendererGL& rendererGL,
 		
 		it1++;
 	} else {
-		it1 = m_arrow.emplace(it, rendererGL, newArrow.getArrow(), 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to);
+		it1 = m_arrow.emplace(it, rendererGL, newArrow.m_arrow, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, 1e+10, m_layer, from, to, m_translation);
 		newArrow.setArrowRendererInList(it1);
 		
 		if (anim1!=nullptr) {
@@ -349,19 +365,9 @@ void ArrowBox::Renderer::spawnArrowAfterCrossingBackward(RendererGL& rendererGL,
 		it1 = ++it;
 	}
 	
-	if (anim1!=nullptr) {
-		++index;
-		while (++it1 != m_arrow.end()) {
-			++index;
-			float t0y = (it1->end() > it1->begin()) ? -1.0 : 1.0;
-			float p0y = (it1->begin()+1)*delta;
-			float p1y = (it1->end()+1)*delta;
-			
-			float px0 = index*0.055+0.0275;
-			float px1 = (index+1)*0.055+0.0275;
-			anim1->addArrow(*it1, px0, p0y, px0, p1y, 0.0, t0y, 0.0, -t0y, px1, p0y, px1, p1y, 0.0, t0y, 0.0, -t0y);
-		}
-	}
+	// Les fleches suivantes, de (index+2)*0.055+0.0275, avancent d'une place
+	if (anim1!=nullptr)
+		anim1->shiftArrows((index+2)*0.055, m_arrow.size()*0.055, 0.055);
 }
 
 void ArrowBox::Renderer::mergeArrows(RendererGL& rendererGL, ArrowBox::ArrowRendererInList it, int index,
@@ -405,49 +411,23 @@ void ArrowBox::Renderer::mergeArrows(RendererGL& rendererGL, ArrowBox::ArrowRend
 		anim0->addArrow(*it0, px0, p0y, px0, p1y, 0.0, t0y, 0.0, -t0y, px1, p0y, px1, p1y, 0.0, t0y, 0.0, -t0y);
 	}
 	
-	if (anim1!=nullptr || anim0!=nullptr) {
-		while (++it0 != m_arrow.end()) {
-			++index;
-			float t0y = (it0->end() > it0->begin()) ? -1.0 : 1.0;
-			float p0y = (it0->begin()+1)*delta;
-			float p1y = (it0->end()+1)*delta;
-			
-			if (anim1!=nullptr) {
-				float px0 = index*0.055;
-				float px1 = (index-1)*0.055-0.0275;
-				anim1->addArrow(*it0, px0, p0y, px0, p1y, 0.0, t0y, 0.0, -t0y, px1, p0y, px1, p1y, 0.0, t0y, 0.0, -t0y);
-			}
-			if (anim0!=nullptr) {
-				float px0 = index*0.055+0.0275;
-				float px1 = index*0.055;
-				anim0->addArrow(*it0, px0, p0y, px0, p1y, 0.0, t0y, 0.0, -t0y, px1, p0y, px1, p1y, 0.0, t0y, 0.0, -t0y);
-			}
-		}
-	}
+	// Les fleches suivantes, de (index+1)*0.055+0.0275, reculent d'une demi-place puis, une fois les fleches fusionnees retirees,
+	// d'une place et demie
+	if (anim0!=nullptr)
+		anim0->shiftArrows((index+1)*0.055, m_arrow.size()*0.055, -0.0275);
+	if (anim1!=nullptr)
+		anim1->shiftArrows((index+1)*0.055-0.0275, m_arrow.size()*0.055, -0.0825);
 }
 
 void ArrowBox::Renderer::removeArrow(RendererGL& rendererGL, ArrowBox::ArrowRendererInList it, int index,
 		AnimateMoveArrowInArrowBoxCommand* anim0, UpdateArrowBoxLenghtCommand* lenAnim0) {
-	const float delta = 1.0/(m_oneHandle.numberOfTracks()+1);
-	
 	if (lenAnim0!=nullptr) {
 		lenAnim0->setVariation(m_arrow.size()*0.055, m_arrow.size()*0.055-0.055);
 	}
 	
-	if (anim0!=nullptr) {
-		while (++it != m_arrow.end()) {
-			++index;
-			float t0y = (it->end() > it->begin()) ? -1.0 : 1.0;
-			float p0y = (it->begin()+1)*delta;
-			float p1y = (it->end()+1)*delta;
-			
-			if (anim0!=nullptr) {
-				float px0 = index*0.055+0.0275;
-				float px1 = index*0.055-0.0275;
-				anim0->addArrow(*it, px0, p0y, px0, p1y, 0.0, t0y, 0.0, -t0y, px1, p0y, px1, p1y, 0.0, t0y, 0.0, -t0y);
-			}
-		}
-	}
+	// La fleche est retiree avant l'animation: les suivantes reculent d'une place
+	if (anim0!=nullptr)
+		anim0->shiftArrows((index+1)*0.055, m_arrow.size()*0.055, -0.055);
 }
 
 void ArrowBox::Renderer::genCrossing(RendererGL& rendererGL, ArrowBox::ArrowRendererInList arrow, int index, AnimateMoveArrowInArrowBoxCommand* anim,
@@ -561,6 +541,18 @@ void ArrowBox::Renderer::refreshArrows() {
 	}
 }
 
+void ArrowBox::Renderer::getArrowsInRange(float start, float end, std::vector<Arrow::Renderer*>& arrows) {
+	const float localStart = toTranslationX(start);
+	const float localEnd   = toTranslationX(end);
+	
+	arrows.clear();
+	for (auto it=m_arrow.begin(); it!=m_arrow.end(); ++it) {
+		const float x = it->getLocalX();
+		if (it->getAnimation()==0 && x>=localStart && x<localEnd)
+			arrows.push_back(&(*it));
+	}
+}
+
 void ArrowBox::Renderer::refreshLenght() {
 	setLenght(m_arrow.size()*0.055, true);
 }
@@ -581,10 +573,10 @@ std::pair<ArrowBox::ArrowRendererInList, int> ArrowBox::Renderer::pushBackArrow(
 		float p0y = m_basey - (from+1)*delta;
 		float p1y = m_basey - (to+1)*delta;
 		float t0y = (to > from) ? -1.0 : 1.0;
-		m_arrow.emplace_back(rendererGL, newArrow.getArrow(), px, p0y, px, p1y, 0.0, t0y, 0.0, -t0y, m_layer, from, to);
+		m_arrow.emplace_back(rendererGL, newArrow.m_arrow, px, p0y, px, p1y, 0.0, t0y, 0.0, -t0y, m_layer, from, to, m_translation);
 		setLenght(m_arrow.size()*0.055, true);
 	} else
-		m_arrow.emplace_back(rendererGL, newArrow.getArrow(), 1e+10, 1e+10, 1e+10, 1e+10, 0.0, 0.0, 0.0, 0.0, m_layer, from, to);
+		m_arrow.emplace_back(rendererGL, newArrow.m_arrow, 1e+10, 1e+10, 1e+10, 1e+10, 0.0, 0.0, 0.0, 0.0, m_layer, from, to, m_translation);
 	
 	newArrow.setArrowRendererInList(--m_arrow.end());
 	return std::make_pair(--m_arrow.end(), m_arrow.size()-1);
@@ -598,10 +590,12 @@ std::pair<ArrowBox::ArrowRendererInList, int> ArrowBox::Renderer::pushFrontArrow
 		float p0y = m_basey - (from+1)*delta;
 		float p1y = m_basey - (to+1)*delta;
 		float t0y = (to > from) ? -1.0 : 1.0;
-		m_arrow.emplace_front(rendererGL, newArrow.getArrow(), px, p0y, px, p1y, 0.0, t0y, 0.0, -t0y, m_layer, from, to);
+		m_arrow.emplace_front(rendererGL, newArrow.m_arrow, px, p0y, px, p1y, 0.0, t0y, 0.0, -t0y, m_layer, from, to, m_translation);
 		setLenght(m_arrow.size()*0.055, true);
+		// Les autres fleches reculent d'une place
+		refreshArrows();
 	} else
-		m_arrow.emplace_front(rendererGL, newArrow.getArrow(), 1e+10, 1e+10, 1e+10, 1e+10, 0.0, 0.0, 0.0, 0.0, m_layer, from, to);
+		m_arrow.emplace_front(rendererGL, newArrow.m_arrow, 1e+10, 1e+10, 1e+10, 1e+10, 0.0, 0.0, 0.0, 0.0, m_layer, from, to, m_translation);
 	
 	newArrow.setArrowRendererInList(m_arrow.begin());
 	return std::make_pair(m_arrow.begin(), 0);
@@ -610,6 +604,7 @@ std::pair<ArrowBox::ArrowRendererInList, int> ArrowBox::Renderer::pushFrontArrow
 ArrowBox::ArrowRendererInList ArrowBox::Renderer::transferArrowToBack(Renderer& target, ArrowRendererInList arrow, unsigned int targetI, unsigned int targetJ) {
 	ArrowRendererInList ret(arrow); ++ret;
 	arrow->setBeginEnd(targetI, targetJ);
+	arrow->setTranslation(target.m_translation);
 	target.m_arrow.splice(target.m_arrow.end(), m_arrow, arrow);
 	return ret;
 }
@@ -664,21 +659,137 @@ bool ArrowBox::ArrowInArrowBoxIndexedIterator::operator==(const ArrowBox::ArrowI
 }
 
 ArrowBox::ArrowInArrowBoxIndexedIterator ArrowBox::ArrowInArrowBoxIndexedIterator::eraseFromArrowBox(ArrowBox& arrowBox) {
+	arrowBox.unindexArrow(*m_it);
 	return ArrowInArrowBoxIndexedIterator(arrowBox.m_arrows.erase(m_it), m_index);
 }
 
 ArrowBox::ArrowInArrowBoxIndexedIterator ArrowBox::ArrowInArrowBoxIndexedIterator::insertInArrowBox(ArrowBox::ArrowInArrowBox* arrow, ArrowBox& arrowBox) {
-	auto it0 = arrowBox.m_arrows.insert(m_it, arrow);
+	auto it0 = arrowBox.m_arrows.insert(m_it, arrowBox.adoptArrow(arrow));
+	arrowBox.indexInsertedArrow(it0);
 	return ArrowBox::ArrowInArrowBoxIndexedIterator(it0, m_index++);
 }
 
 void ArrowBox::ArrowInArrowBoxIndexedIterator::transfer(ArrowBox::ArrowInArrowBoxIndexedIterator& other, ArrowBox& arrowBox) {
 	if (*this==other) {assert(false);}
+	arrowBox.unindexArrow(*m_it);
 	arrowBox.m_arrows.splice(other.m_it, arrowBox.m_arrows, m_it);
+	arrowBox.indexInsertedArrow(m_it);
 	assert(other.m_index > m_index);
 	m_index = other.m_index-1;
 }
 
+void ArrowBox::buildLenghtIndex() {
+	for (auto it=m_lenghtIndex.begin(); it!=m_lenghtIndex.end(); ++it) {
+		it->clear();
+	}
+	for (auto it=m_trackIndex.begin(); it!=m_trackIndex.end(); ++it) {
+		it->clear();
+	}
+	m_positions.clear();
+	
+	// On espace les positions au maximum pour retarder la prochaine reconstruction
+	const unsigned long long gap = std::numeric_limits<unsigned long long>::max()/(m_arrows.size()+1);
+	unsigned long long order = 0;
+	for (auto it=m_arrows.begin(); it!=m_arrows.end(); ++it) {
+		order += gap;
+		(*it)->m_order = order;
+		(*it)->m_inList = it;
+		m_positions.insertBefore(&(*it)->m_position, nullptr);
+		
+		Arrow arrow = (*it)->getArrow();
+		getLenghtIndex(arrow).emplace_hint(getLenghtIndex(arrow).end(), order, *it);
+		m_trackIndex[arrow.begin()].emplace_hint(m_trackIndex[arrow.begin()].end(), order, *it);
+		m_trackIndex[arrow.end()].emplace_hint(m_trackIndex[arrow.end()].end(), order, *it);
+	}
+	
+	m_lenghtIndexValid = true;
+}
+
+void ArrowBox::indexArrowTracks(ArrowInArrowBox* arrow) {
+	Arrow tracks = arrow->getArrow();
+	getLenghtIndex(tracks).emplace(arrow->m_order, arrow);
+	m_trackIndex[tracks.begin()].emplace(arrow->m_order, arrow);
+	m_trackIndex[tracks.end()].emplace(arrow->m_order, arrow);
+}
+
+void ArrowBox::unindexArrowTracks(ArrowInArrowBox* arrow) {
+	Arrow tracks = arrow->getArrow();
+	getLenghtIndex(tracks).erase(arrow->m_order);
+	m_trackIndex[tracks.begin()].erase(arrow->m_order);
+	m_trackIndex[tracks.end()].erase(arrow->m_order);
+}
+
+void ArrowBox::unindexArrow(ArrowInArrowBox* arrow) {
+	if (!m_lenghtIndexValid) return;
+	
+	unindexArrowTracks(arrow);
+	m_positions.erase(&arrow->m_position);
+}
+
+void ArrowBox::getArrowsOnTracks(const std::vector<unsigned int>& tracks, unsigned long long order, std::vector<ArrowInArrowBox*>& arrows) {
+	for (auto track=tracks.begin(); track!=tracks.end(); ++track) {
+		const std::map<unsigned long long, ArrowInArrowBox*>& index = m_trackIndex[*track];
+		for (auto it=index.upper_bound(order); it!=index.end(); ++it)
+			arrows.push_back(it->second);
+	}
+	
+	std::sort(arrows.begin(), arrows.end());
+	arrows.erase(std::unique(arrows.begin(), arrows.end()), arrows.end());
+}
+
+void ArrowBox::indexInsertedArrow(std::list<ArrowInArrowBox*>::iterator it) {
+	if (!m_lenghtIndexValid) return;
+	
+	unsigned long long low  = 0;
+	unsigned long long high = std::numeric_limits<unsigned long long>::max();
+	if (it!=m_arrows.begin()) {
+		auto prev = it; --prev;
+		low = (*prev)->m_order;
+	}
+	auto next = it; ++next;
+	if (next!=m_arrows.end()) {
+		high = (*next)->m_order;
+	}
+	
+	if (high-low < 2) { // Plus de place entre les voisins
+		invalidateLenghtIndex();
+	} else {
+		(*it)->m_order = low + (high-low)/2;
+		(*it)->m_inList = it;
+		m_positions.insertBefore(&(*it)->m_position, (next!=m_arrows.end()) ? &(*next)->m_position : nullptr);
+		indexArrowTracks(*it);
+	}
+}
+
+bool ArrowBox::findLemma29Candidate(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& it, unsigned int maxLenght, bool strict) {
+	if (maxLenght>=m_numberOfTracks) { // Aucune fleche n'est aussi longue
+		if (strict) return false;
+		maxLenght = m_numberOfTracks-1;
+	}
+	if (!m_lenghtIndexValid) buildLenghtIndex();
+	
+	bool isUp = (*begin)->getArrow().isUp();
+	unsigned long long beginOrder = (*begin)->m_order;
+	unsigned long long endOrder   = (it.getIterator()==m_arrows.end()) ? std::numeric_limits<unsigned long long>::max() : (*it)->m_order;
+	
+	ArrowInArrowBox* candidate = nullptr;
+	for (unsigned int lenght=maxLenght; lenght>0 && candidate==nullptr; --lenght) {
+		std::map<unsigned long long, ArrowInArrowBox*>& index = m_lenghtIndex[(isUp ? m_numberOfTracks : 0) + lenght];
+		auto found = index.lower_bound(endOrder);
+		if (found!=index.begin() && (--found)->first >= beginOrder) {
+			candidate = found->second;
+		}
+		
+		if (strict) break;
+	}
+	
+	if (candidate==nullptr) return false;
+	
+	it = ArrowInArrowBoxIndexedIterator(candidate->m_inList, m_positions.rank(&candidate->m_position));
+	assert(it>=begin);
+	return true;
+}
+
 void ArrowBox::removeDepthMArrows(const OneHandle& oneHandle, const ZeroHandle& zeroHandle, int m, bool to) {
 	assert(m>0);
 	
@@ -688,9 +799,10 @@ void ArrowBox::removeDepthMArrows(const OneHandle& oneHandle, const ZeroHandle&
 		int depth = oneHandle.getArrowDepth(*this, zeroHandle, std::make_pair(arrow.begin(), arrow.end()), to);
 		assert(std::abs(depth)>=m && depth!=(-m));
 		
-		if (depth==m)
+		if (depth==m) {
 			it = removeArrow(it);
-		else
+			statistics().count(Statistics::DEPTH_REMOVALS);
+		} else
 			++it;
 	}
 }
@@ -714,206 +826,407 @@ unsigned int ArrowBox::getMinimalDepth(const OneHandle& oneHandle, const ZeroHan
 	return depth;
 }
 
+// Deux fleches (i,j) et (k,l) commutent si j!=k et l!=i, et deux fleches identiques adjacentes s'annulent.
+// On annule donc chaque fleche avec la derniere occurrence restante de la meme fleche, si aucune fleche restante
+// entre les deux ne finit a sa voie de depart ou ne commence a sa voie d'arrivee.
+void ArrowBox::reduceCommutingPairs(std::list<Arrow>& arrows) const {
+	std::unordered_map<unsigned int, std::vector<std::pair<size_t, std::list<Arrow>::iterator>>> sameArrows;
+	std::vector<std::set<size_t>> beginsAt(m_numberOfTracks);
+	std::vector<std::set<size_t>> endsAt(m_numberOfTracks);
+	size_t pos = 0;
+	
+	auto it = arrows.begin();
+	while (it!=arrows.end()) {
+		unsigned int i = it->begin();
+		unsigned int j = it->end();
+		auto& same = sameArrows[i*m_numberOfTracks+j];
+		
+		if (!same.empty() && (endsAt[i].empty() || *endsAt[i].rbegin()<same.back().first) &&
+				(beginsAt[j].empty() || *beginsAt[j].rbegin()<same.back().first)) {
+			beginsAt[i].erase(same.back().first);
+			endsAt[j].erase(same.back().first);
+			arrows.erase(same.back().second);
+			same.pop_back();
+			it = arrows.erase(it);
+		} else {
+			same.emplace_back(pos, it);
+			beginsAt[i].insert(pos);
+			endsAt[j].insert(pos);
+			++it;
+		}
+		++pos;
+	}
+}
+
 ArrowBox::ArrowInArrowBoxIndexedIterator ArrowBox::removeArrow(ArrowInArrowBoxIndexedIterator arrow) {
 	postRemoveArrowFromArrowBoxCommand(*this, makeArrowInArrowBoxIndexed(arrow));
 	return arrow.eraseFromArrowBox(*this);
 }
 
-void ArrowBox::lemma29MovePastArrow(ArrowInArrowBox& movingArrow, unsigned int& movingIndex, ArrowInArrowBoxIndexedIterator& arrow,
-		ArrowInArrowBoxIndexedIterator* last, ArrowInArrowBoxIndexedIterator& end) {
-	unsigned int moving_begin = movingArrow.getArrow().begin();
-	unsigned int moving_end   = movingArrow.getArrow().end();
-	unsigned int arrow_begin = (*arrow)->getArrow().begin();
-	unsigned int arrow_end   = (*arrow)->getArrow().end();
-	
-	unsigned int create_begin;
-	unsigned int create_end;
-	bool shouldCreateArrow = false;
+// Les lemmes 29 sont executes comme une machine a etats avec une pile explicite de cadres alloues sur le tas,
+// pour ne pas depasser la pile du thread de travail sur de longs mots de fleches. Chaque cadre correspond a un
+// appel de l'ancienne version recursive et reprend son execution a l'etat ou il a ete interrompu.
+class ArrowBox::Lemma29Frame {
+public:
+	virtual ~Lemma29Frame() {}
+	
+	// Retourne vrai si le cadre a termine, faux s'il a empile un sous-cadre ou doit etre repris
+	virtual bool step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack) = 0;
+};
+
+class ArrowBox::DoLemma29Frame : public ArrowBox::Lemma29Frame {
+	enum State {START, MOVE_PAST, FINISH_MOVE};
+	
+	ArrowInArrowBoxIndexedIterator& m_begin;
+	ArrowInArrowBoxIndexedIterator m_it;
+	unsigned int m_k;
+	bool m_shouldGoDeeper;
+	bool m_strictK;
+	ArrowInArrowBoxIndexedIterator& m_end;
+	ArrowInArrowBoxIndexedIterator* m_last;
+	
+	State m_state = START;
+	ArrowInArrowBoxIndexedIterator m_candidate;
+	unsigned int m_maxLenght = 0;
+	ArrowInArrowBox* m_candidateArrow = nullptr;
+	unsigned int m_candidateIndex = 0;
+	
+	// Equivalent de l'appel recursif final de doLemma29
+	void goDeeper(ArrowInArrowBoxIndexedIterator checkStart, unsigned int k, bool strictK) {
+		m_it = checkStart;
+		m_k = k;
+		m_strictK = strictK;
+		m_last = nullptr;
+		m_state = START;
+	}
 	
-	if (moving_end==arrow_begin) {
-		shouldCreateArrow = true;
-		create_begin = moving_begin;
-		create_end   = arrow_end;
-	} else if (arrow_end==moving_begin) {
-		shouldCreateArrow = true;
-		create_begin = arrow_begin;
-		create_end   = moving_end;
+public:
+	DoLemma29Frame(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator checkStart, unsigned int k, bool shouldGoDeeper,
+			bool strictK, ArrowInArrowBoxIndexedIterator& end, ArrowInArrowBoxIndexedIterator* last) :
+		m_begin(begin), m_it(checkStart), m_k(k), m_shouldGoDeeper(shouldGoDeeper), m_strictK(strictK), m_end(end), m_last(last) {}
+	
+	bool step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack);
+};
+
+class ArrowBox::MovePastArrowFrame : public ArrowBox::Lemma29Frame {
+	enum State {START, REMOVE_SAME_ARROWS, FINISH};
+	
+	ArrowInArrowBox& m_movingArrow;
+	unsigned int& m_movingIndex;
+	ArrowInArrowBoxIndexedIterator& m_arrow;
+	ArrowInArrowBoxIndexedIterator* m_last;
+	ArrowInArrowBoxIndexedIterator& m_end;
+	
+	State m_state = START;
+	ArrowInArrowBoxIndexedIterator* m_newLast = nullptr;
+	
+public:
+	MovePastArrowFrame(ArrowInArrowBox& movingArrow, unsigned int& movingIndex, ArrowInArrowBoxIndexedIterator& arrow,
+			ArrowInArrowBoxIndexedIterator* last, ArrowInArrowBoxIndexedIterator& end) :
+		m_movingArrow(movingArrow), m_movingIndex(movingIndex), m_arrow(arrow), m_last(last), m_end(end) {}
+	
+	bool step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack);
+};
+
+class ArrowBox::RemoveSameArrowsFrame : public ArrowBox::Lemma29Frame {
+	enum State {START, NEXT_TARGET, SEARCH_SAME, MOVE_PAST, MERGE};
+	
+	ArrowInArrowBoxIndexedIterator* m_begin;
+	ArrowInArrowBoxIndexedIterator& m_end;
+	ArrowInArrowBoxIndexedIterator m_tailBegin; // Debut de l'appel recursif final quand il ne reutilise pas begin
+	
+	State m_state = START;
+	ArrowInArrowBoxIndexedIterator m_itTarget;
+	ArrowInArrowBoxIndexedIterator m_last;
+	unsigned int m_itTargetBegin = 0;
+	unsigned int m_itTargetEnd = 0;
+	ArrowInArrowBoxIndexedIterator m_it;
+	ArrowInArrowBoxIndexedIterator m_it0;
+	ArrowInArrowBox* m_itArrow = nullptr;
+	unsigned int m_itIndex = 0;
+	
+	void restartFrom(ArrowInArrowBoxIndexedIterator& begin) {
+		if (&begin!=m_begin) {
+			m_tailBegin = begin;
+			m_begin = &m_tailBegin;
+		}
+		m_state = START;
 	}
 	
-	if (shouldCreateArrow) {
-		ArrowInArrowBoxIndexedIterator* newLast = (last==nullptr) ? nullptr : (*last>arrow) ? last : nullptr;
-		ArrowInArrowBoxIndexedIterator it1(arrow);
+public:
+	RemoveSameArrowsFrame(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& end) : m_begin(&begin), m_end(end) {}
+	
+	bool step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack);
+};
+
+void ArrowBox::runLemma29(Lemma29Frame* frame) {
+	std::vector<Lemma29Frame*> stack;
+	stack.push_back(frame);
+	
+	try {
+		while (!stack.empty()) {
+			cancellationPoint();
+			
+			Lemma29Frame* top = stack.back();
+			if (top->step(*this, stack)) {
+				assert(stack.back()==top);
+				stack.pop_back();
+				delete top;
+			}
+		}
+	} catch (const WorkCancelled&) {
+		for (Lemma29Frame* remaining : stack)
+			delete remaining;
+		throw;
+	}
+}
+
+bool ArrowBox::DoLemma29Frame::step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack) {
+	for (;;) {
+		switch (m_state) {
+		case START:
+			if (m_k>=arrowBox.m_numberOfTracks || m_begin==m_end) return true;
+			
+			m_maxLenght = 0;
+			if (arrowBox.findLemma29Candidate(m_begin, m_it, arrowBox.m_numberOfTracks-m_k, m_strictK)) {
+				m_maxLenght = (*m_it)->getArrow().lenght();
+				m_candidate = m_it;
+			}
+			
+			if (m_maxLenght) {  // Si on a trouver une fleche a bouger
+				m_k = arrowBox.m_numberOfTracks-m_maxLenght;
+				m_it = m_candidate;
+				
+				m_candidateArrow = *m_candidate;
+				m_candidateIndex = m_candidate.getPos();
+				m_state = MOVE_PAST;
+			} else if (m_strictK && m_shouldGoDeeper) {
+				goDeeper(m_end, m_k+1, false);
+			} else {
+				return true;
+			}
+			break;
+			
+		case MOVE_PAST:
+			if (++m_it != m_end && (*m_it)->getArrow().lenght()<m_maxLenght) {
+				stack.push_back(new MovePastArrowFrame(*m_candidateArrow, m_candidateIndex, m_it, m_last, m_end));
+				return false;
+			}
+			m_state = FINISH_MOVE;
+			break;
+			
+		case FINISH_MOVE: {
+			ArrowInArrowBox& candidateArrow = *m_candidateArrow;
+			ArrowInArrowBoxIndexedIterator& it(m_it);
+			ArrowInArrowBoxIndexedIterator newCheckBegin(m_candidate);
+			if (it==m_end || candidateArrow.getArrow().begin()!=(*it)->getArrow().begin() || 
+					candidateArrow.getArrow().end()!=(*it)->getArrow().end()) {
+				postMoveArrowInArrowBox(arrowBox, makeArrowInArrowBoxIndexed(candidateArrow, m_candidateIndex), makeArrowInArrowBoxIndexed(--it));
+				it++;
+				
+				if (m_begin==m_candidate) { // Si candidate==begin, begin doit pointer a la fleche suivante
+					++m_begin;
+					if (m_begin!=it) m_begin.decIndex();
+					else --m_begin;
+				}
+				
+				// candidate==newCheckBegin, donc newCheckBegin doit pointer a la fleche suivante
+				++newCheckBegin;
+				if (newCheckBegin!=it) newCheckBegin.decIndex();
+				else --newCheckBegin;
+				
+				m_candidate.transfer(it, arrowBox);
+			} else {
+				postMoveMergeArrowsCommand(arrowBox, makeArrowInArrowBoxIndexed(candidateArrow, m_candidateIndex), makeArrowInArrowBoxIndexed(it));
+				statistics().count(Statistics::MERGES);
+				
+				if (m_begin==m_candidate) {
+					++m_begin;
+					if (m_begin==it) {
+						++m_begin;
+						m_begin.decIndex();
+					}
+					m_begin.decIndex();
+				}
+				
+				++newCheckBegin;
+				if (newCheckBegin==it) {
+					newCheckBegin++;
+					newCheckBegin.decIndex();
+				}
+				newCheckBegin.decIndex();
+				
+				it.eraseFromArrowBox(arrowBox);
+				m_candidate.eraseFromArrowBox(arrowBox);
+				m_end.decIndex(); m_end.decIndex();
+			}
+			
+			if (!m_shouldGoDeeper) return true;
+			
+			if (newCheckBegin!=m_begin) {
+				goDeeper(newCheckBegin, m_k, true);
+			} else {
+				goDeeper(m_end, m_k+1, false);
+			}
+			break;
+		}
+		}
+	}
+}
+
+bool ArrowBox::MovePastArrowFrame::step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack) {
+	switch (m_state) {
+	case START: {
+		unsigned int moving_begin = m_movingArrow.getArrow().begin();
+		unsigned int moving_end   = m_movingArrow.getArrow().end();
+		unsigned int arrow_begin = (*m_arrow)->getArrow().begin();
+		unsigned int arrow_end   = (*m_arrow)->getArrow().end();
+		
+		unsigned int create_begin;
+		unsigned int create_end;
+		
+		if (moving_end==arrow_begin) {
+			create_begin = moving_begin;
+			create_end   = arrow_end;
+		} else if (arrow_end==moving_begin) {
+			create_begin = arrow_begin;
+			create_end   = moving_end;
+		} else {
+			return true;
+		}
+		
+		m_newLast = (m_last==nullptr) ? nullptr : (*m_last>m_arrow) ? m_last : nullptr;
+		ArrowInArrowBoxIndexedIterator it1(m_arrow);
 		++it1;
-		it1 = it1.insertInArrowBox(new ArrowInArrowBox(Arrow(create_begin, create_end), ArrowRendererInList()), *this);
-		postGenArrowAfterMoveCrossing(*this, makeArrowInArrowBoxIndexed(movingArrow, movingIndex), makeArrowInArrowBoxIndexed(arrow), **it1,
+		it1 = it1.insertInArrowBox(new ArrowInArrowBox(Arrow(create_begin, create_end), ArrowRendererInList()), arrowBox);
+		postGenArrowAfterMoveCrossing(arrowBox, makeArrowInArrowBoxIndexed(m_movingArrow, m_movingIndex), makeArrowInArrowBoxIndexed(m_arrow), **it1,
 				create_begin, create_end, true);
+		statistics().count(Statistics::ARROWS_GENERATED);
 		
-		movingIndex = arrow.getPos();
-		arrow = it1;
-		if (newLast!=nullptr) newLast->incIndex();
-		end.incIndex();
-		doLemma29(arrow, ++it1, 0, false, false, end, newLast);
-		if (newLast!=nullptr) {
-			newLast->decIndex();
-			lemma29RemoveSameArrows(++(*newLast), end);
-			--(*newLast);
+		m_movingIndex = m_arrow.getPos();
+		m_arrow = it1;
+		if (m_newLast!=nullptr) m_newLast->incIndex();
+		m_end.incIndex();
+		m_state = REMOVE_SAME_ARROWS;
+		stack.push_back(new DoLemma29Frame(m_arrow, ++it1, 0, false, false, m_end, m_newLast));
+		return false;
+	}
+	
+	case REMOVE_SAME_ARROWS:
+		m_state = FINISH;
+		if (m_newLast!=nullptr) {
+			m_newLast->decIndex();
+			stack.push_back(new RemoveSameArrowsFrame(++(*m_newLast), m_end));
 		} else {
-			lemma29RemoveSameArrows(arrow, end);
+			stack.push_back(new RemoveSameArrowsFrame(m_arrow, m_end));
 		}
-		--arrow;
+		return false;
+		
+	case FINISH:
+		if (m_newLast!=nullptr) --(*m_newLast);
+		--m_arrow;
+		return true;
 	}
+	
+	assert(false);
+	return true;
 }
 
-void ArrowBox::doLemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator checkStart,
-					unsigned int k, bool shouldGoDeeper, bool strictK, ArrowInArrowBoxIndexedIterator& end, ArrowInArrowBoxIndexedIterator* last) {
-	if (k>=m_numberOfTracks) return;
-	
-	ArrowInArrowBoxIndexedIterator& it(checkStart);
-	ArrowInArrowBoxIndexedIterator candidate;
-	unsigned int max_lenght = 0;
-	
-#ifndef NDEBUG
-	bool isUp = (*begin)->getArrow().isUp();
-#endif
-	
-	do {
-		--it;
-		assert((*it)->getArrow().isUp()==isUp);
-		
-		unsigned int lenght = (*it)->getArrow().lenght();
-		if (lenght > max_lenght && ((strictK) ? lenght==m_numberOfTracks-k : lenght <= m_numberOfTracks-k)) {
-			max_lenght = lenght;
-			candidate = it;
-			if (max_lenght==m_numberOfTracks-k) break;
-		}
-	} while (it!=begin);
-	
-	if (max_lenght) {  // Si on a trouver une fleche a bouger
-		k = m_numberOfTracks-max_lenght;
-		it = candidate;
+bool ArrowBox::RemoveSameArrowsFrame::step(ArrowBox& arrowBox, std::vector<Lemma29Frame*>& stack) {
+	for (;;) {
+		ArrowInArrowBoxIndexedIterator& begin = *m_begin;
 		
-		ArrowInArrowBox& candidateArrow = **candidate;
-		unsigned int candidateIndex = candidate.getPos();
-		while (++it != end && (*it)->getArrow().lenght()<max_lenght) {
-			lemma29MovePastArrow(candidateArrow, candidateIndex, it, last, end);
+		switch (m_state) {
+		case START: {
+			if (begin==m_end) return true;
+			
+			m_itTarget = begin;
+			unsigned int beginLenght = (*begin)->getArrow().lenght();
+			
+			while (++m_itTarget!=m_end && (*m_itTarget)->getArrow().lenght()==beginLenght);
+			m_last = m_itTarget; --m_last;
+			m_state = NEXT_TARGET;
+			break;
 		}
 		
-		ArrowInArrowBoxIndexedIterator newCheckBegin(candidate);
-		if (it==end || candidateArrow.getArrow().begin()!=(*it)->getArrow().begin() || 
-				candidateArrow.getArrow().end()!=(*it)->getArrow().end()) {
-			postMoveArrowInArrowBox(*this, makeArrowInArrowBoxIndexed(candidateArrow, candidateIndex), makeArrowInArrowBoxIndexed(--it));
-			it++;
-			
-			if (begin==candidate) { // Si candidate==begin, begin doit pointer a la fleche suivante
-				++begin;
-				if (begin!=it) begin.decIndex();
-				else --begin;
+		case NEXT_TARGET:
+			if (--m_itTarget==begin) {
+				restartFrom(++m_last);
+				break;
 			}
 			
-			// candidate==newCheckBegin, donc newCheckBegin doit pointer a la fleche suivante
-			++newCheckBegin;
-			if (newCheckBegin!=it) newCheckBegin.decIndex();
-			else --newCheckBegin;
+			m_itTargetBegin = (*m_itTarget)->getArrow().begin();
+			m_itTargetEnd   = (*m_itTarget)->getArrow().end();
+			m_it = m_itTarget;
+			m_state = SEARCH_SAME;
+			break;
 			
-			candidate.transfer(it, *this);
-		} else {
-			postMoveMergeArrowsCommand(*this, makeArrowInArrowBoxIndexed(candidateArrow, candidateIndex), makeArrowInArrowBoxIndexed(it));
+		case SEARCH_SAME:
+			--m_it;
+			if ((*m_it)->getArrow().begin()==m_itTargetBegin && (*m_it)->getArrow().end()==m_itTargetEnd) {
+				m_it0 = m_it;
+				m_itArrow = *m_it;
+				m_itIndex = m_it.getPos();
+				m_state = MOVE_PAST;
+			} else if (m_it==begin) {
+				m_state = NEXT_TARGET;
+			}
+			break;
 			
-			if (begin==candidate) {
+		case MOVE_PAST:
+			if (++m_it0 != m_itTarget) {
+				stack.push_back(new MovePastArrowFrame(*m_itArrow, m_itIndex, m_it0, &m_last, m_end));
+				return false;
+			}
+			m_state = MERGE;
+			break;
+			
+		case MERGE:
+			postMoveMergeArrowsCommand(arrowBox, makeArrowInArrowBoxIndexed(*m_itArrow, m_itIndex), makeArrowInArrowBoxIndexed(m_itTarget));
+			statistics().count(Statistics::MERGES);
+			if (m_it==begin) {
 				++begin;
-				if (begin==it) {
+				if (begin==m_itTarget) {
 					++begin;
 					begin.decIndex();
 				}
 				begin.decIndex();
 			}
 			
-			++newCheckBegin;
-			if (newCheckBegin==it) {
-				newCheckBegin++;
-				newCheckBegin.decIndex();
-			}
-			newCheckBegin.decIndex();
+			++m_last;
+			m_it0 = m_itTarget; ++m_it0; m_it0.decIndex(); m_it0.decIndex();
+			m_itTarget.eraseFromArrowBox(arrowBox);
+			m_it.eraseFromArrowBox(arrowBox);
+			m_itTarget = m_it0;
+			m_last.decIndex(); m_last.decIndex();
+			m_end.decIndex(); m_end.decIndex();
 			
-			it.eraseFromArrowBox(*this);
-			candidate.eraseFromArrowBox(*this);
-			end.decIndex(); end.decIndex();
-		}
-		
-		if (shouldGoDeeper) {
-			if (newCheckBegin!=begin) {
-				doLemma29(begin, newCheckBegin, k, true, true, end);
+			if (begin==m_itTarget) {
+				if (begin==m_last)
+					restartFrom(begin);
+				else
+					restartFrom(m_last);
 			} else {
-				doLemma29(begin, end, k+1, true, false, end);
+				--m_last;
+				m_state = NEXT_TARGET;
 			}
+			break;
 		}
-	} else if (strictK && shouldGoDeeper) {
-		doLemma29(begin,end, k+1, true, false, end);
 	}
 }
 
+void ArrowBox::doLemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator checkStart,
+					unsigned int k, bool shouldGoDeeper, bool strictK, ArrowInArrowBoxIndexedIterator& end, ArrowInArrowBoxIndexedIterator* last) {
+	runLemma29(new DoLemma29Frame(begin, checkStart, k, shouldGoDeeper, strictK, end, last));
+}
+
 void ArrowBox::lemma29RemoveSameArrows(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& end) {
-	if (begin==end) return;
-	
-	ArrowInArrowBoxIndexedIterator itTarget(begin);
-	unsigned int beginLenght = (*begin)->getArrow().lenght();
-	
-	while (++itTarget!=end && (*itTarget)->getArrow().lenght()==beginLenght);
-	ArrowInArrowBoxIndexedIterator last(itTarget); --last;
-	
-	while (--itTarget!=begin) {
-		unsigned int itTargetBegin = (*itTarget)->getArrow().begin();
-		unsigned int itTargetEnd   = (*itTarget)->getArrow().end();
-		ArrowBox::ArrowInArrowBoxIndexedIterator it(itTarget);
-		
-		do {
-			--it;
-			if ((*it)->getArrow().begin()==itTargetBegin && (*it)->getArrow().end()==itTargetEnd) {
-				ArrowInArrowBoxIndexedIterator it0(it);
-				ArrowInArrowBox& itArrow = **it;
-				unsigned int itIndex = it.getPos();
-				
-				while (++it0 != itTarget) {
-					lemma29MovePastArrow(itArrow, itIndex, it0, &last, end);
-				}
-				
-				postMoveMergeArrowsCommand(*this, makeArrowInArrowBoxIndexed(itArrow, itIndex), makeArrowInArrowBoxIndexed(itTarget));
-				if (it==begin) {
-					++begin;
-					if (begin==itTarget) {
-						++begin;
-						begin.decIndex();
-					}
-					begin.decIndex();
-				}
-				
-				++last;
-				it0 = itTarget; ++it0; it0.decIndex(); it0.decIndex();
-				itTarget.eraseFromArrowBox(*this);
-				it.eraseFromArrowBox(*this);
-				itTarget = it0;
-				last.decIndex(); last.decIndex();
-				end.decIndex(); end.decIndex();
-				
-				if (begin==itTarget) {
-					if (begin==last)
-						lemma29RemoveSameArrows(begin, end);
-					else
-						lemma29RemoveSameArrows(last, end);
-					
-					return;
-				} else {
-					--last;
-					break;
-				}
-			}
-		} while (it!=begin);
-	}
-	
-	lemma29RemoveSameArrows(++last, end);
+	runLemma29(new RemoveSameArrowsFrame(begin, end));
 }
 
 void ArrowBox::lemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& end, ArrowInArrowBoxIndexedIterator* checkStart) {
+	Statistics::LemmaScope scope(Statistics::LEMMA_29);
+	
 	if (begin!=end) {
 		if (checkStart==nullptr)
 			doLemma29(begin, end, 0, true, false, end);
@@ -923,9 +1236,9 @@ void ArrowBox::lemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxInd
 		// On verifie si le lemme a fonctionne
 #ifndef NDEBUG
 		ArrowInArrowBoxIndexedIterator it(begin);
-		bool isUp = (*it)->getArrow().isUp();
-		unsigned int lenght = (*it)->getArrow().lenght();
-		while (++it != end) {
+		bool isUp = (begin!=end) && (*it)->getArrow().isUp();
+		unsigned int lenght = (begin!=end) ? (*it)->getArrow().lenght() : 0;
+		while (it != end && ++it != end) {
 			assert((*it)->getArrow().isUp() == isUp);
 			assert((*it)->getArrow().lenght() >= lenght);
 			lenght = (*it)->getArrow().lenght();
@@ -937,9 +1250,9 @@ void ArrowBox::lemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxInd
 		// On verifie si le lemme a fonctionne
 #ifndef NDEBUG
 		it = begin;
-		isUp = (*it)->getArrow().isUp();
-		lenght = (*it)->getArrow().lenght();
-		while (++it != end) {
+		isUp = (begin!=end) && (*it)->getArrow().isUp();
+		lenght = (begin!=end) ? (*it)->getArrow().lenght() : 0;
+		while (it != end && ++it != end) {
 			assert((*it)->getArrow().isUp() == isUp);
 			assert((*it)->getArrow().lenght() >= lenght);
 			lenght = (*it)->getArrow().lenght();
@@ -949,10 +1262,24 @@ void ArrowBox::lemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxInd
 }
 
 void ArrowBox::permuteTracks(const Permutation& permutation) {
-	for (auto it=m_arrows.begin(); it!=m_arrows.end(); ++it) {
-		Arrow& arrow = (*it)->getArrow();
-		arrow = Arrow(permutation[arrow.begin()], permutation[arrow.end()]);
+	BiPermutation relabel = m_relabel + BiPermutation(permutation);
+	
+	// Seules les fleches des voies deplacees changent de longueur
+	std::vector<ArrowInArrowBox*> changed;
+	if (m_lenghtIndexValid) {
+		std::vector<unsigned int> tracks;
+		for (unsigned int i=0; i<m_numberOfTracks; i++) {
+			if (relabel.post(m_relabel.pre(i))!=i) tracks.push_back(i);
+		}
+		
+		getArrowsOnTracks(tracks, 0, changed);
+		for (auto it=changed.begin(); it!=changed.end(); ++it)
+			unindexArrowTracks(*it);
 	}
+	
+	m_relabel = std::move(relabel);
+	for (auto it=changed.begin(); it!=changed.end(); ++it)
+		indexArrowTracks(*it);
 }
 
 void ArrowBox::fillArrowsRendererLists(std::list<std::pair<unsigned int, unsigned int>>& arrowsData, std::list<ArrowInArrowBox*>& arrows) {
@@ -962,6 +1289,14 @@ void ArrowBox::fillArrowsRendererLists(std::list<std::pair<unsigned int, unsigne
 	}
 }
 
+std::list<Arrow> ArrowBox::getArrows() const {
+	std::list<Arrow> ret;
+	for (auto it=m_arrows.begin(); it!=m_arrows.end(); it++) {
+		ret.push_back((*it)->getArrow());
+	}
+	return ret;
+}
+
 void ArrowBox::moveArrowsThroughoutZeroHandle(ZeroHandle& zeroHandle, OneHandle& oneHandle, bool fromEnd) {
 	if (!m_arrows.empty()) {
 		PassArrowsThroughtZeroHandleCommand* cmd = PassArrowsThroughtZeroHandleCommand::create(*this);
@@ -981,8 +1316,15 @@ void ArrowBox::moveArrowsThroughoutZeroHandle(ZeroHandle& zeroHandle, OneHandle&
 	}
 }
 
+static Arrow swapArrowTracks(const Arrow& arrow, unsigned int i, unsigned int j) {
+	unsigned int begin = (arrow.begin()==i) ? j : (arrow.begin()==j) ? i : arrow.begin();
+	unsigned int end   = (arrow.end()==i)   ? j : (arrow.end()==j)   ? i : arrow.end();
+	return Arrow(begin, end);
+}
+
 void ArrowBox::removeArrowGenCrossing(ArrowInArrowBoxIndexedIterator arrow, ArrowInArrowBoxIndexedIterator& crossingPos, PermutationBox& permutationBox) {
 	assert(crossingPos.getPos() > arrow.getPos());
+	statistics().count(Statistics::CROSSINGS);
 	
 	unsigned int begin = (*arrow)->getArrow().begin();
 	unsigned int end   = (*arrow)->getArrow().end();
@@ -990,26 +1332,42 @@ void ArrowBox::removeArrowGenCrossing(ArrowInArrowBoxIndexedIterator arrow, Arro
 	assert((*crossingPos)->getArrow().end() == begin);
 	assert((*crossingPos)->getArrow().begin() == end);
 	
+	ArrowInArrowBox& movingArrow = **arrow;
+	unsigned int movingIndex = arrow.getPos();
 	arrow.eraseFromArrowBox(*this);
-	ArrowInArrowBoxIndexedIterator it(crossingPos);
-	it.decIndex();
-	while (++it != ArrowInArrowBoxIndexedIterator::fromEndOfBox(*this)) {
-		if (((*it)->getArrow().begin() == begin && (*it)->getArrow().end() == end) ||
-				((*it)->getArrow().begin() == end && (*it)->getArrow().end() == begin))
-			(*it)->getArrow() = Arrow((*it)->getArrow().end(), (*it)->getArrow().begin());
-		else if ((*it)->getArrow().begin() == begin)
-			(*it)->getArrow() = Arrow(end, (*it)->getArrow().end());
-		else if ((*it)->getArrow().begin() == end)
-			(*it)->getArrow() = Arrow(begin, (*it)->getArrow().end());
-		else if ((*it)->getArrow().end() == begin)
-			(*it)->getArrow() = Arrow((*it)->getArrow().begin(), end);
-		else if ((*it)->getArrow().end() == end)
-			(*it)->getArrow() = Arrow((*it)->getArrow().begin(), begin);
+	size_t crossingIndex = crossingPos.getPos()-1;
+	
+	// Seules les fleches apres le croisement qui touchent les voies begin ou end changent de longueur
+	std::vector<ArrowInArrowBox*> changed;
+	if (m_lenghtIndexValid) {
+		getArrowsOnTracks({begin, end}, (*crossingPos)->m_order, changed);
+		for (auto it=changed.begin(); it!=changed.end(); ++it)
+			unindexArrowTracks(*it);
 	}
 	
+	// Les fleches apres le croisement echangent les voies begin et end. On reetiquette le cote le plus court :
+	// si c'est le debut, on echange les voies de toute la boite et on annule l'echange sur le debut.
+	std::list<ArrowInArrowBox*>::iterator it;
+	std::list<ArrowInArrowBox*>::iterator itEnd;
+	if (m_arrows.size()-crossingIndex-1 <= crossingIndex+1) {
+		it = crossingPos.getIterator(); ++it;
+		itEnd = m_arrows.end();
+	} else {
+		m_relabel.postAdd(std::make_pair(begin, end));
+		it = m_arrows.begin();
+		itEnd = crossingPos.getIterator(); ++itEnd;
+	}
+	
+	for (; it!=itEnd; ++it) {
+		(*it)->setArrow(swapArrowTracks((*it)->getArrow(), begin, end));
+	}
+	
+	for (auto arrowIt=changed.begin(); arrowIt!=changed.end(); ++arrowIt)
+		indexArrowTracks(*arrowIt);
+	
 	permutationBox.permute(std::make_pair(begin, end), false);
 	
-	postMoveArrowGenCrossingCommand(*this, makeArrowInArrowBoxIndexed(arrow), makeArrowInArrowBoxIndexed(crossingPos), begin, end);
+	postMoveArrowGenCrossingCommand(*this, makeArrowInArrowBoxIndexed(movingArrow, movingIndex), makeArrowInArrowBoxIndexed(crossingPos), begin, end);
 	crossingPos.decIndex();
 }
 
@@ -1284,11 +1642,10 @@ void OneHandle::sortArrowBoxesStrands(ZeroHandle& zeroHandle) {
 void OneHandle::transferArrowsToFirstArrowBox() {
 	if (!m_arrows1.empty()) {
 		while (!m_arrows1.empty()) {
-			Arrow& arrow = (*(ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1)))->getArrow();
+			Arrow arrow((*(ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1)))->getArrow());
 			unsigned int targetI = m_permutation.pre(arrow.begin());
 			unsigned int targetJ = m_permutation.pre(arrow.end());
-			m_arrows0.transferToBackArrow(ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1).getIterator(), m_arrows1);
-			arrow = Arrow(targetI, targetJ);
+			m_arrows0.transferToBackArrow(ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1).getIterator(), m_arrows1, Arrow(targetI, targetJ));
 		}
 		
 		postMoveArrowToFirstArrowBoxCommand(*this);
@@ -1296,119 +1653,140 @@ void OneHandle::transferArrowsToFirstArrowBox() {
 }
 
 void OneHandle::transferArrowToSecondArrowBox(ArrowBox::ArrowInArrowBoxIndexedIterator it, ArrowBox::ArrowInArrowBoxIndexedIterator& end) {
-	Arrow& arrow = (*it)->getArrow();
+	Arrow arrow((*it)->getArrow());
 	unsigned int targetI = m_permutation.post(arrow.begin());
 	unsigned int targetJ = m_permutation.post(arrow.end());
-	m_arrows1.transferToFrontArrow(it.getIterator(), m_arrows0);
+	m_arrows1.transferToFrontArrow(it.getIterator(), m_arrows0, Arrow(targetI, targetJ));
 	end.incIndex();
-	arrow = Arrow(targetI, targetJ);
-	assert(arrow.isDown());
+	assert((*it)->getArrow().isDown());
 	
 	postMoveArrowToOtherArrowBoxCommand(*this, m_arrows0, makeArrowInArrowBoxIndexed(it), targetI, targetJ);
 }
 
 void OneHandle::transferArrowToSecondArrowBoxResolveCrossing(ArrowBox::ArrowInArrowBoxIndexedIterator it, ArrowBox::ArrowInArrowBoxIndexedIterator& end) {
-	Arrow& arrow = (*it)->getArrow();
+	Arrow arrow((*it)->getArrow());
 	unsigned int targetI = m_permutation.post(arrow.begin());
 	unsigned int targetJ = m_permutation.post(arrow.end());
 	
-	m_arrows1.transferToFrontArrow(it.getIterator(), m_arrows0);
+	m_arrows1.transferToFrontArrow(it.getIterator(), m_arrows0, Arrow(targetJ, targetI));
 	m_arrows0.pushBackArrow(Arrow(arrow.end(), arrow.begin()));
 	m_permutation.permute(std::make_pair(arrow.begin(), arrow.end()), false);
 	end.incIndex();
-	arrow = Arrow(targetJ, targetI);
-	assert(arrow.isDown());
+	assert((*it)->getArrow().isDown());
 	
 	postMoveArrowToOtherArrowBoxResolveCrossingCommand(*this, m_arrows0, makeArrowInArrowBoxIndexed(it), m_arrows0.back(), targetJ, targetI);
 }
 
 void OneHandle::doLemma30(ArrowBox::ArrowInArrowBoxIndexedIterator begin, ArrowBox::ArrowInArrowBoxIndexedIterator& end) {
-	while (begin!=ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows0) && (*(--begin))->getArrow().isUp());
-	if ((*begin)->getArrow().isUp()) return;
-	
-	ArrowBox::ArrowInArrowBoxIndexedIterator candidate(begin);
-	ArrowBox::ArrowInArrowBoxIndexedIterator it(candidate);
-	bool shouldDoTransfer = true;
-	unsigned int candidateI = (*candidate)->getArrow().begin();
-	unsigned int candidateJ = (*candidate)->getArrow().end();
-	
-	ArrowBox::ArrowInArrowBoxIndexedIterator tIt(ArrowBox::ArrowInArrowBoxIndexedIterator::fromEndOfBox(m_arrows0));
-	m_arrows0.lemma29(++it, tIt);
-	it=candidate;
-	while (shouldDoTransfer && (++it)!=ArrowBox::ArrowInArrowBoxIndexedIterator::fromEndOfBox(m_arrows0)) {
-		assert((*candidate)->getArrow().isDown());
-		assert((*it)->getArrow().isUp());
-		unsigned int itI = (*it)->getArrow().begin();
-		unsigned int itJ = (*it)->getArrow().end();
+	// Une fleche de m_arrows0 est traitee par iteration, jusqu'a ce que m_arrows0 soit vide
+	while (!m_arrows0.empty()) {
+		cancellationPoint();
 		
-		unsigned int createI;
-		unsigned int createJ;
-		bool shouldCreateArrow = false;
+		while (begin!=ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows0) && (*(--begin))->getArrow().isUp());
+		if ((*begin)->getArrow().isUp()) return;
 		
-		if (candidateI==itJ && candidateJ==itI) {
-			if (begin==candidate) {
-				++begin;
-				begin.decIndex();
-			}
-			m_arrows0.removeArrowGenCrossing(candidate, it, m_permutation);
-			shouldDoTransfer = false;
-		} else if (candidateI == itJ) {
-			createI = itI;
-			createJ = candidateJ;
-			shouldCreateArrow = true;
-		} else if (candidateJ == itI) {
-			createI = candidateI;
-			createJ = itJ;
-			shouldCreateArrow = true;
-		}
+		ArrowBox::ArrowInArrowBoxIndexedIterator candidate(begin);
+		ArrowBox::ArrowInArrowBoxIndexedIterator it(candidate);
+		bool shouldDoTransfer = true;
+		unsigned int candidateI = (*candidate)->getArrow().begin();
+		unsigned int candidateJ = (*candidate)->getArrow().end();
 		
-		if (shouldCreateArrow) {
-			ArrowBox::ArrowInArrowBoxIndexedIterator it0(it); ++it0;
-			ArrowBox::ArrowInArrowBoxIndexedIterator newArrow = it0.insertInArrowBox(new ArrowBox::ArrowInArrowBox(Arrow(createI, createJ),
-					ArrowBox::ArrowRendererInList()), m_arrows0);
-			postGenArrowAfterMoveCrossing(m_arrows0, makeArrowInArrowBoxIndexed(candidate), makeArrowInArrowBoxIndexed(it), **newArrow, createI, createJ, false);
-			if (candidate==begin) {
-				++begin; begin.decIndex();
-			}
-			candidate.transfer(it0, m_arrows0);
-			newArrow.decIndex();
-			it = candidate;
+		ArrowBox::ArrowInArrowBoxIndexedIterator tIt(ArrowBox::ArrowInArrowBoxIndexedIterator::fromEndOfBox(m_arrows0));
+		m_arrows0.lemma29(++it, tIt);
+		it=candidate;
+		while (shouldDoTransfer && (++it)!=ArrowBox::ArrowInArrowBoxIndexedIterator::fromEndOfBox(m_arrows0)) {
+			assert((*candidate)->getArrow().isDown());
+			assert((*it)->getArrow().isUp());
+			unsigned int itI = (*it)->getArrow().begin();
+			unsigned int itJ = (*it)->getArrow().end();
+			
+			unsigned int createI;
+			unsigned int createJ;
+			bool shouldCreateArrow = false;
 			
-			if ((*newArrow)->getArrow().isDown()) {
-				begin = it0;
+			if (candidateI==itJ && candidateJ==itI) {
+				if (begin==candidate) {
+					++begin;
+					begin.decIndex();
+				}
+				m_arrows0.removeArrowGenCrossing(candidate, it, m_permutation);
 				shouldDoTransfer = false;
+			} else if (candidateI == itJ) {
+				createI = itI;
+				createJ = candidateJ;
+				shouldCreateArrow = true;
+			} else if (candidateJ == itI) {
+				createI = candidateI;
+				createJ = itJ;
+				shouldCreateArrow = true;
+			}
+			
+			if (shouldCreateArrow) {
+				ArrowBox::ArrowInArrowBoxIndexedIterator it0(it); ++it0;
+				ArrowBox::ArrowInArrowBoxIndexedIterator newArrow = it0.insertInArrowBox(new ArrowBox::ArrowInArrowBox(Arrow(createI, createJ),
+						ArrowBox::ArrowRendererInList()), m_arrows0);
+				postGenArrowAfterMoveCrossing(m_arrows0, makeArrowInArrowBoxIndexed(candidate), makeArrowInArrowBoxIndexed(it), **newArrow, createI, createJ, false);
+				statistics().count(Statistics::ARROWS_GENERATED);
+				if (candidate==begin) {
+					++begin; begin.decIndex();
+				}
+				candidate.transfer(it0, m_arrows0);
+				newArrow.decIndex();
+				it = candidate;
+				
+				if ((*newArrow)->getArrow().isDown()) {
+					begin = it0;
+					shouldDoTransfer = false;
+				}
 			}
 		}
-	}
-	
-	if (shouldDoTransfer) {
-		bool candidateIsBegin = (candidate==begin);
-		if (candidateIsBegin) ++begin;
 		
-		assert(candidateI < candidateJ);
-		if (m_permutation.post(candidateI) < m_permutation.post(candidateJ)) {
-			transferArrowToSecondArrowBox(candidate, end);
-			if (candidateIsBegin) begin.decIndex();
-		} else {
-			bool beginIsEnd = (begin == ArrowBox::ArrowInArrowBoxIndexedIterator::fromEndOfBox(m_arrows0));
-			transferArrowToSecondArrowBoxResolveCrossing(candidate, end);
-			if (candidateIsBegin) {
-				if (beginIsEnd) --begin;
-				else begin.decIndex();
+		if (shouldDoTransfer) {
+			bool candidateIsBegin = (candidate==begin);
+			if (candidateIsBegin) ++begin;
+			
+			assert(candidateI < candidateJ);
+			if (m_permutation.post(candidateI) < m_permutation.post(candidateJ)) {
+				transferArrowToSecondArrowBox(candidate, end);
+				if (candidateIsBegin) begin.decIndex();
+			} else {
+				bool beginIsEnd = (begin == ArrowBox::ArrowInArrowBoxIndexedIterator::fromEndOfBox(m_arrows0));
+				transferArrowToSecondArrowBoxResolveCrossing(candidate, end);
+				if (candidateIsBegin) {
+					if (beginIsEnd) --begin;
+					else begin.decIndex();
+				}
 			}
+			
+			candidate = ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1);
+			it = candidate; ++it;
+			m_arrows1.lemma29(candidate, end, &it);
 		}
-		
-		candidate = ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1);
-		it = candidate; ++it;
-		m_arrows1.lemma29(candidate, end, &it);
 	}
-	
-	if (!m_arrows0.empty()) {
-		doLemma30(begin, end);
+}
+
+OneHandle::Checkpoint OneHandle::getCheckpoint() const {
+	Checkpoint ret;
+	ret.prePermutation  = m_prePermutation.getBiPermutation().getPermutation().toMap();
+	ret.permutation     = m_permutation.getBiPermutation().getPermutation().toMap();
+	ret.postPermutation = m_postPermutation.getBiPermutation().getPermutation().toMap();
+	ret.arrows0 = m_arrows0.getArrows();
+	ret.arrows1 = m_arrows1.getArrows();
+	return ret;
+}
+
+// Le rendu d'une anse restauree est construit avec les fleches de la premiere boite seulement et des permutations
+// identites. On ajoute le reste de l'etat avec des commandes d'affichage.
+void OneHandle::postRestoredState() {
+	for (auto it=m_arrows1.begin(); it!=m_arrows1.end(); it++) {
+		postPushArrowCommand(m_arrows1, **it, (*it)->getArrow().begin(), (*it)->getArrow().end());
 	}
+	postRestorePermutationBoxesCommand(*this, m_prePermutation.getBiPermutation(), m_permutation.getBiPermutation(),
+			m_postPermutation.getBiPermutation());
 }
 
 void OneHandle::lemma30(ZeroHandle& zeroHandle) {
+	Statistics::LemmaScope scope(Statistics::LEMMA_30);
 	sortArrowBoxesStrands(zeroHandle);
 	ArrowBox::ArrowInArrowBoxIndexedIterator end(ArrowBox::ArrowInArrowBoxIndexedIterator::fromBeginOfBox(m_arrows1));
 	
@@ -1467,15 +1845,13 @@ void OneHandle::addArrowFromZeroHandle(PassArrowsThroughtZeroHandleCommand* cmd,
 		unsigned int targetJ = m_prePermutation.post(endJ);
 		
 		cmd->addArrow(makeArrowInArrowBoxIndexed(**arrow, index), m_arrows0, beginI, beginJ, endI, endJ, targetI, targetJ);
-		(*arrow)->getArrow() = Arrow(targetI, targetJ);
-		m_arrows0.transferToFrontArrow(arrow, src);
+		m_arrows0.transferToFrontArrow(arrow, src, Arrow(targetI, targetJ));
 	} else {
 		unsigned int targetI = m_postPermutation.pre(endI);
 		unsigned int targetJ = m_postPermutation.pre(endJ);
 		
 		cmd->addArrow(makeArrowInArrowBoxIndexed(**arrow, index), m_arrows1, beginI, beginJ, endI, endJ, targetI, targetJ);
-		(*arrow)->getArrow() = Arrow(targetI, targetJ);
-		m_arrows1.transferToBackArrow(arrow, src);
+		m_arrows1.transferToBackArrow(arrow, src, Arrow(targetI, targetJ));
 	}
 }
 
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <list>
+#include <map>
 #include <limits>
 #include <functional>
 
@@ -13,6 +14,7 @@
 #include "surface.hpp"
 #include "track.hpp"
 #include "color.hpp"
+#include "position_tree.hpp"
 
 class ZeroHandle;
 class ZeroHandleRenderer;
@@ -45,6 +47,7 @@ public:
 		void permute(const BiPermutation& permutation, AnimateMoveTrackPermutationBox* animPermutation, bool isAfter);
 		void permute(std::pair<unsigned int, unsigned int> permutation, AnimateMoveTrackPermutationBox* animPermutation, bool isAfter);
 		void refresh();
+		void setInversePermutation(const Permutation& inv_per) {m_inv_per = inv_per; refresh();}
 		TrackBezier& getTrack(unsigned int rightIndex) {assert(rightIndex<m_tracks.size()); return m_tracks[rightIndex];}
 		const TrackBezier& getTrack(unsigned int rightIndex) const {assert(rightIndex<m_tracks.size()); return m_tracks[rightIndex];}
 		unsigned int pre(unsigned int val) const {assert(val<m_inv_per.size()); return m_inv_per[val];}
@@ -61,11 +64,13 @@ private:
 	
 public:
 	PermutationBox(unsigned int m_numberOfTrackss) : m_permutation(m_numberOfTrackss) {}
+	PermutationBox(BiPermutation&& permutation) : m_permutation(std::move(permutation)) {}
 	
 	void permute(const BiPermutation& permutation, bool isAfter);
 	void permute(std::pair<unsigned int, unsigned int> permutation, bool isAfter);
 	unsigned int pre (unsigned int val) const {return m_permutation.pre(val);}
 	unsigned int post(unsigned int val) const {return m_permutation.post(val);}
+	const BiPermutation& getBiPermutation() const {return m_permutation;}
 	
 	friend Renderer;
 };
@@ -76,7 +81,12 @@ public:
 	typedef std::list<Arrow::Renderer>::iterator ArrowRendererInList;
 	
 	class ArrowInArrowBox {
-		Arrow m_arrow;
+		Arrow m_arrow; // Voies avant le reetiquetage paresseux de la boite
+		const BiPermutation* m_relabel = nullptr;
+		unsigned long long m_order = 0; // Position relative dans la boite, valide si l'index des longueurs l'est
+		// Rang et place dans la liste de la boite, valides si l'index des longueurs l'est
+		PositionNode m_position;
+		std::list<ArrowInArrowBox*>::iterator m_inList;
 		ArrowRendererInList m_arrowRendererInList;
 #ifndef NDEBUG
 		bool m_arrowRendererInListSet = false;
@@ -93,7 +103,7 @@ public:
 		ArrowInArrowBox() = delete;
 		ArrowInArrowBox(Arrow arrow, ArrowRendererInList arrowRendererInList) : m_arrow(arrow), m_arrowRendererInList(arrowRendererInList) {}
 		ArrowInArrowBox(const ArrowInArrowBox& other) = delete;
-		ArrowInArrowBox(ArrowInArrowBox&& other) : m_arrow(std::move(other.m_arrow)) {
+		ArrowInArrowBox(ArrowInArrowBox&& other) : m_arrow(std::move(other.m_arrow)), m_relabel(other.m_relabel), m_order(other.m_order) {
 			m_arrowRendererInList = std::move(other.m_arrowRendererInList);
 #ifndef NDEBUG
 			m_arrowRendererInListSet = other.m_arrowRendererInListSet;
@@ -105,10 +115,25 @@ public:
 		bool arrowInListSet() const {return m_arrowRendererInListSet;}
 #endif
 		
-		Arrow& getArrow() {return m_arrow;}
+		Arrow getArrow() const {
+			if (m_relabel==nullptr) return m_arrow;
+			return Arrow(m_relabel->post(m_arrow.begin()), m_relabel->post(m_arrow.end()));
+		}
+		
+		void setArrow(Arrow arrow) {
+			if (m_relabel==nullptr) m_arrow = arrow;
+			else m_arrow = Arrow(m_relabel->pre(arrow.begin()), m_relabel->pre(arrow.end()));
+		}
+		
+		void setRelabel(const BiPermutation& relabel, Arrow arrow) {
+			m_relabel = &relabel;
+			setArrow(arrow);
+		}
+		
 		ArrowRendererInList getArrowRendererInList() const {assert(m_arrowRendererInListSet); return m_arrowRendererInList;}
 		
 		friend Renderer;
+		friend ArrowBox;
 	};
 	
 	class Renderer {
@@ -129,6 +154,9 @@ public:
 		std::vector<TrackLine> m_tracks;
 		float m_basex, m_basey, m_lenght;
 		OneHandleRenderer& m_oneHandle;
+		RendererGL& m_rendererGL;
+		// Les fleches sont relatives a cette translation, qui suit la base de la boite; 0 si elles sont placees dans la structure
+		unsigned int m_translation;
 		std::list<Arrow::Renderer> m_arrow;
 		int m_layer;
 		Crossing* m_crossing = nullptr;
@@ -143,6 +171,7 @@ public:
 		Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float basex, float basey, int layer, OneHandleRenderer& oneHandle, 
 				 std::list<std::pair<unsigned int, unsigned int>>& arrowsData, std::list<ArrowBox::ArrowInArrowBox*>& arrows);
 		Renderer(RendererGL& rendererGL, ArrowBox& arrowBox, float basex, float basey, int layer, OneHandleRenderer& oneHandle);
+		~Renderer();
 		
 		ArrowRendererInList begin() {return m_arrow.begin();}
 		ArrowRendererInList end()   {return m_arrow.end();}
@@ -220,11 +249,18 @@ public:
 		bool empty() const {return m_lenght==0.0;}
 		float lenght() const {return m_lenght;}
 		void setLenght(float newLenght, bool updateArrows);
+		// La 1-anse doit ensuite etre replacee par OneHandleRenderer::updateLenght
+		void resizeWithoutLayout(float newLenght) {m_lenght = newLenght;}
 		float endX() const {return m_basex+m_lenght;}
 		static float arrowSeparation() {return 0.055;}
 		float getBasex() const {return m_basex;}
 		float getBasey() const {return m_basey;}
 		float getRelativeYForTrack(unsigned int index) const;
+		unsigned int getTranslation() const {return m_translation;}
+		// Abscisse relative a la boite ramenee dans les coordonnees de la translation des fleches
+		float toTranslationX(float x) const {return m_basex+x-m_rendererGL.getTranslation(m_translation)[0];}
+		// Fleches fixes (groupe 0) dont le debut, relatif a la boite, est dans [start, end)
+		void getArrowsInRange(float start, float end, std::vector<Arrow::Renderer*>& arrows);
 		
 		Crossing& getCrossing() {
 			assert(m_crossing!=nullptr);
@@ -257,6 +293,8 @@ public:
 		
 		ArrowInArrowBoxIndexedIterator(std::list<ArrowInArrowBox*>::iterator it, size_t index) : m_it(it), m_index(index) {}
 		
+		friend ArrowBox;
+		
 	public:
 		ArrowInArrowBoxIndexedIterator() : m_index(std::numeric_limits<size_t>::max()) {}
 		
@@ -298,21 +336,53 @@ public:
 private:
 	std::list<ArrowInArrowBox*> m_arrows;
 	unsigned int m_numberOfTracks;
+	BiPermutation m_relabel; // Reetiquetage des voies applique paresseusement a toutes les fleches
 	Renderer* m_renderer = nullptr;
 	
-	void lemma29MovePastArrow(ArrowInArrowBox& movingArrow, unsigned int& movingIndex, ArrowInArrowBoxIndexedIterator& arrow,
-			ArrowInArrowBoxIndexedIterator* last, ArrowInArrowBoxIndexedIterator& end);
+	// Fleches par direction et longueur, et par voie touchee, ordonnees par position. Construit au besoin par doLemma29,
+	// puis tenu a jour: un reetiquetage ne reindexe que les fleches des voies deplacees.
+	std::vector<std::map<unsigned long long, ArrowInArrowBox*>> m_lenghtIndex;
+	std::vector<std::map<unsigned long long, ArrowInArrowBox*>> m_trackIndex;
+	PositionTree m_positions;
+	bool m_lenghtIndexValid = false;
+	
+	ArrowInArrowBox* adoptArrow(ArrowInArrowBox* arrow) {arrow->setRelabel(m_relabel, arrow->getArrow()); return arrow;}
+	
+	std::map<unsigned long long, ArrowInArrowBox*>& getLenghtIndex(const Arrow& arrow) {
+		return m_lenghtIndex[(arrow.isUp() ? m_numberOfTracks : 0) + arrow.lenght()];
+	}
+	void buildLenghtIndex();
+	void invalidateLenghtIndex() {m_lenghtIndexValid = false;}
+	void indexInsertedArrow(std::list<ArrowInArrowBox*>::iterator it);
+	void unindexArrow(ArrowInArrowBox* arrow);
+	void indexArrowTracks(ArrowInArrowBox* arrow);
+	void unindexArrowTracks(ArrowInArrowBox* arrow);
+	// Fleches apres la position order qui touchent une des voies, sans doublon
+	void getArrowsOnTracks(const std::vector<unsigned int>& tracks, unsigned long long order, std::vector<ArrowInArrowBox*>& arrows);
+	bool findLemma29Candidate(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& it, unsigned int maxLenght, bool strict);
+	
+	void reduceCommutingPairs(std::list<Arrow>& arrows) const;
+	
+	class Lemma29Frame;
+	class DoLemma29Frame;
+	class MovePastArrowFrame;
+	class RemoveSameArrowsFrame;
+	void runLemma29(Lemma29Frame* frame);
 	void doLemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator checkStart,
 					unsigned int k, bool shouldGoDeeper, bool strictK, ArrowInArrowBoxIndexedIterator& end, ArrowInArrowBoxIndexedIterator* last=nullptr);
 	void lemma29RemoveSameArrows(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& end);
 	
 public:
-	ArrowBox(std::list<Arrow>&& arrows, unsigned int numberOfTracks) : m_numberOfTracks(numberOfTracks) {
+	ArrowBox(std::list<Arrow>&& arrows, unsigned int numberOfTracks, bool shouldReduce=true) : m_numberOfTracks(numberOfTracks),
+			m_relabel(numberOfTracks), m_lenghtIndex(2*numberOfTracks), m_trackIndex(numberOfTracks) {
+		if (shouldReduce) reduceCommutingPairs(arrows);
 		for (auto it=arrows.begin(); it!=arrows.end(); it++) {
-			m_arrows.push_back(new ArrowInArrowBox(*it, ArrowRendererInList()));
+			m_arrows.push_back(adoptArrow(new ArrowInArrowBox(*it, ArrowRendererInList())));
 		}
 	}
-	ArrowBox(unsigned int numberOfTracks) : m_numberOfTracks(numberOfTracks) {}
+	ArrowBox(unsigned int numberOfTracks) : m_numberOfTracks(numberOfTracks), m_relabel(numberOfTracks), m_lenghtIndex(2*numberOfTracks),
+			m_trackIndex(numberOfTracks) {}
+	ArrowBox(const ArrowBox& other) = delete;
 	
 	Renderer& getRenderer() {assert(m_renderer!=nullptr); return *m_renderer;}
 	
@@ -323,8 +393,10 @@ public:
 	void moveArrowsThroughoutZeroHandle(ZeroHandle& zeroHandle, OneHandle& oneHandle, bool fromEnd);
 	
 	ArrowInArrowBox& pushArrowRet(Arrow arrow) {
-		ArrowInArrowBox* arrowInArrowBox = new ArrowInArrowBox(arrow, ArrowRendererInList());
-		return **(m_arrows.insert(m_arrows.end(), arrowInArrowBox));
+		ArrowInArrowBox* arrowInArrowBox = adoptArrow(new ArrowInArrowBox(arrow, ArrowRendererInList()));
+		auto it = m_arrows.insert(m_arrows.end(), arrowInArrowBox);
+		indexInsertedArrow(it);
+		return **it;
 	}
 	
 	size_t size() const {return m_arrows.size();}
@@ -334,40 +406,51 @@ public:
 	std::list<ArrowInArrowBox*>::iterator end()   {return m_arrows.end();}
 	
 	void pushBackArrow(Arrow arrow) {
-		ArrowInArrowBox* arrowInArrowBox = new ArrowInArrowBox(arrow, ArrowRendererInList());
+		ArrowInArrowBox* arrowInArrowBox = adoptArrow(new ArrowInArrowBox(arrow, ArrowRendererInList()));
 		m_arrows.push_back(arrowInArrowBox);
+		indexInsertedArrow(--m_arrows.end());
 	}
 	
 	void pushFrontArrow(Arrow arrow) {
-		ArrowInArrowBox* arrowInArrowBox = new ArrowInArrowBox(arrow, ArrowRendererInList());
+		ArrowInArrowBox* arrowInArrowBox = adoptArrow(new ArrowInArrowBox(arrow, ArrowRendererInList()));
 		m_arrows.push_front(arrowInArrowBox);
+		indexInsertedArrow(m_arrows.begin());
 	}
 	
 	Arrow popBackArrow() {
 		Arrow ret(m_arrows.back()->getArrow());
+		unindexArrow(m_arrows.back());
 		m_arrows.pop_back();
 		return ret;
 	}
 	
 	Arrow popFrontArrow() {
 		Arrow ret(m_arrows.front()->getArrow());
+		unindexArrow(m_arrows.front());
 		m_arrows.pop_front();
 		return ret;
 	}
 	
 	ArrowInArrowBox& back() {return *(m_arrows.back());}
 	
-	void transferToFrontArrow(std::list<ArrowInArrowBox*>::iterator it, ArrowBox& src) {
+	void transferToFrontArrow(std::list<ArrowInArrowBox*>::iterator it, ArrowBox& src, Arrow arrow) {
+		src.unindexArrow(*it);
+		(*it)->setRelabel(m_relabel, arrow);
 		m_arrows.splice(m_arrows.begin(), src.m_arrows, it);
+		indexInsertedArrow(it);
 	}
-	void transferToBackArrow(std::list<ArrowInArrowBox*>::iterator it, ArrowBox& src) {
+	void transferToBackArrow(std::list<ArrowInArrowBox*>::iterator it, ArrowBox& src, Arrow arrow) {
+		src.unindexArrow(*it);
+		(*it)->setRelabel(m_relabel, arrow);
 		m_arrows.splice(m_arrows.end(), src.m_arrows, it);
+		indexInsertedArrow(it);
 	}
 	
 	void removeArrowGenCrossing(ArrowInArrowBoxIndexedIterator arrow, ArrowInArrowBoxIndexedIterator& crossingPos, PermutationBox& permutationBox);
 	void lemma29(ArrowInArrowBoxIndexedIterator& begin, ArrowInArrowBoxIndexedIterator& end, ArrowInArrowBoxIndexedIterator* checkStart=nullptr);
 	void permuteTracks(const Permutation& permutation);
 	void fillArrowsRendererLists(std::list<std::pair<unsigned int, unsigned int>>& arrowsData, std::list<ArrowInArrowBox*>& arrows);
+	std::list<Arrow> getArrows() const;
 	
 	friend ArrowInArrowBoxIndexedIterator;
 };
@@ -447,12 +530,31 @@ private:
 	void sortArrowBoxesStrands(ZeroHandle& zeroHandle);
 	
 public:
+	// Etat complet d'une anse, pour les points de reprise de la proposition 28
+	struct Checkpoint {
+		std::vector<unsigned int> prePermutation;
+		std::vector<unsigned int> permutation;
+		std::vector<unsigned int> postPermutation;
+		std::list<Arrow> arrows0;
+		std::list<Arrow> arrows1;
+	};
+	
 	OneHandle(std::list<Arrow>&& arrows, unsigned int numberOfTracks, std::list<std::pair<unsigned int, unsigned int>>& arrowsData,
 		std::list<ArrowBox::ArrowInArrowBox*>& arrowsPtr) : 
 			m_prePermutation(numberOfTracks), m_arrows0(std::move(arrows), numberOfTracks), m_permutation(numberOfTracks), m_arrows1(numberOfTracks),
 			m_postPermutation(numberOfTracks), m_numberOfTracks(numberOfTracks) {
 		m_arrows0.fillArrowsRendererLists(arrowsData, arrowsPtr);
 	}
+	OneHandle(Checkpoint&& checkpoint, unsigned int numberOfTracks, std::list<std::pair<unsigned int, unsigned int>>& arrowsData,
+		std::list<ArrowBox::ArrowInArrowBox*>& arrowsPtr) :
+			m_prePermutation(BiPermutation(Permutation::FromMap(checkpoint.prePermutation))), m_arrows0(std::move(checkpoint.arrows0), numberOfTracks, false),
+			m_permutation(BiPermutation(Permutation::FromMap(checkpoint.permutation))), m_arrows1(std::move(checkpoint.arrows1), numberOfTracks, false),
+			m_postPermutation(BiPermutation(Permutation::FromMap(checkpoint.postPermutation))), m_numberOfTracks(numberOfTracks) {
+		m_arrows0.fillArrowsRendererLists(arrowsData, arrowsPtr);
+	}
+	
+	Checkpoint getCheckpoint() const;
+	void postRestoredState();
 	
 	ArrowBox& getFirstArrowBox() {return m_arrows0;}
 	PermutationBox& getPermutation() {return m_permutation;}
@@ -31,6 +31,21 @@ Permutation Permutation::Identity(unsigned int size) {
 	return ret;
 }
 
+Permutation Permutation::FromMap(const std::vector<unsigned int>& map) {
+	Permutation ret(map.size());
+	std::copy(map.begin(), map.end(), ret.m_map);
+	
+#ifndef NDEBUG
+	std::vector<bool> seen(ret.m_size, false);
+	for (unsigned int i=0; i<ret.m_size; i++) {
+		assert(ret.m_map[i]<ret.m_size && !seen[ret.m_map[i]]);
+		seen[ret.m_map[i]] = true;
+	}
+#endif
+	
+	return ret;
+}
+
 Permutation Permutation::operator*(const Permutation& other) const {
 	assert(m_size==other.m_size);
 	
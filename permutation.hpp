@@ -19,6 +19,7 @@ private:
 	
 public:
 	static Permutation Identity(unsigned int size);
+	static Permutation FromMap(const std::vector<unsigned int>& map);
 	
 	Permutation(const Permutation& other);
 	Permutation(Permutation&& other) : m_size(other.m_size), m_map(other.m_map) {other.m_map = nullptr; other.m_size = 0;}
@@ -30,6 +31,7 @@ public:
 	Permutation& operator*=(std::pair<unsigned int, unsigned int> p);
 	unsigned int size() const {return m_size;}
 	bool isIdentity() const;
+	std::vector<unsigned int> toMap() const {return std::vector<unsigned int>(m_map, m_map+m_size);}
 	
 	template<class COMPARE>
 	void sort(COMPARE compare);
@@ -0,0 +1,94 @@
+#include "position_tree.hpp"
+
+void PositionTree::replaceChild(PositionNode* parent, PositionNode* oldChild, PositionNode* newChild) {
+	if (parent==nullptr)
+		m_root = newChild;
+	else if (parent->m_left==oldChild)
+		parent->m_left = newChild;
+	else
+		parent->m_right = newChild;
+}
+
+void PositionTree::rotateUp(PositionNode* node) {
+	PositionNode* parent = node->m_parent;
+	PositionNode* grandParent = parent->m_parent;
+	
+	if (parent->m_left==node) {
+		parent->m_left = node->m_right;
+		if (node->m_right!=nullptr) node->m_right->m_parent = parent;
+		node->m_right = parent;
+	} else {
+		parent->m_right = node->m_left;
+		if (node->m_left!=nullptr) node->m_left->m_parent = parent;
+		node->m_left = parent;
+	}
+	
+	parent->m_parent = node;
+	node->m_parent = grandParent;
+	replaceChild(grandParent, parent, node);
+	updateSize(parent);
+	updateSize(node);
+}
+
+uint32_t PositionTree::nextPriority() {
+	m_seed ^= m_seed << 13;
+	m_seed ^= m_seed >> 17;
+	m_seed ^= m_seed << 5;
+	return m_seed;
+}
+
+void PositionTree::insertBefore(PositionNode* node, PositionNode* next) {
+	node->m_left = node->m_right = nullptr;
+	node->m_size = 1;
+	node->m_priority = nextPriority();
+	
+	if (m_root==nullptr) {
+		node->m_parent = nullptr;
+		m_root = node;
+		return;
+	}
+	
+	// Le nouveau noeud devient une feuille: fils gauche de next, ou fils droit de son predecesseur
+	PositionNode* parent;
+	if (next!=nullptr && next->m_left==nullptr) {
+		parent = next;
+		parent->m_left = node;
+	} else {
+		parent = (next==nullptr) ? m_root : next->m_left;
+		while (parent->m_right!=nullptr)
+			parent = parent->m_right;
+		parent->m_right = node;
+	}
+	node->m_parent = parent;
+	
+	for (PositionNode* it=parent; it!=nullptr; it=it->m_parent)
+		it->m_size++;
+	
+	while (node->m_parent!=nullptr && node->m_parent->m_priority<node->m_priority)
+		rotateUp(node);
+}
+
+void PositionTree::erase(PositionNode* node) {
+	// On descend le noeud jusqu'a ce qu'il ait au plus un fils
+	while (node->m_left!=nullptr && node->m_right!=nullptr)
+		rotateUp((node->m_left->m_priority>node->m_right->m_priority) ? node->m_left : node->m_right);
+	
+	PositionNode* child = (node->m_left!=nullptr) ? node->m_left : node->m_right;
+	if (child!=nullptr) child->m_parent = node->m_parent;
+	replaceChild(node->m_parent, node, child);
+	
+	for (PositionNode* it=node->m_parent; it!=nullptr; it=it->m_parent)
+		it->m_size--;
+	
+	node->m_parent = node->m_left = node->m_right = nullptr;
+	node->m_size = 1;
+}
+
+size_t PositionTree::rank(const PositionNode* node) const {
+	size_t ret = size(node->m_left);
+	for (; node->m_parent!=nullptr; node=node->m_parent) {
+		if (node->m_parent->m_right==node)
+			ret += size(node->m_parent->m_left)+1;
+	}
+	return ret;
+}
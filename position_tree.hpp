@@ -0,0 +1,47 @@
+#ifndef __POSITION_TREE_HPP__
+#define __POSITION_TREE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+// Noeud d'un PositionTree, range dans l'element lui-meme
+struct PositionNode {
+	PositionNode* m_parent = nullptr;
+	PositionNode* m_left   = nullptr;
+	PositionNode* m_right  = nullptr;
+	uint32_t m_priority = 0;
+	size_t m_size = 1;
+};
+
+// Sequence d'elements qui donne le rang de chacun en O(log n) en moyenne: arbre cartesien a cles implicites.
+// L'arbre ne possede pas les noeuds, il ne fait que les relier.
+class PositionTree {
+	PositionNode* m_root;
+	uint32_t m_seed;
+	
+	PositionTree(const PositionTree&) = delete;
+	PositionTree& operator=(const PositionTree&) = delete;
+	
+	static size_t size(const PositionNode* node) {return (node==nullptr) ? 0 : node->m_size;}
+	static void updateSize(PositionNode* node) {node->m_size = size(node->m_left)+size(node->m_right)+1;}
+	void replaceChild(PositionNode* parent, PositionNode* oldChild, PositionNode* newChild);
+	// Remonte node d'un niveau
+	void rotateUp(PositionNode* node);
+	uint32_t nextPriority();
+	
+public:
+	PositionTree() : m_root(nullptr), m_seed(2463534242u) {}
+	
+	// Oublie tous les noeuds sans les toucher
+	void clear() {m_root = nullptr;}
+	bool empty() const {return m_root==nullptr;}
+	size_t size() const {return size(m_root);}
+	
+	// Insere node juste avant next, ou a la fin si next est nul
+	void insertBefore(PositionNode* node, PositionNode* next);
+	void erase(PositionNode* node);
+	// Nombre d'elements avant node
+	size_t rank(const PositionNode* node) const;
+};
+
+#endif // __POSITION_TREE_HPP__
@@ -204,16 +204,33 @@ ProgramsGL::Program::~Program() {
 	}
 }
 
-ProgramsGL::ProgramsGL(int) : m_programs{std::move(Program(0))} {
-	Shader vertex_shader("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_vertex.glsl", GL_VERTEX_SHADER);
-	Shader fragment_shader("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_fragment.glsl", GL_FRAGMENT_SHADER);
+ProgramsGL::ProgramsGL(int) : m_programs{std::move(Program(0)), std::move(Program(0))} {
+	{
+		Shader vertex_shader("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_vertex.glsl", GL_VERTEX_SHADER);
+		Shader fragment_shader("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_fragment.glsl", GL_FRAGMENT_SHADER);
+	
+		Shader* shaders[2] = {&vertex_shader, &fragment_shader};
+		const char*  uniforms[3]   = {"matrix", "animationTime", "translation"};
+		const char*  attributes[6] = {"position", "target", "animation", "color", "layer", "vertexTranslation"};
+		m_programs[DEFAULT_PROGRAM].attachShaders(shaders, 2);
+		m_programs[DEFAULT_PROGRAM].link();
+		m_programs[DEFAULT_PROGRAM].loadUniforms(uniforms, 3);
+		m_programs[DEFAULT_PROGRAM].loadAttributes(attributes, 6);
+		m_programs[DEFAULT_PROGRAM].detachShaders();
+	}
 	
-	Shader* shaders[2] = {&vertex_shader, &fragment_shader};
-	const char*  uniforms[2]   = {"matrix", "vertexColor"};
-	const char*  attributes[1] = {"position"};
-	m_programs[0].attachShaders(shaders, 2);
-	m_programs[0].link();
-	m_programs[0].loadUniforms(uniforms, 2);
-	m_programs[0].loadAttributes(attributes, 1);
-	m_programs[0].detachShaders();
+	{
+		Shader vertex_shader("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_arrow_vertex.glsl", GL_VERTEX_SHADER);
+		Shader fragment_shader("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_arrow_fragment.glsl", GL_FRAGMENT_SHADER);
+		
+		Shader* shaders[2] = {&vertex_shader, &fragment_shader};
+		const char*  uniforms[5]    = {"matrix", "animationTime", "translation", "numStep", "translationShift"};
+		const char*  attributes[10] = {"arrowBegin", "arrowEnd", "arrowTip", "arrowTargetBegin", "arrowTargetEnd", "arrowTargetTip", "arrowAnimation",
+									  "arrowColor", "arrowLayer", "arrowTranslation"};
+		m_programs[ARROW_PROGRAM].attachShaders(shaders, 2);
+		m_programs[ARROW_PROGRAM].link();
+		m_programs[ARROW_PROGRAM].loadUniforms(uniforms, 5);
+		m_programs[ARROW_PROGRAM].loadAttributes(attributes, 10);
+		m_programs[ARROW_PROGRAM].detachShaders();
+	}
 }
@@ -76,16 +76,37 @@ class ProgramsGL {
 
   public:
 	enum ProgramInstance {
-		DEFAULT_PROGRAM = 0
+		DEFAULT_PROGRAM = 0,
+		ARROW_PROGRAM   = 1
 	};
 
 	enum Uniform {
-		MATRIX = 0,
-		COLOR  = 1
+		MATRIX            = 0,
+		ANIMATION_TIME    = 1,
+		TRANSLATION       = 2,
+		NUM_STEP          = 3, // ARROW_PROGRAM seulement
+		TRANSLATION_SHIFT = 4  // ARROW_PROGRAM seulement
 	};
 
 	enum Attribute {
-		POSITION = 0
+		POSITION    = 0,
+		TARGET      = 1,
+		ANIMATION   = 2,
+		COLOR       = 3,
+		LAYER       = 4,
+		VERTEX_TRANSLATION = 5,
+		
+		// ARROW_PROGRAM
+		ARROW_BEGIN        = 0,
+		ARROW_END          = 1,
+		ARROW_TIP          = 2,
+		ARROW_TARGET_BEGIN = 3,
+		ARROW_TARGET_END   = 4,
+		ARROW_TARGET_TIP   = 5,
+		ARROW_ANIMATION    = 6,
+		ARROW_COLOR        = 7,
+		ARROW_LAYER        = 8,
+		ARROW_TRANSLATION  = 9
 	};
 	  
 	class Program {
@@ -122,7 +143,7 @@ class ProgramsGL {
 	};
 	
   private:
-	Program m_programs[1];
+	Program m_programs[2];
 	
   public:
 	ProgramsGL() = default;
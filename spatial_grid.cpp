@@ -0,0 +1,88 @@
+#include <cmath>
+#include <algorithm>
+
+#include "spatial_grid.hpp"
+
+bool SpatialGrid::getCells(const BoundingBox& box, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1, size_t maxCells) {
+	float cells[4] = {box.m_min[0], box.m_min[1], box.m_max[0], box.m_max[1]};
+	for (int i=0; i<4; i++) {
+		cells[i] = std::floor(cells[i]/SPATIAL_GRID_CELL_SIZE);
+		if (!std::isfinite(cells[i]) || std::abs(cells[i])>=std::numeric_limits<int32_t>::max()) return false;
+	}
+	
+	if ((cells[2]-cells[0]+1)*(cells[3]-cells[1]+1) > maxCells) return false;
+	
+	x0 = cells[0]; y0 = cells[1];
+	x1 = cells[2]; y1 = cells[3];
+	return true;
+}
+
+void SpatialGrid::insert(size_t element, const BoundingBox& box) {
+	if (box.empty()) return;
+	
+	int32_t x0, y0, x1, y1;
+	if (!getCells(box, x0, y0, x1, y1, SPATIAL_GRID_MAX_CELLS)) {
+		m_large.push_back(element);
+		return;
+	}
+	
+	for (int32_t x=x0; x<=x1; x++) {
+		for (int32_t y=y0; y<=y1; y++)
+			m_cells[getKey(x, y)].push_back(element);
+	}
+}
+
+static void removeFrom(std::vector<size_t>& elements, size_t element) {
+	auto it = std::find(elements.begin(), elements.end(), element);
+	if (it!=elements.end()) {
+		*it = elements.back();
+		elements.pop_back();
+	}
+}
+
+void SpatialGrid::remove(size_t element, const BoundingBox& box) {
+	if (box.empty()) return;
+	
+	int32_t x0, y0, x1, y1;
+	if (!getCells(box, x0, y0, x1, y1, SPATIAL_GRID_MAX_CELLS)) {
+		removeFrom(m_large, element);
+		return;
+	}
+	
+	for (int32_t x=x0; x<=x1; x++) {
+		for (int32_t y=y0; y<=y1; y++) {
+			auto it = m_cells.find(getKey(x, y));
+			if (it==m_cells.end()) continue;
+			
+			removeFrom(it->second, element);
+			if (it->second.empty())
+				m_cells.erase(it);
+		}
+	}
+}
+
+void SpatialGrid::query(const BoundingBox& box, std::vector<size_t>& out) const {
+	out.insert(out.end(), m_large.begin(), m_large.end());
+	
+	int32_t x0, y0, x1, y1;
+	if (getCells(box, x0, y0, x1, y1, m_cells.size())) {
+		for (int32_t x=x0; x<=x1; x++) {
+			for (int32_t y=y0; y<=y1; y++) {
+				auto it = m_cells.find(getKey(x, y));
+				if (it!=m_cells.end())
+					out.insert(out.end(), it->second.begin(), it->second.end());
+			}
+		}
+	}
+	else {
+		// Plus de cellules a voir que de cellules occupees: on parcourt celles-ci
+		float minx = std::floor(box.m_min[0]/SPATIAL_GRID_CELL_SIZE), maxx = std::floor(box.m_max[0]/SPATIAL_GRID_CELL_SIZE);
+		float miny = std::floor(box.m_min[1]/SPATIAL_GRID_CELL_SIZE), maxy = std::floor(box.m_max[1]/SPATIAL_GRID_CELL_SIZE);
+		for (auto& cell : m_cells) {
+			float x = static_cast<int32_t>(cell.first >> 32);
+			float y = static_cast<int32_t>(cell.first & 0xffffffff);
+			if (x>=minx && x<=maxx && y>=miny && y<=maxy)
+				out.insert(out.end(), cell.second.begin(), cell.second.end());
+		}
+	}
+}
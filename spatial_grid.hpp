@@ -0,0 +1,61 @@
+#ifndef __SPATIAL_GRID_HPP__
+#define __SPATIAL_GRID_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <unordered_map>
+
+// Cote d'une cellule de la grille, en unites de la structure
+#define SPATIAL_GRID_CELL_SIZE 1.0
+// Un element qui couvre plus de cellules est toujours renvoye par query
+#define SPATIAL_GRID_MAX_CELLS 64
+
+// Rectangle englobant, vide tant que m_min depasse m_max
+struct BoundingBox {
+	float m_min[2];
+	float m_max[2];
+	
+	BoundingBox() : m_min{std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()},
+			m_max{-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()} {}
+	BoundingBox(float minx, float miny, float maxx, float maxy) : m_min{minx, miny}, m_max{maxx, maxy} {}
+	
+	void extend(float x, float y) {
+		if (x<m_min[0]) m_min[0] = x;
+		if (x>m_max[0]) m_max[0] = x;
+		if (y<m_min[1]) m_min[1] = y;
+		if (y>m_max[1]) m_max[1] = y;
+	}
+	
+	bool empty() const {return m_min[0]>m_max[0] || m_min[1]>m_max[1];}
+	bool intersects(const BoundingBox& other) const {
+		return m_min[0]<=other.m_max[0] && other.m_min[0]<=m_max[0] && m_min[1]<=other.m_max[1] && other.m_min[1]<=m_max[1];
+	}
+	
+	bool operator==(const BoundingBox& other) const {
+		return m_min[0]==other.m_min[0] && m_min[1]==other.m_min[1] && m_max[0]==other.m_max[0] && m_max[1]==other.m_max[1];
+	}
+};
+
+// Grille uniforme d'elements numerotes, selon leur rectangle englobant.
+// remove doit recevoir le rectangle donne a insert.
+class SpatialGrid {
+	std::unordered_map<uint64_t, std::vector<size_t>> m_cells;
+	// Elements trop grands ou aux coordonnees non finies
+	std::vector<size_t> m_large;
+	
+	static uint64_t getKey(int32_t x, int32_t y) {return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);}
+	// Cellules [x0, x1]x[y0, y1] couvertes par box, false si elles sont trop nombreuses
+	static bool getCells(const BoundingBox& box, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1, size_t maxCells);
+	
+public:
+	void insert(size_t element, const BoundingBox& box);
+	void remove(size_t element, const BoundingBox& box);
+	bool empty() const {return m_cells.empty() && m_large.empty();}
+	
+	// Ajoute a out les elements des cellules qui touchent box, avec des doublons
+	void query(const BoundingBox& box, std::vector<size_t>& out) const;
+};
+
+#endif // __SPATIAL_GRID_HPP__
@@ -0,0 +1,182 @@
+#ifndef __SPSC_CHANNEL_HPP__
+#define __SPSC_CHANNEL_HPP__
+
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+
+#include <pthread.h>
+
+// Nombre d'elements par segment du canal
+#define SPSC_SEGMENT_SIZE 256
+
+// File sans verrou entre un seul producteur et un seul consommateur.
+// Les elements sont ranges dans une liste de segments: le producteur n'attend jamais la memoire du consommateur.
+// Le producteur peut changer de thread si le changement est synchronise (pthread_join, mutex, ...),
+// de meme pour le consommateur.
+template<class T>
+class SpscChannel {
+	struct Segment {
+		T m_items[SPSC_SEGMENT_SIZE];
+		std::atomic<Segment*> m_next;
+		
+		Segment() : m_next(nullptr) {}
+	};
+	
+	// Cote producteur
+	Segment* m_tail;
+	size_t m_tailPos;
+	size_t m_written;
+	
+	// Cote consommateur
+	Segment* m_head;
+	size_t m_headPos;
+	size_t m_read;
+	
+	std::atomic<size_t> m_published;
+	std::atomic<size_t> m_consumed;
+	// Dernier segment libere par le consommateur, reutilise par le producteur
+	std::atomic<Segment*> m_spare;
+	
+	SpscChannel(const SpscChannel&) = delete;
+	SpscChannel& operator=(const SpscChannel&) = delete;
+	
+	void write(const T& item) {
+		if (m_tailPos==SPSC_SEGMENT_SIZE) {
+			Segment* segment = m_spare.exchange(nullptr, std::memory_order_acq_rel);
+			if (segment==nullptr)
+				segment = new Segment;
+			else
+				segment->m_next.store(nullptr, std::memory_order_relaxed);
+			
+			// Rendu visible au consommateur par la publication suivante
+			m_tail->m_next.store(segment, std::memory_order_relaxed);
+			m_tail = segment;
+			m_tailPos = 0;
+		}
+		
+		m_tail->m_items[m_tailPos++] = item;
+		m_written++;
+	}
+	
+	T read() {
+		if (m_headPos==SPSC_SEGMENT_SIZE) {
+			Segment* segment = m_head;
+			m_head = segment->m_next.load(std::memory_order_relaxed);
+			m_headPos = 0;
+			delete m_spare.exchange(segment, std::memory_order_acq_rel);
+		}
+		
+		m_read++;
+		return m_head->m_items[m_headPos++];
+	}
+	
+public:
+	SpscChannel() : m_tailPos(0), m_written(0), m_headPos(0), m_read(0), m_published(0), m_consumed(0), m_spare(nullptr) {
+		m_tail = m_head = new Segment;
+	}
+	
+	~SpscChannel() {
+		while (m_head!=nullptr) {
+			Segment* next = m_head->m_next.load(std::memory_order_relaxed);
+			delete m_head;
+			m_head = next;
+		}
+		delete m_spare.load(std::memory_order_relaxed);
+	}
+	
+	// Producteur
+	void push(const T& item) {
+		write(item);
+		m_published.store(m_written, std::memory_order_seq_cst);
+	}
+	
+	// Producteur: les elements ne deviennent visibles qu'une fois tous ecrits
+	template<class Iterator>
+	void pushBatch(Iterator begin, Iterator end) {
+		for (Iterator it=begin; it!=end; ++it)
+			write(*it);
+		m_published.store(m_written, std::memory_order_seq_cst);
+	}
+	
+	// Consommateur
+	bool pop(T& item) {
+		if (m_read==m_published.load(std::memory_order_acquire))
+			return false;
+		
+		item = read();
+		m_consumed.store(m_read, std::memory_order_seq_cst);
+		return true;
+	}
+	
+	// Consommateur: retire au plus maxItems elements, renvoie le nombre retire
+	size_t popBatch(T* items, size_t maxItems) {
+		size_t count = std::min(m_published.load(std::memory_order_acquire)-m_read, maxItems);
+		for (size_t i=0; i<count; i++)
+			items[i] = read();
+		
+		if (count!=0)
+			m_consumed.store(m_read, std::memory_order_seq_cst);
+		return count;
+	}
+	
+	// N'importe quel thread, valeur approchee
+	size_t size() const {
+		size_t consumed = m_consumed.load(std::memory_order_seq_cst);
+		return m_published.load(std::memory_order_seq_cst)-consumed;
+	}
+	
+	size_t published() const {return m_published.load(std::memory_order_seq_cst);}
+	size_t consumed()  const {return m_consumed.load(std::memory_order_seq_cst);}
+};
+
+// Reveil a la maniere d'un futex: notify ne prend le verrou que si un thread attend.
+// Le thread qui attend appelle prepareWait, reverifie sa condition, puis wait ou cancelWait.
+class EventCount {
+	std::atomic<unsigned int> m_epoch;
+	std::atomic<unsigned int> m_waiters;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t  m_cond;
+	
+	EventCount(const EventCount&) = delete;
+	EventCount& operator=(const EventCount&) = delete;
+	
+public:
+	EventCount() : m_epoch(0), m_waiters(0) {
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init (&m_cond,  NULL);
+	}
+	
+	~EventCount() {
+		pthread_cond_destroy(&m_cond);
+		pthread_mutex_destroy(&m_mutex);
+	}
+	
+	unsigned int prepareWait() {
+		m_waiters.fetch_add(1, std::memory_order_seq_cst);
+		return m_epoch.load(std::memory_order_seq_cst);
+	}
+	
+	void cancelWait() {
+		m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+	}
+	
+	void wait(unsigned int epoch) {
+		pthread_mutex_lock(&m_mutex);
+			while (m_epoch.load(std::memory_order_seq_cst)==epoch)
+				pthread_cond_wait(&m_cond, &m_mutex);
+		pthread_mutex_unlock(&m_mutex);
+		m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+	}
+	
+	void notify() {
+		if (m_waiters.load(std::memory_order_seq_cst)==0) return;
+		
+		pthread_mutex_lock(&m_mutex);
+			m_epoch.fetch_add(1, std::memory_order_seq_cst);
+			pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+};
+
+#endif // __SPSC_CHANNEL_HPP__
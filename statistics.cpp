@@ -0,0 +1,212 @@
+#include "statistics.hpp"
+#include "display_cmd.hpp"
+
+static Statistics globalStatistics;
+static thread_local Statistics* threadStatistics = nullptr;
+static thread_local Statistics::Scope currentScope = Statistics::NO_LEMMA;
+static thread_local Statistics::LemmaScope* currentInvocation = nullptr;
+
+static const char* counterNames[Statistics::NUMBER_OF_COUNTERS] = {
+	"arrowsGenerated", "merges", "crossings", "zeroHandleTransfers", "depthRemovals", "markovRebuilds"
+};
+static const char* scopeNames[Statistics::NUMBER_OF_SCOPES] = {"none", "lemma29", "lemma30"};
+static const char* stepNames[Statistics::NUMBER_OF_STEPS] = {"step1", "step2", "step3", "step4"};
+
+Statistics& statistics() {
+	return (threadStatistics!=nullptr) ? *threadStatistics : globalStatistics;
+}
+
+void setThreadStatistics(Statistics* stats) {
+	threadStatistics = stats;
+}
+
+Statistics::LemmaScope::LemmaScope(Scope scope) : m_previous(currentScope), m_parent(currentInvocation), m_statistics(&statistics()),
+		m_start(std::chrono::steady_clock::now()) {
+	m_record.depth = 0;
+	m_record.scope = scope;
+	m_record.sequence = m_statistics->m_sequence.fetch_add(1, std::memory_order_relaxed)+1;
+	m_record.parent = (m_parent!=nullptr) ? m_parent->m_record.sequence : 0;
+	for (int i=0; i<NUMBER_OF_COUNTERS; i++)
+		m_record.counters[i] = 0;
+	
+	currentScope = scope;
+	currentInvocation = this;
+	m_statistics->countInvocation(scope);
+}
+
+Statistics::LemmaScope::~LemmaScope() {
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-m_start;
+	m_record.time = elapsed.count();
+	m_statistics->addInvocation(m_record);
+	
+	currentInvocation = m_parent;
+	currentScope = m_previous;
+}
+
+Statistics::StepTimer::~StepTimer() {
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-m_start;
+	statistics().m_stepTime[m_step] += elapsed.count();
+}
+
+Statistics::Statistics() : m_sequence(0), m_depthInvocations(0), m_droppedInvocations(0) {
+	pthread_mutex_init(&m_invocationMutex, NULL);
+	clearCurrent();
+}
+
+Statistics::~Statistics() {
+	pthread_mutex_destroy(&m_invocationMutex);
+}
+
+void Statistics::clearCurrent() {
+	for (int i=0; i<NUMBER_OF_SCOPES; i++) {
+		m_invocations[i].store(0, std::memory_order_relaxed);
+		for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+			m_counters[i][j].store(0, std::memory_order_relaxed);
+	}
+	for (int i=0; i<NUMBER_OF_STEPS; i++)
+		m_stepTime[i] = 0.0;
+}
+
+void Statistics::reset() {
+	clearCurrent();
+	m_records.clear();
+	
+	pthread_mutex_lock(&m_invocationMutex);
+		m_invocationRecords.clear();
+		m_depthInvocations = 0;
+		m_droppedInvocations = 0;
+	pthread_mutex_unlock(&m_invocationMutex);
+}
+
+void Statistics::count(Counter counter, unsigned long long n) {
+	m_counters[currentScope][counter].fetch_add(n, std::memory_order_relaxed);
+	if (currentInvocation!=nullptr)
+		currentInvocation->m_record.counters[counter] += n;
+}
+
+void Statistics::addInvocation(const InvocationRecord& record) {
+	pthread_mutex_lock(&m_invocationMutex);
+		if (m_invocationRecords.size()<STATISTICS_MAX_INVOCATIONS)
+			m_invocationRecords.push_back(record);
+		else
+			m_droppedInvocations++;
+	pthread_mutex_unlock(&m_invocationMutex);
+}
+
+void Statistics::endDepth(unsigned int depth) {
+	DepthRecord record;
+	record.depth = depth;
+	for (int i=0; i<NUMBER_OF_SCOPES; i++) {
+		record.invocations[i] = m_invocations[i].load(std::memory_order_relaxed);
+		for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+			record.counters[i][j] = m_counters[i][j].load(std::memory_order_relaxed);
+	}
+	for (int i=0; i<NUMBER_OF_STEPS; i++)
+		record.stepTime[i] = m_stepTime[i];
+	
+	m_records.push_back(record);
+	clearCurrent();
+	
+	// Les appels de la profondeur sont tous termines
+	pthread_mutex_lock(&m_invocationMutex);
+		for (size_t i=m_depthInvocations; i<m_invocationRecords.size(); i++)
+			m_invocationRecords[i].depth = depth;
+		m_depthInvocations = m_invocationRecords.size();
+	pthread_mutex_unlock(&m_invocationMutex);
+}
+
+static void writeInvocationJson(std::ostream& stream, const Statistics::InvocationRecord& record) {
+	stream << "{\"depth\": " << record.depth << ", \"lemma\": \"" << scopeNames[record.scope] << "\", \"sequence\": " << record.sequence <<
+			", \"parent\": " << record.parent << ", \"time\": " << record.time;
+	for (int j=0; j<Statistics::NUMBER_OF_COUNTERS; j++)
+		stream << ", \"" << counterNames[j] << "\": " << record.counters[j];
+	stream << "}";
+}
+
+static void writeDisplayQueueJson(std::ostream& stream, const DisplayQueueMetrics& displayQueue) {
+	stream << "{\"capacity\": " << displayQueue.capacity << ", \"depth\": " << displayQueue.depth << ", \"maxDepth\": " << displayQueue.maxDepth <<
+			", \"pushed\": " << displayQueue.pushed << ", \"processed\": " << displayQueue.processed <<
+			", \"producerWaits\": " << displayQueue.producerWaits << ", \"producerWaitTime\": " << displayQueue.producerWaitTime << "}";
+}
+
+void Statistics::writeJson(std::ostream& stream, const DisplayQueueMetrics* displayQueue) const {
+	stream << "{\"depths\": [";
+	for (size_t r=0; r<m_records.size(); r++) {
+		const DepthRecord& record = m_records[r];
+		stream << ((r==0) ? "\n" : ",\n") << "\t{\"depth\": " << record.depth << ", \"time\": {";
+		for (int i=0; i<NUMBER_OF_STEPS; i++)
+			stream << ((i==0) ? "" : ", ") << "\"" << stepNames[i] << "\": " << record.stepTime[i];
+		stream << "}, \"lemmas\": {";
+		
+		for (int i=0; i<NUMBER_OF_SCOPES; i++) {
+			stream << ((i==0) ? "" : ", ") << "\"" << scopeNames[i] << "\": {\"invocations\": " << record.invocations[i];
+			for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+				stream << ", \"" << counterNames[j] << "\": " << record.counters[i][j];
+			stream << "}";
+		}
+		stream << "}}";
+	}
+	
+	// Les appels d'une profondeur pas encore terminee n'ont pas de profondeur: on ne les ecrit pas
+	stream << "\n], \"droppedInvocations\": " << m_droppedInvocations << ", \"invocations\": [";
+	for (size_t r=0; r<m_depthInvocations; r++) {
+		stream << ((r==0) ? "\n\t" : ",\n\t");
+		writeInvocationJson(stream, m_invocationRecords[r]);
+	}
+	stream << "\n]";
+	
+	if (displayQueue!=nullptr) {
+		stream << ", \"displayQueue\": ";
+		writeDisplayQueueJson(stream, *displayQueue);
+	}
+	stream << "}" << std::endl;
+}
+
+void Statistics::writeCsv(std::ostream& stream) const {
+	stream << "depth";
+	for (int i=0; i<NUMBER_OF_STEPS; i++)
+		stream << "," << stepNames[i] << "Time";
+	for (int i=0; i<NUMBER_OF_SCOPES; i++) {
+		stream << "," << scopeNames[i] << "_invocations";
+		for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+			stream << "," << scopeNames[i] << "_" << counterNames[j];
+	}
+	stream << "\n";
+	
+	for (size_t r=0; r<m_records.size(); r++) {
+		const DepthRecord& record = m_records[r];
+		stream << record.depth;
+		for (int i=0; i<NUMBER_OF_STEPS; i++)
+			stream << "," << record.stepTime[i];
+		for (int i=0; i<NUMBER_OF_SCOPES; i++) {
+			stream << "," << record.invocations[i];
+			for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+				stream << "," << record.counters[i][j];
+		}
+		stream << "\n";
+	}
+	stream.flush();
+}
+
+void Statistics::writeInvocationsCsv(std::ostream& stream) const {
+	stream << "depth,lemma,sequence,parent,time";
+	for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+		stream << "," << counterNames[j];
+	stream << "\n";
+	
+	for (size_t r=0; r<m_depthInvocations; r++) {
+		const InvocationRecord& record = m_invocationRecords[r];
+		stream << record.depth << "," << scopeNames[record.scope] << "," << record.sequence << "," << record.parent << "," << record.time;
+		for (int j=0; j<NUMBER_OF_COUNTERS; j++)
+			stream << "," << record.counters[j];
+		stream << "\n";
+	}
+	stream.flush();
+}
+
+void Statistics::writeDisplayQueueCsv(std::ostream& stream, const DisplayQueueMetrics& displayQueue) {
+	stream << "capacity,depth,maxDepth,pushed,processed,producerWaits,producerWaitTime\n";
+	stream << displayQueue.capacity << "," << displayQueue.depth << "," << displayQueue.maxDepth << "," << displayQueue.pushed << "," <<
+			displayQueue.processed << "," << displayQueue.producerWaits << "," << displayQueue.producerWaitTime << "\n";
+	stream.flush();
+}
@@ -0,0 +1,131 @@
+#ifndef __STATISTICS_HPP__
+#define __STATISTICS_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <ostream>
+
+#include <pthread.h>
+
+// Nombre maximal d'appels de lemmes gardes un par un; les suivants ne sont que comptes dans leur profondeur
+#define STATISTICS_MAX_INVOCATIONS (1 << 20)
+
+struct DisplayQueueMetrics;
+
+// Compteurs de l'algorithme, regroupes par profondeur de la proposition 28 et par lemme en cours,
+// et gardes aussi pour chaque appel d'un lemme
+class Statistics {
+public:
+	enum Counter {
+		ARROWS_GENERATED,
+		MERGES,
+		CROSSINGS,
+		ZERO_HANDLE_TRANSFERS,
+		DEPTH_REMOVALS,
+		MARKOV_REBUILDS,
+		NUMBER_OF_COUNTERS
+	};
+	
+	enum Scope {
+		NO_LEMMA,
+		LEMMA_29,
+		LEMMA_30,
+		NUMBER_OF_SCOPES
+	};
+	
+	enum Step {
+		STEP_1,
+		STEP_2,
+		STEP_3,
+		STEP_4,
+		NUMBER_OF_STEPS
+	};
+	
+	struct DepthRecord {
+		unsigned int depth;
+		unsigned long long invocations[NUMBER_OF_SCOPES];
+		unsigned long long counters[NUMBER_OF_SCOPES][NUMBER_OF_COUNTERS];
+		double stepTime[NUMBER_OF_STEPS]; // En secondes
+	};
+	
+	// Un appel de lemme. Les compteurs ne comprennent pas ceux des appels imbriques.
+	struct InvocationRecord {
+		unsigned int depth;
+		Scope scope;
+		unsigned long long sequence; // Ordre des debuts d'appels
+		unsigned long long parent;   // sequence de l'appel englobant, 0 s'il n'y en a pas
+		unsigned long long counters[NUMBER_OF_COUNTERS];
+		double time; // En secondes, appels imbriques compris
+	};
+	
+	// Attribue les compteurs au lemme le plus interieur en cours sur le thread courant
+	class LemmaScope {
+		Scope m_previous;
+		LemmaScope* m_parent;
+		Statistics* m_statistics;
+		InvocationRecord m_record;
+		std::chrono::steady_clock::time_point m_start;
+		
+		friend Statistics;
+		
+	public:
+		LemmaScope(Scope scope);
+		~LemmaScope();
+	};
+	
+	// Mesure le temps d'une etape de la profondeur courante
+	class StepTimer {
+		Step m_step;
+		std::chrono::steady_clock::time_point m_start;
+		
+	public:
+		StepTimer(Step step) : m_step(step), m_start(std::chrono::steady_clock::now()) {}
+		~StepTimer();
+	};
+	
+private:
+	std::atomic<unsigned long long> m_invocations[NUMBER_OF_SCOPES];
+	std::atomic<unsigned long long> m_counters[NUMBER_OF_SCOPES][NUMBER_OF_COUNTERS];
+	double m_stepTime[NUMBER_OF_STEPS];
+	std::vector<DepthRecord> m_records;
+	
+	// Les deux anses peuvent terminer des appels en meme temps
+	pthread_mutex_t m_invocationMutex;
+	std::atomic<unsigned long long> m_sequence;
+	std::vector<InvocationRecord> m_invocationRecords;
+	size_t m_depthInvocations; // Debut des appels de la profondeur courante dans m_invocationRecords
+	unsigned long long m_droppedInvocations;
+	
+	Statistics(const Statistics&) = delete;
+	Statistics& operator=(const Statistics&) = delete;
+	
+	void clearCurrent();
+	void addInvocation(const InvocationRecord& record);
+	
+public:
+	Statistics();
+	~Statistics();
+	
+	void reset();
+	void count(Counter counter, unsigned long long n=1);
+	void countInvocation(Scope scope) {m_invocations[scope].fetch_add(1, std::memory_order_relaxed);}
+	void endDepth(unsigned int depth);
+	
+	const std::vector<DepthRecord>& getRecords() const {return m_records;}
+	// Appels termines, dans l'ordre de leur fin. A lire lorsqu'aucun lemme ne s'execute.
+	const std::vector<InvocationRecord>& getInvocationRecords() const {return m_invocationRecords;}
+	// displayQueue est nul si la file d'affichage n'est pas exportee
+	void writeJson(std::ostream& stream, const DisplayQueueMetrics* displayQueue = nullptr) const;
+	// Une ligne par profondeur
+	void writeCsv(std::ostream& stream) const;
+	// Une ligne par appel de lemme
+	void writeInvocationsCsv(std::ostream& stream) const;
+	static void writeDisplayQueueCsv(std::ostream& stream, const DisplayQueueMetrics& displayQueue);
+};
+
+// Statistiques du thread courant: celles de sa structure, sinon des statistiques globales
+Statistics& statistics();
+void setThreadStatistics(Statistics* stats);
+
+#endif // __STATISTICS_HPP__
@@ -4,35 +4,49 @@
 class Quad {
 private:
 	RendererGL::PrimitiveData<RendererGL::VertexData> m_primitiveData;
-	RendererGL::VertexData m_data[6];
+	// Les sommets ne sont gardes que par le DrawData
+	float m_x1, m_x2, m_y1, m_y2;
+	// Translations des cotes x1 et x2
+	unsigned int m_translation[2] = {0, 0};
+	
+	void updateData() {
+		RendererGL::VertexData* data = m_primitiveData.editData();
+		if (data==nullptr) return;
+		
+		data[0].setPosition(m_x1, m_y1, m_translation[0]);
+		data[1].setPosition(m_x2, m_y1, m_translation[1]);
+		data[2].setPosition(m_x2, m_y2, m_translation[1]);
+		data[3].setPosition(m_x1, m_y1, m_translation[0]);
+		data[4].setPosition(m_x2, m_y2, m_translation[1]);
+		data[5].setPosition(m_x1, m_y2, m_translation[0]);
+	}
 	
 public:
 	Quad() = default;
 	Quad(Quad&& other) = default;
 	Quad(RendererGL& rendererGL, float x1, float x2, float y1, float y2) 
-			: m_primitiveData(rendererGL), m_data{RendererGL::VertexData(x1, y1), RendererGL::VertexData(x2, y1), RendererGL::VertexData(x2, y2), 				
-				RendererGL::VertexData(x1, y1), RendererGL::VertexData(x2, y2), RendererGL::VertexData(x1, y2)}
+			: m_primitiveData(rendererGL), m_x1(x1), m_x2(x2), m_y1(y1), m_y2(y2)
 	{m_primitiveData.setPrimitiveType(RendererGL::TRIANGLES);}
 	
 	Quad(RendererGL& rendererGL, float x1, float x2, float y1, float y2, const RendererGL::DisplayParam& displayParam) 
-			: m_primitiveData(rendererGL, displayParam), m_data{RendererGL::VertexData(x1, y1), RendererGL::VertexData(x2, y1), RendererGL::VertexData(x2, y2), 				
-				RendererGL::VertexData(x1, y1), RendererGL::VertexData(x2, y2), RendererGL::VertexData(x1, y2)}
+			: m_primitiveData(rendererGL, displayParam), m_x1(x1), m_x2(x2), m_y1(y1), m_y2(y2)
 	{m_primitiveData.setPrimitiveType(RendererGL::TRIANGLES);}
 	
 	Quad& operator=(Quad&& other) = default;
 	
-	void show(RendererGL& rendererGL) {m_primitiveData.setDataWithSize(rendererGL, 6, m_data);}
+	void show(RendererGL& rendererGL) {m_primitiveData.setDataWithSize(rendererGL, 6, nullptr); updateData();}
 	void hide() {m_primitiveData.remove();}
 	void setColor(float red, float green, float blue) {m_primitiveData.setColor(red, green, blue);}
 	void setLayer(int layer) {m_primitiveData.setLayer(layer);}
+	// Les cotes deviennent relatifs aux translations: le quadrilatere s'etire avec elles
+	void setTranslation(unsigned int translation1, unsigned int translation2) {
+		m_translation[0] = translation1; m_translation[1] = translation2;
+		updateData();
+	}
 	void changePoints(float x1, float x2, float y1, float y2) {
-		m_data[0] = RendererGL::VertexData(x1, y1);
-		m_data[1] = RendererGL::VertexData(x2, y1);
-		m_data[2] = RendererGL::VertexData(x2, y2);
-		m_data[3] = RendererGL::VertexData(x1, y1);
-		m_data[4] = RendererGL::VertexData(x2, y2);
-		m_data[5] = RendererGL::VertexData(x1, y2);
-		m_primitiveData.updateData(m_data);
+		m_x1 = x1; m_x2 = x2;
+		m_y1 = y1; m_y2 = y2;
+		updateData();
 	}
 	
 };
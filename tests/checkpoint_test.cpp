@@ -0,0 +1,166 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <list>
+#include <vector>
+#include <cstdio>
+
+#include "io.hpp"
+#include "matrix.hpp"
+#include "zero_handle.hpp"
+#include "display_cmd.hpp"
+#include "cancellation.hpp"
+
+// Aller-retour d'un point de reprise en binaire, et reprise de la proposition 28 depuis un point de reprise
+
+#define CHECKPOINT_TEST_FILE "checkpoint_test.ckpt"
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+	if (!condition) {
+		std::cout << "FAIL: " << what << std::endl;
+		failures++;
+	}
+}
+
+// Structure de profondeur finie: la proposition 28 y fait plusieurs profondeurs
+static const char* structure =
+	"entries\n"
+	"3 14\n"
+	"0 13 01\n1 11 01\n2 4 01\n3 7 01\n4 2 10\n5 9 01\n6 12 01\n"
+	"7 3 10\n8 10 01\n9 5 10\n10 8 10\n11 1 10\n12 6 10\n13 0 10\n";
+
+static void addArrows(std::list<Arrow>& arrows, unsigned int numberOfTracks, unsigned int count) {
+	if (numberOfTracks<2) return;
+	
+	unsigned int seed = 12345678;
+	for (unsigned int k=0; k<count; k++) {
+		seed = seed*1103515245 + 12345;
+		unsigned int i = (seed>>16)%numberOfTracks;
+		seed = seed*1103515245 + 12345;
+		unsigned int j = (i+1+(seed>>16)%(numberOfTracks-1))%numberOfTracks;
+		arrows.push_back(Arrow(i, j));
+	}
+}
+
+static bool sameArrows(const std::list<Arrow>& a, const std::list<Arrow>& b) {
+	if (a.size()!=b.size()) return false;
+	for (auto itA=a.begin(), itB=b.begin(); itA!=a.end(); ++itA, ++itB) {
+		if (itA->begin()!=itB->begin() || itA->end()!=itB->end()) return false;
+	}
+	return true;
+}
+
+static bool sameHandle(const OneHandle::Checkpoint& a, const OneHandle::Checkpoint& b) {
+	return a.prePermutation==b.prePermutation && a.permutation==b.permutation && a.postPermutation==b.postPermutation &&
+			sameArrows(a.arrows0, b.arrows0) && sameArrows(a.arrows1, b.arrows1);
+}
+
+static bool sameCheckpoint(const ZeroHandle::Checkpoint& a, const ZeroHandle::Checkpoint& b) {
+	if (a.k!=b.k || a.depth!=b.depth || a.matrix.size()!=b.matrix.size()) return false;
+	for (unsigned int i=0; i<a.matrix.size(); i++) {
+		for (unsigned int j=0; j<a.matrix.size(); j++) {
+			if (!(a.matrix(i, j)==b.matrix(i, j))) return false;
+		}
+	}
+	return sameHandle(a.voidHandle, b.voidHandle) && sameHandle(a.fullHandle, b.fullHandle);
+}
+
+static ZeroHandle* resume(ZeroHandle::Checkpoint&& checkpoint) {
+	std::list<std::pair<unsigned int, unsigned int>> voidArrowsData, fullArrowsData;
+	std::list<ArrowBox::ArrowInArrowBox*> voidArrowsPtr, fullArrowsPtr;
+	return new ZeroHandle(std::move(checkpoint), voidArrowsData, voidArrowsPtr, fullArrowsData, fullArrowsPtr);
+}
+
+int main() {
+	// Les commandes d'affichage sont gardees sans etre executees
+	DisplayContext display;
+	display.setQueueCapacity(0);
+	setDisplayContext(&display);
+	
+	std::pair<FUMatrix, unsigned int> parsed;
+	std::istringstream structureStream(structure);
+	structureStream >> parsed;
+	const unsigned int k = parsed.second;
+	FUMatrix& matrix = parsed.first;
+	check(matrix.size()==14, "the test structure is read");
+	
+	std::list<Arrow> voidArrows, fullArrows;
+	std::list<std::pair<unsigned int, unsigned int>> voidArrowsData, fullArrowsData;
+	std::list<ArrowBox::ArrowInArrowBox*> voidArrowsPtr, fullArrowsPtr;
+	lemma23(matrix, k, voidArrows, fullArrows);
+	addArrows(fullArrows, k, 40);
+	addArrows(voidArrows, matrix.size()/2-k, 40);
+	ZeroHandle zeroHandle(k, matrix, std::move(voidArrows), std::move(fullArrows), voidArrowsData, voidArrowsPtr, fullArrowsData, fullArrowsPtr);
+	
+	// Ecriture puis lecture
+	ZeroHandle::Checkpoint initial = zeroHandle.getCheckpoint(zeroHandle.getDepth());
+	std::stringstream stream;
+	writeCheckpointBinary(stream, initial);
+	ZeroHandle::Checkpoint read;
+	readCheckpointBinary(stream, read);
+	check(!stream.fail(), "a written checkpoint can be read back");
+	check(sameCheckpoint(initial, read), "the checkpoint read back is the one written");
+	
+	// Un point de reprise tronque ou corrompu est refuse
+	std::string bytes = stream.str();
+	std::istringstream truncated(bytes.substr(0, bytes.size()-1));
+	ZeroHandle::Checkpoint invalid;
+	readCheckpointBinary(truncated, invalid);
+	check(truncated.fail(), "a truncated checkpoint is rejected");
+	
+	std::string corruptedBytes = bytes;
+	corruptedBytes[0] ^= 0xff;
+	std::istringstream corrupted(corruptedBytes);
+	readCheckpointBinary(corrupted, invalid);
+	check(corrupted.fail(), "a checkpoint with a wrong magic number is rejected");
+	
+	// La structure reprise est identique a l'originale et la proposition 28 y aboutit au meme resultat
+	ZeroHandle* resumed = resume(std::move(read));
+	check(resumed->getDepth()==zeroHandle.getDepth(), "the resumed structure has the same depth");
+	check(sameCheckpoint(resumed->getCheckpoint(initial.depth), initial), "the resumed structure has the same arrows and permutations");
+	
+	// Un arret avant la fin de la premiere profondeur laisse l'etat initial comme derniere profondeur terminee
+	ZeroHandle* interrupted = resume(zeroHandle.getCheckpoint(initial.depth));
+	ZeroHandle::Checkpoint completed;
+	CancellationToken token;
+	token.request();
+	setCancellationToken(&token);
+	bool cancelled = false;
+	try {
+		interrupted->proposition28(std::string(), &completed);
+	} catch (const WorkCancelled&) {
+		cancelled = true;
+	}
+	setCancellationToken(nullptr);
+	check(cancelled, "proposition 28 stops when cancelled");
+	check(sameCheckpoint(completed, initial), "the last completed depth is kept when proposition 28 stops");
+	delete interrupted;
+	
+	std::remove(CHECKPOINT_TEST_FILE);
+	zeroHandle.proposition28(CHECKPOINT_TEST_FILE);
+	resumed->proposition28(std::string(), &completed);
+	
+	unsigned int finalDepth = zeroHandle.getDepth();
+	ZeroHandle::Checkpoint finalState = zeroHandle.getCheckpoint(finalDepth);
+	check(sameCheckpoint(resumed->getCheckpoint(finalDepth), finalState), "proposition 28 ends in the same state after a resume");
+	check(sameCheckpoint(completed, finalState), "the last completed depth is the final state");
+	
+	// Le dernier point de reprise ecrit par la proposition 28 est l'etat final
+	std::ifstream file(CHECKPOINT_TEST_FILE, std::ios::binary);
+	ZeroHandle::Checkpoint written;
+	readCheckpointBinary(file, written);
+	check(!file.fail(), "proposition 28 writes a readable checkpoint");
+	check(sameCheckpoint(written, finalState), "the last checkpoint written is the final state");
+	file.close();
+	std::remove(CHECKPOINT_TEST_FILE);
+	
+	delete resumed;
+	setDisplayContext(nullptr);
+	
+	if (failures==0)
+		std::cout << "checkpoint_test: OK" << std::endl;
+	return (failures==0) ? 0 : 1;
+}
@@ -95,6 +95,14 @@ public:
 		m_line.changePoints(p0x, p0y, p1x, p1y);
 	}
 	
+	void startAnimation(float p0x0, float p0y0, float p1x0, float p1y0, float p0x1, float p0y1, float p1x1, float p1y1, unsigned int animation) {
+		m_line.setAnimatedPoints(p0x0, p0y0, p1x0, p1y0);
+		m_line.startAnimation(Line(p0x1, p0y1, p1x1, p1y1), animation);
+	}
+	
+	void setAnimatedPoints(float p0x, float p0y, float p1x, float p1y) {m_line.setAnimatedPoints(p0x, p0y, p1x, p1y);}
+	void stopAnimation() {m_line.stopAnimation();}
+	
 	TrackLine& operator=(TrackLine&& other) {
 		m_line = std::move(other.m_line);
 		return *this;
@@ -1,4 +1,5 @@
 #include <fstream>
+#include <iostream>
 
 #include <gtkmm/filechooserdialog.h>
 #include <gtkmm/builder.h>
@@ -12,47 +13,121 @@ Glib::RefPtr<TrainTracksApp> TrainTracksApp::create(Glib::RefPtr<TrainTracksApp>
 }
 
 TrainTracksApp::TrainTracksApp(Glib::RefPtr<TrainTracksApp>& self) : Gtk::Application("ca.usherbrooke.math.lwatson.train_tracks",
-		Gio::APPLICATION_FLAGS_NONE), m_self(self) {}
+		Gio::APPLICATION_FLAGS_NONE), m_self(self), m_timeBudget(0.0), m_memoryBudget(0), m_displayQueueCapacity(-1), m_frameBudget(-1.0) {
+	add_main_option_entry(Gio::Application::OPTION_TYPE_FILENAME, "checkpoint", 'c',
+			"Write a checkpoint at the end of each depth of proposition 28", "FILE");
+	add_main_option_entry(Gio::Application::OPTION_TYPE_FILENAME, "resume", 'r', "Resume proposition 28 from a checkpoint", "FILE");
+	add_main_option_entry(Gio::Application::OPTION_TYPE_FILENAME, "statistics", 's',
+			"Export the statistics after each run of proposition 28 (JSON, or CSV if FILE ends with .csv)", "FILE");
+	add_main_option_entry(Gio::Application::OPTION_TYPE_DOUBLE, "time-budget", 't',
+			"Stop proposition 28 after SECONDS and keep the last completed depth", "SECONDS");
+	add_main_option_entry(Gio::Application::OPTION_TYPE_INT, "memory-budget", 'm',
+			"Stop proposition 28 when the process uses more than MB megabytes and keep the last completed depth", "MB");
+	add_main_option_entry(Gio::Application::OPTION_TYPE_INT, "display-queue", 'q',
+			"Number of display commands the worker may queue before waiting (0 for no limit)", "N");
+	add_main_option_entry(Gio::Application::OPTION_TYPE_DOUBLE, "frame-budget", 'b',
+			"Time spent at most per frame on display commands (at least one command runs per frame)", "MS");
+	signal_handle_local_options().connect(sigc::mem_fun(*this, &TrainTracksApp::handleLocalOptions), false);
+}
+
+int TrainTracksApp::handleLocalOptions(const Glib::RefPtr<Glib::VariantDict>& options) {
+	options->lookup_value("checkpoint", m_checkpointPath);
+	options->lookup_value("resume", m_resumePath);
+	options->lookup_value("statistics", m_statisticsPath);
+	options->lookup_value("time-budget", m_timeBudget);
+	options->lookup_value("memory-budget", m_memoryBudget);
+	options->lookup_value("display-queue", m_displayQueueCapacity);
+	options->lookup_value("frame-budget", m_frameBudget);
+	if (m_timeBudget<0.0 || m_memoryBudget<0) {
+		std::cerr << "Budgets must be positive" << std::endl;
+		return 1;
+	}
+	return -1; // Le demarrage continue normalement
+}
+
+TrainTracksAppWindow* TrainTracksApp::createWindow() {
+	Glib::RefPtr<Gtk::Builder> builder(Gtk::Builder::create_from_resource("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_app_window.ui"));
+	Glib::RefPtr<TrainTracksAppWindow> window(TrainTracksAppWindow::create(builder, *this));
+	window->set_application(m_self);
+	if (m_timeBudget>0.0 || m_memoryBudget>0)
+		window->setWorkBudget(m_timeBudget, static_cast<size_t>(m_memoryBudget)*1024*1024);
+	if (m_displayQueueCapacity>=0)
+		window->setDisplayQueueCapacity(static_cast<size_t>(m_displayQueueCapacity));
+	if (m_frameBudget>=0.0)
+		window->setFrameBudget(m_frameBudget/1000.0);
+	m_windows.push_back(window);
+	return window.operator->();
+}
 
 void TrainTracksApp::on_activate() {
 	Gio::Application::on_activate();
 	
-	if (!m_window) {
-		Glib::RefPtr<Gtk::Builder> builder(Gtk::Builder::create_from_resource("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_app_window.ui"));
-		m_window = TrainTracksAppWindow::create(builder, *this);
-		m_window->set_application(m_self);
+	if (m_windows.empty()) {
+		TrainTracksAppWindow* window = createWindow();
+		if (!m_checkpointPath.empty())
+			window->setCheckpointFile(m_checkpointPath);
+		if (!m_resumePath.empty())
+			window->resumeFromCheckpoint(m_resumePath);
+		window->setStatisticsFile(m_statisticsPath);
 	}
 	
-	m_window->present();
+	m_windows.front()->present();
 }
 
 void TrainTracksApp::on_startup() {
 	Gio::Application::on_startup();
 	
+	initWorker();
+	
 	add_action("quit", sigc::mem_fun(*this, &TrainTracksApp::quitActivated));
 	add_action("open", sigc::mem_fun(*this, &TrainTracksApp::openActivated));
+	add_action("checkpoint", sigc::mem_fun(*this, &TrainTracksApp::checkpointActivated));
+	add_action("resume", sigc::mem_fun(*this, &TrainTracksApp::resumeActivated));
+	add_action("statistics", sigc::mem_fun(*this, &TrainTracksApp::statisticsActivated));
 	
 	Glib::RefPtr<Gtk::Builder> builder = Gtk::Builder::create_from_resource("/ca/usherbrooke/math/lwatson/train_tracks/train_tracks_app_menu.ui");
 	Glib::RefPtr<Gio::MenuModel> app_menu(Glib::RefPtr<Gio::MenuModel>::cast_dynamic(builder->get_object("appmenu")));
 	set_app_menu(app_menu);
 }
 
+void TrainTracksApp::on_shutdown() {
+	stopWorker();
+	
+	Gio::Application::on_shutdown();
+}
+
 void TrainTracksApp::quitActivated() {
 	quit();
 }
 
-void TrainTracksApp::openActivated() {
-	if (!m_window) return;
-	
+std::string TrainTracksApp::chooseFile(const Glib::ustring& title, Gtk::FileChooserAction action, const Glib::ustring& acceptLabel) {
 	std::string filename;
-	Gtk::FileChooserDialog dialog(*get_active_window(), "Open File", Gtk::FILE_CHOOSER_ACTION_OPEN);
+	Gtk::FileChooserDialog dialog(*get_active_window(), title, action);
 	dialog.add_button("_Cancel", Gtk::RESPONSE_CANCEL);
-	dialog.add_button("_Open", Gtk::RESPONSE_OK);
+	dialog.add_button(acceptLabel, Gtk::RESPONSE_OK);
+	if (action==Gtk::FILE_CHOOSER_ACTION_SAVE)
+		dialog.set_do_overwrite_confirmation(true);
 	int res = dialog.run();
 	if (res == Gtk::RESPONSE_OK) {
 		filename = dialog.get_filename();
 	}
+	return filename;
+}
+
+TrainTracksAppWindow* TrainTracksApp::getWindowForStructure(TrainTracksAppWindow* window) {
+	// La structure deja chargee reste ouverte pour pouvoir les comparer
+	if (window->hasStructure()) {
+		window = createWindow();
+		window->present();
+	}
+	return window;
+}
+
+void TrainTracksApp::openActivated() {
+	TrainTracksAppWindow* window = dynamic_cast<TrainTracksAppWindow*>(get_active_window());
+	if (window==nullptr) return;
 	
+	std::string filename = chooseFile("Open File", Gtk::FILE_CHOOSER_ACTION_OPEN, "_Open");
 	if (!filename.empty()) {
 		std::ifstream file;
 		file.open(filename.c_str());
@@ -65,9 +140,38 @@ void TrainTracksApp::openActivated() {
 		file.close();
 		
 		if (fail && k<mat.size()) {
-			postSetStructure(k, std::move(mat));
+			getWindowForStructure(window)->setStructure(k, std::move(mat));
 		} else {
 			std::cout << "Impossible de lire les donnees." << std::endl;
 		}
 	}
 }
+
+// Les points de reprise de la structure de la fenetre active seront ecrits dans ce fichier
+void TrainTracksApp::checkpointActivated() {
+	TrainTracksAppWindow* window = dynamic_cast<TrainTracksAppWindow*>(get_active_window());
+	if (window==nullptr) return;
+	
+	std::string filename = chooseFile("Write Checkpoints To", Gtk::FILE_CHOOSER_ACTION_SAVE, "_Select");
+	if (!filename.empty())
+		window->setCheckpointFile(filename);
+}
+
+void TrainTracksApp::resumeActivated() {
+	TrainTracksAppWindow* window = dynamic_cast<TrainTracksAppWindow*>(get_active_window());
+	if (window==nullptr) return;
+	
+	std::string filename = chooseFile("Resume From Checkpoint", Gtk::FILE_CHOOSER_ACTION_OPEN, "_Resume");
+	if (!filename.empty())
+		getWindowForStructure(window)->resumeFromCheckpoint(filename);
+}
+
+// Ecrit apres le travail en cours sur la structure de la fenetre active
+void TrainTracksApp::statisticsActivated() {
+	TrainTracksAppWindow* window = dynamic_cast<TrainTracksAppWindow*>(get_active_window());
+	if (window==nullptr) return;
+	
+	std::string filename = chooseFile("Export Statistics", Gtk::FILE_CHOOSER_ACTION_SAVE, "_Export");
+	if (!filename.empty())
+		window->exportStatistics(filename);
+}
@@ -1,26 +1,49 @@
 #ifndef __TRAIN_TRACKS_APP_HPP__
 #define __TRAIN_TRACKS_APP_HPP__
 
+#include <vector>
+#include <string>
+
 #include <gtkmm/application.h>
+#include <gtkmm/filechooser.h>
+#include <glibmm/variantdict.h>
 
 #include "train_tracks_app_window.hpp"
 
 class TrainTracksApp final : public Gtk::Application {
 	Glib::RefPtr<TrainTracksApp>& m_self;
-	Glib::RefPtr<TrainTracksAppWindow> m_window;
+	std::vector<Glib::RefPtr<TrainTracksAppWindow>> m_windows; // Une fenetre par structure
+	// Options de la ligne de commande, appliquees a la premiere fenetre
+	std::string m_checkpointPath;
+	std::string m_resumePath;
+	std::string m_statisticsPath;
+	// Budget du travail de chaque fenetre, 0 pour aucune limite
+	double m_timeBudget;
+	int m_memoryBudget; // En Mo
+	int m_displayQueueCapacity; // Negative pour garder la capacite par defaut, 0 pour une file non bornee
+	double m_frameBudget; // En millisecondes, negatif pour garder le budget par defaut
 	
 public:
 	static Glib::RefPtr<TrainTracksApp> create(Glib::RefPtr<TrainTracksApp>& self);
-	Glib::RefPtr<TrainTracksAppWindow>& getWindow() {return m_window;}
-	const Glib::RefPtr<TrainTracksAppWindow>& getWindow() const {return m_window;}
+	const std::vector<Glib::RefPtr<TrainTracksAppWindow>>& getWindows() const {return m_windows;}
 	
 private:
 	TrainTracksApp(Glib::RefPtr<TrainTracksApp>& self);
 	
+	TrainTracksAppWindow* createWindow();
 	virtual void on_activate() override;
 	virtual void on_startup() override;
+	virtual void on_shutdown() override;
+	int handleLocalOptions(const Glib::RefPtr<Glib::VariantDict>& options);
+	// Chemin choisi, vide si l'utilisateur annule
+	std::string chooseFile(const Glib::ustring& title, Gtk::FileChooserAction action, const Glib::ustring& acceptLabel);
+	// Fenetre ou afficher une nouvelle structure: la fenetre active si elle est vide, une nouvelle sinon
+	TrainTracksAppWindow* getWindowForStructure(TrainTracksAppWindow* window);
 	void quitActivated();
 	void openActivated();
+	void checkpointActivated();
+	void resumeActivated();
+	void statisticsActivated();
 };
 
 #endif // __TRAIN_TRACKS_APP_HPP__
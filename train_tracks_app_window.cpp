@@ -14,6 +14,7 @@
 #include "train_tracks_error.hpp"
 #include "worker_thread.hpp"
 #include "display_cmd.hpp"
+#include "curves.hpp"
 #include "color.hpp"
 #include "util.hpp"
 
@@ -26,7 +27,7 @@ Glib::RefPtr<TrainTracksAppWindow> TrainTracksAppWindow::create(Glib::RefPtr<Gtk
 }
 
 TrainTracksAppWindow::TrainTracksAppWindow(BaseObjectType* cobj, const Glib::RefPtr<Gtk::Builder>& builder, const TrainTracksApp& app) : Gtk::ApplicationWindow(cobj),
-		m_app(app), m_speed(55), m_mousePressed(false) {
+		m_context(new StructureContext), m_app(app), m_speed(55), m_mousePressed(false) {
 	builder->get_widget("gl_drawing_area", m_glDrawingArea);
 	builder->get_widget("play_button", m_playButton);
 	m_speedAdjustment = Glib::RefPtr<Gtk::Adjustment>::cast_dynamic((builder->get_object("speed_adjustment")));
@@ -50,6 +51,52 @@ TrainTracksAppWindow::TrainTracksAppWindow(BaseObjectType* cobj, const Glib::Ref
 
 TrainTracksAppWindow::~TrainTracksAppWindow() {
 	if (m_drawConnection) m_drawConnection.disconnect();
+	delete m_context;
+}
+
+bool TrainTracksAppWindow::hasStructure() const {
+	return m_context!=nullptr && m_context->hasStructure();
+}
+
+void TrainTracksAppWindow::setStructure(unsigned int k, FUMatrix&& matrix) {
+	if (m_context==nullptr)
+		m_context = new StructureContext;
+	m_context->postSetStructure(k, std::move(matrix));
+}
+
+void TrainTracksAppWindow::setCheckpointFile(const std::string& path) {
+	if (m_context==nullptr)
+		m_context = new StructureContext;
+	m_context->postSetCheckpointFile(path);
+}
+
+void TrainTracksAppWindow::resumeFromCheckpoint(const std::string& path) {
+	if (m_context==nullptr)
+		m_context = new StructureContext;
+	m_context->postResumeFromCheckpoint(path);
+}
+
+void TrainTracksAppWindow::exportStatistics(const std::string& path) {
+	if (m_context!=nullptr)
+		m_context->postExportStatistics(path);
+}
+
+void TrainTracksAppWindow::setWorkBudget(double seconds, size_t memory) {
+	if (m_context==nullptr)
+		m_context = new StructureContext;
+	m_context->postSetWorkBudget(seconds, memory);
+}
+
+void TrainTracksAppWindow::setDisplayQueueCapacity(size_t capacity) {
+	if (m_context==nullptr)
+		m_context = new StructureContext;
+	m_context->getDisplay().setQueueCapacity(capacity);
+}
+
+void TrainTracksAppWindow::setFrameBudget(double seconds) {
+	if (m_context==nullptr)
+		m_context = new StructureContext;
+	m_context->getDisplay().setFrameBudget(seconds);
 }
 
 void TrainTracksAppWindow::glInit() {
@@ -87,10 +134,13 @@ void TrainTracksAppWindow::glInit() {
 		
 		glLineWidth(1.0);
 		glEnable(GL_LINE_SMOOTH);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
 		m_programsGL = ProgramsGL(0);
 		m_rendererGL = RendererGL(m_programsGL);
 		
-		initWorker();
+		if (m_context==nullptr)
+			m_context = new StructureContext;
 		updateTargetFrameRate();
 		glInited = true;
 	} catch (Glib::Error& err) {
@@ -109,7 +159,9 @@ void TrainTracksAppWindow::glFini() {
 	m_glDrawingArea->make_current();
 	
 	if (m_drawConnection) m_drawConnection.disconnect();
-	stopWorker();
+	// Le rendu de la structure utilise le contexte OpenGL courant
+	delete m_context;
+	m_context = nullptr;
 	
 	try {
 		m_glDrawingArea->throw_if_error();
@@ -128,12 +180,13 @@ bool TrainTracksAppWindow::glDraw(const Glib::RefPtr<Gdk::GLContext>& context) {
 	* the GtkGLArea gets a new size allocation
 	*/
 	glClearColor(backgroundColor.r, backgroundColor.g, backgroundColor.b, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
 	double frame_time = m_timer.elapsed();
 	
 	// draw
-	processDisplayCommand(m_rendererGL, m_speed*m_speed * (frame_time-m_lastFrameTime)/50.0);
+	m_context->getDisplay().process(m_rendererGL, m_speed*m_speed * (frame_time-m_lastFrameTime)/50.0);
+	m_rendererGL.updateLevelOfDetail();
 	m_rendererGL.draw();
 	
 	// flush the contents of the pipeline 
@@ -192,14 +245,20 @@ bool TrainTracksAppWindow::on_drag_motion(const Glib::RefPtr<Gdk::DragContext>&
 
 void TrainTracksAppWindow::speedChanged() {
 	m_speed = m_speedAdjustment->get_value();
+	// A la vitesse maximale, on saute directement d'une etape de l'algorithme a la suivante
+	if (m_context!=nullptr)
+		m_context->getDisplay().setFastForward(m_speed >= m_speedAdjustment->get_upper());
 }
 
 void TrainTracksAppWindow::playToggled() {
 	bool toggled = m_playButton->get_active();
 	
-	if (toggled)
+	if (toggled && m_context!=nullptr)
 	{
-		postOnPlay();
+		m_context->postOnPlay();
+		// Execute apres la proposition 28, meme si elle est interrompue
+		if (!m_statisticsPath.empty())
+			m_context->postExportStatistics(m_statisticsPath);
 	}
 	else
 	{
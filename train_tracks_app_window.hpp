@@ -8,17 +8,21 @@
 #include <gtkmm/adjustment.h>
 #include <gtkmm/builder.h>
 #include <gdkmm/event.h>
+#include <string>
 
 #include "prog_gl.hpp"
 #include "draw_gl.hpp"
+#include "matrix.hpp"
 
 class TrainTracksApp;
+class StructureContext;
 
 extern bool glInited;
 
 class TrainTracksAppWindow final : public Gtk::ApplicationWindow {
 	ProgramsGL m_programsGL;
 	RendererGL m_rendererGL;
+	StructureContext*				m_context;
 	const TrainTracksApp&			m_app;
 	Gtk::GLArea*					m_glDrawingArea;
 	Gtk::ToggleButton*				m_playButton;
@@ -28,6 +32,7 @@ class TrainTracksAppWindow final : public Gtk::ApplicationWindow {
 	double							m_lastFrameTime;
 	double							m_mouseX;
 	double							m_mouseY;
+	std::string						m_statisticsPath; // Vide si les statistiques ne sont pas exportees apres chaque execution
 	float							m_speed;
 	int								m_tickCallbackId;
 	bool							m_mousePressed;
@@ -39,6 +44,19 @@ public:
 	~TrainTracksAppWindow();
 	static Glib::RefPtr<TrainTracksAppWindow> create(Glib::RefPtr<Gtk::Builder>& builder, const TrainTracksApp& app);
 	
+	bool hasStructure() const;
+	void setStructure(unsigned int k, FUMatrix&& matrix);
+	void setCheckpointFile(const std::string& path);
+	void resumeFromCheckpoint(const std::string& path);
+	void exportStatistics(const std::string& path);
+	void setStatisticsFile(const std::string& path) {m_statisticsPath = path;}
+	// Secondes et octets par execution, 0 pour aucune limite
+	void setWorkBudget(double seconds, size_t memory);
+	// 0 pour une file non bornee
+	void setDisplayQueueCapacity(size_t capacity);
+	// En secondes
+	void setFrameBudget(double seconds);
+	
 private:
 	void glInit();
 	void glFini();
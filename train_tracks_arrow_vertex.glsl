@@ -0,0 +1,59 @@
+#version 330
+
+// Une instance par fleche: p0, c0, c1, p1 et le vecteur de la pointe, au depart et a l'arrivee de l'animation
+in vec4 arrowBegin;
+in vec4 arrowEnd;
+in vec2 arrowTip;
+in vec4 arrowTargetBegin;
+in vec4 arrowTargetEnd;
+in vec2 arrowTargetTip;
+in float arrowAnimation;
+in vec3 arrowColor;
+in float arrowLayer;
+in float arrowTranslation;
+uniform mat4 matrix;
+uniform float animationTime[64]; // ANIMATION_GROUPS, le groupe 0 est toujours au temps 0
+uniform int numStep;
+uniform vec2 translation[16]; // BOX_TRANSLATIONS, la translation 0 est toujours nulle
+uniform vec3 translationShift[16]; // Plage [x, y) des fleches fixes de la translation, decalees de z
+
+out vec3 fragmentColor;
+
+const float layerCount = 64.0; // RENDER_LAYERS
+
+void main() {
+  fragmentColor = arrowColor;
+  
+  float time = animationTime[int(arrowAnimation)];
+  vec4 begin = mix(arrowBegin, arrowTargetBegin, time);
+  vec4 end   = mix(arrowEnd,   arrowTargetEnd,   time);
+  vec2 tip   = mix(arrowTip,   arrowTargetTip,   time);
+  
+  vec2 p0 = begin.xy;
+  vec2 c0 = begin.zw;
+  vec2 c1 = end.xy;
+  vec2 p1 = end.zw;
+  vec2 position;
+  
+  if (gl_VertexID < 2*numStep) {
+    // Segments [i/numStep, (i+1)/numStep] du corps
+    float t = float((gl_VertexID+1)/2)/float(numStep);
+    float s = 1.0-t;
+    position = s*s*s*p0 + 3.0*t*s*s*c0 + 3.0*t*t*s*c1 + t*t*t*p1;
+  } else {
+    int i = gl_VertexID - 2*numStep;
+    if (i==1)
+      position = p1 + vec2(tip.x-tip.y, tip.y+tip.x);
+    else if (i==3)
+      position = p1 + vec2(tip.x+tip.y, tip.y-tip.x);
+    else
+      position = p1;
+  }
+  
+  // Les points sont relatifs a la boite de la fleche
+  vec2 offset = translation[int(arrowTranslation)];
+  vec3 shift = translationShift[int(arrowTranslation)];
+  if (arrowAnimation==0.0 && arrowBegin.x>=shift.x && arrowBegin.x<shift.y)
+    offset.x += shift.z;
+  gl_Position = matrix * vec4(position + offset, -arrowLayer/layerCount, 1.0);
+}
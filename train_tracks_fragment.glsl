@@ -1,9 +1,9 @@
 #version 330
 
-uniform vec3 vertexColor;
+in vec3 fragmentColor;
 
 out vec4 outputColor;
 
 void main() {
-  outputColor = vec4(vertexColor, 1.0);
+  outputColor = vec4(fragmentColor, 1.0);
 }
@@ -1,8 +1,22 @@
 #version 330
 
 in vec2 position;
+in vec2 target;
+in float animation;
+in vec3 color;
+in float layer;
+in float vertexTranslation;
 uniform mat4 matrix;
+uniform float animationTime[64]; // ANIMATION_GROUPS, le groupe 0 est toujours au temps 0
+uniform vec2 translation[16]; // BOX_TRANSLATIONS, la translation 0 est toujours nulle
+
+out vec3 fragmentColor;
+
+const float layerCount = 64.0; // RENDER_LAYERS
 
 void main() {
-  gl_Position = matrix * vec4(position, 0.0, 1.0);
+  fragmentColor = color;
+  // Les couches superieures sont plus proches
+  vec2 offset = translation[int(vertexTranslation)];
+  gl_Position = matrix * vec4(mix(position, target, animationTime[int(animation)]) + offset, -layer/layerCount, 1.0);
 }
@@ -1,12 +1,19 @@
 #include <iostream>
 #include <cstddef>
-#include <queue>
 #include <string>
+#include <atomic>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <set>
+#include <algorithm>
+#include <random>
 
 #include <cstdlib>
 #include <ctime>
 
 #include <pthread.h>
+#include <unistd.h>
 
 #include "worker_thread.hpp"
 #include "command.hpp"
@@ -14,25 +21,38 @@
 #include "zero_handle.hpp"
 #include "display_cmd.hpp"
 #include "arrow.hpp"
+#include "io.hpp"
+#include "statistics.hpp"
+#include "cancellation.hpp"
+#include "spsc_channel.hpp"
 
-static ZeroHandle* zeroHandle = nullptr;
+// Nombre maximal de threads de travail
+#define MAX_WORKER_THREADS 64
 
-struct worker_thread_arg_t {
-	pthread_mutex_t init_mutex;
-	pthread_cond_t  init_cond;
-	bool worker_done_init;
+// Commandes qui remplacent zeroHandle ou travaillent dessus.
+// Elles sont abandonnees si une nouvelle structure a ete demandee depuis leur envoi.
+class StructureCommand : public Command<StructureContext&> {
+	unsigned int m_generation;
+	
+protected:
+	StructureCommand(unsigned int generation) : m_generation(generation) {}
+	
+public:
+	unsigned int getGeneration() const {return m_generation;}
 };
 
-class SetStructureCommand : public Command<> {
+class SetStructureCommand : public StructureCommand {
 	unsigned int k_m;
 	FUMatrix mat;
 	
-	SetStructureCommand(unsigned int k, FUMatrix&& matrix) : k_m(k), mat(matrix) {}
+	SetStructureCommand(unsigned int generation, unsigned int k, FUMatrix&& matrix) : StructureCommand(generation), k_m(k), mat(matrix) {}
 	
 public:
-	static Command<>* create(unsigned int k, FUMatrix&& matrix) {return new SetStructureCommand(k, std::move(matrix));}
+	static Command<StructureContext&>* create(unsigned int generation, unsigned int k, FUMatrix&& matrix) {
+		return new SetStructureCommand(generation, k, std::move(matrix));
+	}
 	
-	virtual void run() {
+	virtual void run(StructureContext& context) {
 		std::list<Arrow> voidArrows;
 		std::list<Arrow> fullArrows;
 		std::list<std::pair<unsigned int, unsigned int>> voidArrowsData;
@@ -40,8 +60,7 @@ public:
 		std::list<std::pair<unsigned int, unsigned int>> fullArrowsData;
 		std::list<ArrowBox::ArrowInArrowBox*> fullArrowsPtr;
 		
-		if (zeroHandle!=nullptr)
-			postDeleteZeroHandle(*zeroHandle);
+		context.discardZeroHandle();
 		
 		try {
 			lemma23(mat, k_m, voidArrows, fullArrows);
@@ -50,13 +69,14 @@ public:
 			return;
 		}
 		
-		srand(12345678);
+		// Generateur propre a la commande: les structures chargees en meme temps ne se le partagent pas
+		std::mt19937 generator(12345678);
 		unsigned int num_track = k_m;
 		for (int k=0; k<100; k++) {
 			unsigned int i, j;
-			i = rand()%num_track;
+			i = generator()%num_track;
 			do {
-				j = rand()%num_track;
+				j = generator()%num_track;
 			} while(i==j);
 			fullArrows.push_back(Arrow(i, j));
 		}
@@ -64,9 +84,9 @@ public:
 		num_track = mat.size()/2-k_m;
 		for (int k=0; k<100; k++) {
 			unsigned int i, j;
-			i = rand()%num_track;
+			i = generator()%num_track;
 			do {
-				j = rand()%num_track;
+				j = generator()%num_track;
 			} while(i==j);
 			voidArrows.push_back(Arrow(i, j));
 		}
@@ -99,20 +119,156 @@ public:
 		fullArrows.push_back(Arrow(3, 0));*/
 		
 		
-		zeroHandle = new ZeroHandle(k_m, mat, std::move(voidArrows), std::move(fullArrows), voidArrowsData, voidArrowsPtr, fullArrowsData, fullArrowsPtr);
+		ZeroHandle* zeroHandle = new ZeroHandle(k_m, mat, std::move(voidArrows), std::move(fullArrows), voidArrowsData, voidArrowsPtr, fullArrowsData, fullArrowsPtr);
+		context.setZeroHandle(zeroHandle);
 		postDrawZeroHandle(zeroHandle->getPairing(), *zeroHandle, std::move(voidArrowsData), std::move(voidArrowsPtr), std::move(fullArrowsData), std::move(fullArrowsPtr));
 	}
 	
 	virtual std::string name() const {return "SetStructureCommand";}
 };
 
-class OnPlayCommand : public Command<> {
+class SetCheckpointFileCommand : public Command<StructureContext&> {
+	std::string m_path;
+	
+	SetCheckpointFileCommand(const std::string& path) : m_path(path) {}
+	
 public:
-	static Command<>* create() {return new OnPlayCommand;}
+	static Command<StructureContext&>* create(const std::string& path) {return new SetCheckpointFileCommand(path);}
+	
+	virtual void run(StructureContext& context) {
+		context.setCheckpointPath(m_path);
+	}
+	
+	virtual std::string name() const {return "SetCheckpointFileCommand";}
+};
+
+static void printDisplayQueue(const DisplayQueueMetrics& metrics) {
+	std::cout << "Display queue: " << metrics.maxDepth << " commands at most";
+	if (metrics.capacity!=0)
+		std::cout << " of " << metrics.capacity;
+	std::cout << ", producer waited " << metrics.producerWaits << " times (" << metrics.producerWaitTime << " s)" << std::endl;
+}
+
+// Remplace la structure du contexte par celle du point de reprise et l'affiche
+static void restoreZeroHandle(StructureContext& context, ZeroHandle::Checkpoint&& checkpoint) {
+	std::list<std::pair<unsigned int, unsigned int>> voidArrowsData;
+	std::list<ArrowBox::ArrowInArrowBox*> voidArrowsPtr;
+	std::list<std::pair<unsigned int, unsigned int>> fullArrowsData;
+	std::list<ArrowBox::ArrowInArrowBox*> fullArrowsPtr;
+	
+	context.discardZeroHandle();
+	
+	ZeroHandle* zeroHandle = new ZeroHandle(std::move(checkpoint), voidArrowsData, voidArrowsPtr, fullArrowsData, fullArrowsPtr);
+	context.setZeroHandle(zeroHandle);
+	
+	postDrawZeroHandle(zeroHandle->getPairing(), *zeroHandle, std::move(voidArrowsData), std::move(voidArrowsPtr), std::move(fullArrowsData), std::move(fullArrowsPtr));
+	zeroHandle->postRestoredState();
+}
+
+class ResumeFromCheckpointCommand : public StructureCommand {
+	std::string m_path;
+	
+	ResumeFromCheckpointCommand(unsigned int generation, const std::string& path) : StructureCommand(generation), m_path(path) {}
+	
+public:
+	static Command<StructureContext&>* create(unsigned int generation, const std::string& path) {return new ResumeFromCheckpointCommand(generation, path);}
+	
+	virtual void run(StructureContext& context) {
+		ZeroHandle::Checkpoint checkpoint;
+		std::ifstream stream(m_path, std::ios::binary);
+		readCheckpointBinary(stream, checkpoint);
+		if (stream.fail()) {
+			std::cout << "Invalid checkpoint " << m_path << std::endl;
+			return;
+		}
+		
+		unsigned int depth = checkpoint.depth;
+		restoreZeroHandle(context, std::move(checkpoint));
+		if (context.getZeroHandle()->getDepth()!=depth)
+			std::cout << "Checkpoint " << m_path << " does not match its recorded depth" << std::endl;
+	}
+	
+	virtual std::string name() const {return "ResumeFromCheckpointCommand";}
+};
+
+class ExportStatisticsCommand : public Command<StructureContext&> {
+	std::string m_path;
 	
-	virtual void run() {
+	ExportStatisticsCommand(const std::string& path) : m_path(path) {}
+	
+public:
+	static Command<StructureContext&>* create(const std::string& path) {return new ExportStatisticsCommand(path);}
+	
+	// En CSV, les appels de lemmes et la file d'affichage vont dans leurs propres fichiers:
+	// statistiques.csv, statistiques.invocations.csv et statistiques.display.csv
+	virtual void run(StructureContext& context) {
+		DisplayQueueMetrics displayQueue = context.getDisplay().getMetrics();
+		std::ofstream stream(m_path);
+		bool isCsv = (m_path.size()>=4 && m_path.compare(m_path.size()-4, 4, ".csv")==0);
+		if (isCsv) {
+			statistics().writeCsv(stream);
+			
+			std::string basePath = m_path.substr(0, m_path.size()-4);
+			std::ofstream invocationsStream(basePath + ".invocations.csv");
+			statistics().writeInvocationsCsv(invocationsStream);
+			if (invocationsStream.fail())
+				std::cout << "Could not write statistics to " << basePath << ".invocations.csv" << std::endl;
+			
+			std::ofstream displayStream(basePath + ".display.csv");
+			Statistics::writeDisplayQueueCsv(displayStream, displayQueue);
+			if (displayStream.fail())
+				std::cout << "Could not write statistics to " << basePath << ".display.csv" << std::endl;
+		} else
+			statistics().writeJson(stream, &displayQueue);
+		
+		if (stream.fail())
+			std::cout << "Could not write statistics to " << m_path << std::endl;
+	}
+	
+	virtual std::string name() const {return "ExportStatisticsCommand";}
+};
+
+class SetWorkBudgetCommand : public Command<StructureContext&> {
+	WorkBudget m_budget;
+	
+	SetWorkBudgetCommand(const WorkBudget& budget) : m_budget(budget) {}
+	
+public:
+	static Command<StructureContext&>* create(const WorkBudget& budget) {return new SetWorkBudgetCommand(budget);}
+	
+	virtual void run(StructureContext& context) {
+		context.setWorkBudget(m_budget);
+	}
+	
+	virtual std::string name() const {return "SetWorkBudgetCommand";}
+};
+
+class OnPlayCommand : public StructureCommand {
+	OnPlayCommand(unsigned int generation) : StructureCommand(generation) {}
+	
+public:
+	static Command<StructureContext&>* create(unsigned int generation) {return new OnPlayCommand(generation);}
+	
+	virtual void run(StructureContext& context) {
+		ZeroHandle* zeroHandle = context.getZeroHandle();
 		if (zeroHandle!=nullptr) {
-			zeroHandle->proposition28();
+			// Sans budget, rien ne revient a la derniere profondeur terminee: inutile d'en garder l'etat
+			const bool restorable = context.getWorkBudget().isLimited();
+			ZeroHandle::Checkpoint completed;
+			try {
+				zeroHandle->proposition28(context.getCheckpointPath(), (restorable) ? &completed : nullptr);
+			} catch (const WorkCancelled& e) {
+				// Le contexte en cours de fermeture libere zeroHandle lui-meme.
+				// Si le budget est depasse, on revient a la derniere profondeur terminee.
+				if (!context.isClosing()) {
+					if (e.getReason()==WorkCancelled::REQUESTED || !restorable)
+						context.discardZeroHandle();
+					else
+						restoreZeroHandle(context, std::move(completed));
+				}
+				throw;
+			}
+			printDisplayQueue(context.getDisplay().getMetrics());
 			/*srand(12345678);
 			unsigned int tracks = zeroHandle->getVoidHandle().numberOfTracks();
 			BiPermutation permutation(tracks);
@@ -244,55 +400,177 @@ public:
 	virtual std::string name() const {return "OnPlayCommand";}
 };
 
-static pthread_t worker_thread;
-static std::queue<Command<>*> workerQueue;
-static pthread_cond_t         workerCond;
-static pthread_mutex_t        workerMutex;
+static std::vector<pthread_t> workerThreads;
+// Les contextes sont partages entre tous les threads de travail et le thread graphique
+static pthread_mutex_t poolMutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  poolCond      = PTHREAD_COND_INITIALIZER; // Un contexte est pret
+static pthread_cond_t  contextIdle   = PTHREAD_COND_INITIALIZER; // Un contexte n'est plus traite
+static std::deque<StructureContext*> readyContexts;
+static std::set<StructureContext*>   contexts;
 
-static int shouldStop = 0;
+static std::atomic<int> shouldStop(0);
 static bool initialized = false;
 
+// Renvoie nullptr lorsque le thread doit s'arreter
+static StructureContext* waitReadyContext() {
+	StructureContext* context = nullptr;
+	
+	pthread_mutex_lock(&poolMutex);
+		while (readyContexts.empty() && !shouldStop)
+			pthread_cond_wait(&poolCond, &poolMutex);
+		
+		if (!shouldStop) {
+			context = readyContexts.front();
+			readyContexts.pop_front();
+		}
+	pthread_mutex_unlock(&poolMutex);
+	
+	return context;
+}
+
 static void* worker_main(void* arg);
 
-static void* worker_main(void* x) {
-	worker_thread_arg_t* arg = static_cast<worker_thread_arg_t*>(x);
+static void* worker_main(void* arg) {
+	StructureContext* context;
+	while ((context = waitReadyContext())!=nullptr)
+		context->service();
+	
+	return NULL;
+}
+
+StructureContext::StructureContext() : m_display(new DisplayContext), m_zeroHandle(nullptr), m_structureGeneration(0), m_runningStructureWork(false),
+		m_closing(false), m_hasStructure(false), m_scheduled(false) {
+	pthread_mutex_lock(&poolMutex);
+		contexts.insert(this);
+	pthread_mutex_unlock(&poolMutex);
+}
+
+StructureContext::~StructureContext() {
+	m_closing = true;
+	interrupt();
 	
-	pthread_mutex_init(&workerMutex, NULL);
-	pthread_cond_init (&workerCond,  NULL);
+	pthread_mutex_lock(&poolMutex);
+		contexts.erase(this);
+		std::deque<StructureContext*>::iterator it = std::find(readyContexts.begin(), readyContexts.end(), this);
+		if (it!=readyContexts.end()) {
+			readyContexts.erase(it);
+			m_scheduled = false;
+		}
+		
+		// Apres stopWorker, plus aucun thread ne traite le contexte
+		while (m_scheduled && !shouldStop)
+			pthread_cond_wait(&contextIdle, &poolMutex);
+	pthread_mutex_unlock(&poolMutex);
 	
-	pthread_mutex_lock(&(arg->init_mutex));
-		arg->worker_done_init = true;
-		pthread_cond_signal(&(arg->init_cond));
-	pthread_mutex_unlock(&(arg->init_mutex));
+	Command<StructureContext&>* cmd;
+	while (m_channel.pop(cmd))
+		cmd->clear();
+	
+	// Le rendu de l'anse 0 reference la structure
+	delete m_display;
+	delete m_zeroHandle;
+}
+
+void StructureContext::interrupt() {
+	m_cancellation.request();
+	m_display->releaseBackpressure();
+}
+
+void StructureContext::discardZeroHandle() {
+	if (m_zeroHandle!=nullptr) {
+		postDeleteZeroHandle(*m_zeroHandle);
+		m_zeroHandle = nullptr;
+	}
+}
+
+void StructureContext::post(Command<StructureContext&>* cmd) {
+	m_channel.push(cmd);
 	
-	while (!shouldStop) {
-		Command<>* cmd;
+	pthread_mutex_lock(&poolMutex);
+		if (!m_scheduled && !shouldStop) {
+			m_scheduled = true;
+			readyContexts.push_back(this);
+			pthread_cond_signal(&poolCond);
+		}
+	pthread_mutex_unlock(&poolMutex);
+}
+
+// Une nouvelle structure rend obsolete tout le travail sur la precedente:
+// les commandes deja envoyees seront ignorees et celle en cours est interrompue.
+unsigned int StructureContext::supersedeStructureWork() {
+	unsigned int generation = ++m_structureGeneration;
+	if (m_runningStructureWork)
+		m_cancellation.request();
+	return generation;
+}
+
+// Execute une commande puis rend la main, pour que les autres contextes avancent aussi
+void StructureContext::service() {
+	Command<StructureContext&>* cmd;
+	if (m_channel.pop(cmd)) {
+		setDisplayContext(m_display);
+		setCancellationToken(&m_cancellation);
+		setThreadStatistics(&m_statistics);
 		
-		pthread_mutex_lock(&workerMutex);
-			while (workerQueue.empty() && !shouldStop)
-				pthread_cond_wait(&workerCond, &workerMutex);
-			
-			if (!shouldStop) {
-				cmd = workerQueue.front();
-				workerQueue.pop();
-			}
-		pthread_mutex_unlock(&workerMutex);
+		StructureCommand* structureCmd = dynamic_cast<StructureCommand*>(cmd);
+		// Doit preceder la lecture de m_structureGeneration: voir supersedeStructureWork
+		m_runningStructureWork = (structureCmd!=nullptr);
+		m_cancellation.clear();
 		
-		if (!shouldStop) {
-			cmd->run();
-			cmd->clear();
+		if (structureCmd==nullptr || structureCmd->getGeneration()==m_structureGeneration) {
+			m_cancellation.begin(m_workBudget);
+			try {
+				cmd->run(*this);
+			} catch (const WorkCancelled& e) {
+				std::cout << cmd->name() << ": " << e.what() << std::endl;
+			}
 		}
+		
+		m_runningStructureWork = false;
+		cmd->clear();
+		
+		setThreadStatistics(nullptr);
+		setCancellationToken(nullptr);
+		setDisplayContext(nullptr);
 	}
 	
-	pthread_cond_destroy(&workerCond);
-	pthread_mutex_destroy(&workerMutex);
-	
-	while(!workerQueue.empty()) {
-		workerQueue.front()->clear();
-		workerQueue.pop();
-	}
-	
-	return NULL;
+	pthread_mutex_lock(&poolMutex);
+		if (m_channel.size()!=0 && !shouldStop && !m_closing) {
+			readyContexts.push_back(this);
+			pthread_cond_signal(&poolCond);
+		} else {
+			m_scheduled = false;
+			pthread_cond_broadcast(&contextIdle);
+		}
+	pthread_mutex_unlock(&poolMutex);
+}
+
+void StructureContext::postOnPlay() {
+	post(OnPlayCommand::create(m_structureGeneration));
+}
+
+void StructureContext::postSetStructure(unsigned int k, FUMatrix&& matrix) {
+	unsigned int generation = supersedeStructureWork();
+	post(SetStructureCommand::create(generation, k, std::move(matrix)));
+	m_hasStructure = true;
+}
+
+void StructureContext::postSetCheckpointFile(const std::string& path) {
+	post(SetCheckpointFileCommand::create(path));
+}
+
+void StructureContext::postResumeFromCheckpoint(const std::string& path) {
+	unsigned int generation = supersedeStructureWork();
+	post(ResumeFromCheckpointCommand::create(generation, path));
+	m_hasStructure = true;
+}
+
+void StructureContext::postExportStatistics(const std::string& path) {
+	post(ExportStatisticsCommand::create(path));
+}
+
+void StructureContext::postSetWorkBudget(double seconds, size_t memory) {
+	post(SetWorkBudgetCommand::create(WorkBudget(seconds, memory)));
 }
 
 int shouldWorkerStop() {
@@ -300,20 +578,15 @@ int shouldWorkerStop() {
 }
 
 void initWorker() {
-	worker_thread_arg_t worker_arg;
-	worker_arg.worker_done_init = false;
-	pthread_cond_init(&(worker_arg.init_cond), NULL);
-	pthread_mutex_init(&(worker_arg.init_mutex), NULL);
-	
-	pthread_create(&worker_thread, NULL, worker_main, &worker_arg);
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t threads = (processors<1) ? 1 : std::min(static_cast<size_t>(processors), static_cast<size_t>(MAX_WORKER_THREADS));
 	
-	pthread_mutex_lock(&(worker_arg.init_mutex));
-		while (!worker_arg.worker_done_init) 
-			pthread_cond_wait(&(worker_arg.init_cond), &(worker_arg.init_mutex));
-	pthread_mutex_unlock(&(worker_arg.init_mutex));
-	
-	pthread_mutex_destroy(&(worker_arg.init_mutex));
-	pthread_cond_destroy(&(worker_arg.init_cond));
+	shouldStop = 0;
+	for (size_t i=0; i<threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, worker_main, NULL)==0)
+			workerThreads.push_back(thread);
+	}
 	
 	initialized = true;
 }
@@ -321,28 +594,19 @@ void initWorker() {
 void stopWorker() {
 	if (initialized) {
 		initialized = false;
-		shouldStop = 1;
-		pthread_mutex_lock(&workerMutex);
-		pthread_cond_signal(&workerCond);
-		pthread_mutex_unlock(&workerMutex);
-		pthread_join(worker_thread, NULL);
 		
-		if (zeroHandle!=nullptr) {
-			delete zeroHandle;
-		}
+		pthread_mutex_lock(&poolMutex);
+			shouldStop = 1;
+			for (std::set<StructureContext*>::iterator it=contexts.begin(); it!=contexts.end(); ++it)
+				(*it)->interrupt();
+			
+			// Les commandes en attente seront liberees avec leur contexte
+			readyContexts.clear();
+			pthread_cond_broadcast(&poolCond);
+		pthread_mutex_unlock(&poolMutex);
+		
+		for (size_t i=0; i<workerThreads.size(); i++)
+			pthread_join(workerThreads[i], NULL);
+		workerThreads.clear();
 	}
 }
-
-void postOnPlay() {
-	pthread_mutex_lock(&workerMutex);
-	workerQueue.push(OnPlayCommand::create());
-	pthread_cond_signal(&workerCond);
-	pthread_mutex_unlock(&workerMutex);
-}
-
-void postSetStructure(unsigned int k, FUMatrix&& matrix) {
-	pthread_mutex_lock(&workerMutex);
-	workerQueue.push(SetStructureCommand::create(k, std::move(matrix)));
-	pthread_cond_signal(&workerCond);
-	pthread_mutex_unlock(&workerMutex);
-}
@@ -4,17 +4,85 @@
 #include <pthread.h>
 
 #ifdef __cplusplus
+#include <string>
+#include <cstddef>
+#include <atomic>
 #include "matrix.hpp"
+#include "command.hpp"
+#include "spsc_channel.hpp"
+#include "statistics.hpp"
+#include "cancellation.hpp"
+
+class ZeroHandle;
+class DisplayContext;
 #endif
 
 int shouldWorkerStop();
+// Demarre les threads de travail, un par processeur
 void initWorker();
 void stopWorker();
 
-void postOnPlay();
-
 #ifdef __cplusplus
-void postSetStructure(unsigned int k, FUMatrix&& matrix);
+// Une structure, ses files de commandes et son affichage.
+// Les commandes d'un contexte s'executent dans l'ordre, sur un seul thread de travail a la fois;
+// des contextes differents sont traites en parallele par les threads de travail.
+class StructureContext {
+	DisplayContext* m_display;
+	ZeroHandle* m_zeroHandle;
+	std::string m_checkpointPath; // Vide si les points de reprise sont desactives
+	WorkBudget m_workBudget;
+	Statistics m_statistics;
+	CancellationToken m_cancellation;
+	
+	// Seul le thread graphique envoie des commandes
+	SpscChannel<Command<StructureContext&>*> m_channel;
+	// Incremente par le thread graphique a chaque nouvelle structure
+	std::atomic<unsigned int> m_structureGeneration;
+	std::atomic<bool> m_runningStructureWork;
+	std::atomic<bool> m_closing;
+	bool m_hasStructure; // Thread graphique
+	bool m_scheduled;    // En attente ou en cours de traitement par un thread de travail, protege par le verrou des threads
+	
+	StructureContext(const StructureContext&) = delete;
+	StructureContext& operator=(const StructureContext&) = delete;
+	
+	void post(Command<StructureContext&>* cmd);
+	unsigned int supersedeStructureWork();
+	
+public:
+	StructureContext();
+	// A appeler depuis le thread graphique, avec le contexte OpenGL de l'affichage courant
+	~StructureContext();
+	
+	DisplayContext& getDisplay() {return *m_display;}
+	bool hasStructure() const {return m_hasStructure;}
+	
+	void postOnPlay();
+	void postSetStructure(unsigned int k, FUMatrix&& matrix);
+	void postSetCheckpointFile(const std::string& path);
+	void postResumeFromCheckpoint(const std::string& path);
+	void postExportStatistics(const std::string& path);
+	
+	// Budget de chaque commande suivante: secondes et octets de memoire residente, 0 pour aucune limite.
+	// Charger une nouvelle structure interrompt le travail en cours sur l'ancienne.
+	void postSetWorkBudget(double seconds, size_t memory);
+	
+	// Interrompt la commande en cours et ne fait plus attendre l'affichage
+	void interrupt();
+	
+	// Threads de travail
+	void service();
+	bool isClosing() const {return m_closing;}
+	ZeroHandle* getZeroHandle() const {return m_zeroHandle;}
+	void setZeroHandle(ZeroHandle* zeroHandle) {m_zeroHandle = zeroHandle;}
+	// Le travail en cours sur la structure a ete interrompu: son etat n'est plus celui d'un lemme termine
+	void discardZeroHandle();
+	const std::string& getCheckpointPath() const {return m_checkpointPath;}
+	void setCheckpointPath(const std::string& path) {m_checkpointPath = path;}
+	const WorkBudget& getWorkBudget() const {return m_workBudget;}
+	void setWorkBudget(const WorkBudget& budget) {m_workBudget = budget;}
+	const Statistics& getStatistics() const {return m_statistics;}
+};
 #endif
 
 #endif /* __WORKER_THREAD_HPP__ */
@@ -1,8 +1,16 @@
 #include "zero_handle.hpp"
 #include "color.hpp"
+#include "io.hpp"
+#include "statistics.hpp"
+#include "cancellation.hpp"
 
 #include <cassert>
+#include <cmath>
 #include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+#include <pthread.h>
 
 std::pair<unsigned int, int> ZeroHandle::getIndexEdgeFromIndex(unsigned int index) const {
 	int edge;
@@ -121,11 +129,51 @@ void ZeroHandle::buildMarkovPart(DeterministMarkov& markov, int edge) const {
 ZeroHandle::ZeroHandle(unsigned int k, const FUMatrix& matrix, std::list<Arrow>&& voidArrows, std::list<Arrow>&& fullArrows,
 		std::list<std::pair<unsigned int, unsigned int>>& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& voidArrowsPtr,
 		std::list<std::pair<unsigned int, unsigned int>>& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& fullArrowsPtr) :
-	m_numTrackVoid(matrix.size()/2-k), m_numTrackFull(k), m_pairing(matrix, k), m_voidHandle(std::move(voidArrows), m_numTrackVoid, voidArrowsData, voidArrowsPtr),
+	m_numTrackVoid(matrix.size()/2-k), m_numTrackFull(k), m_matrix(matrix), m_pairing(matrix, k),
+		m_voidHandle(std::move(voidArrows), m_numTrackVoid, voidArrowsData, voidArrowsPtr),
 		m_fullHandle(std::move(fullArrows), m_numTrackFull, fullArrowsData, fullArrowsPtr) {
 	updateMarkov();
 }
 
+ZeroHandle::ZeroHandle(Checkpoint&& checkpoint,
+		std::list<std::pair<unsigned int, unsigned int>>& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& voidArrowsPtr,
+		std::list<std::pair<unsigned int, unsigned int>>& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& fullArrowsPtr) :
+	m_numTrackVoid(checkpoint.matrix.size()/2-checkpoint.k), m_numTrackFull(checkpoint.k), m_matrix(std::move(checkpoint.matrix)),
+		m_pairing(m_matrix, m_numTrackFull),
+		m_voidHandle(std::move(checkpoint.voidHandle), m_numTrackVoid, voidArrowsData, voidArrowsPtr),
+		m_fullHandle(std::move(checkpoint.fullHandle), m_numTrackFull, fullArrowsData, fullArrowsPtr) {
+	updateMarkov();
+}
+
+ZeroHandle::Checkpoint ZeroHandle::getCheckpoint(unsigned int depth) const {
+	Checkpoint ret;
+	ret.k = m_numTrackFull;
+	ret.matrix = m_matrix;
+	ret.depth = depth;
+	ret.voidHandle = m_voidHandle.getCheckpoint();
+	ret.fullHandle = m_fullHandle.getCheckpoint();
+	return ret;
+}
+
+void ZeroHandle::postRestoredState() {
+	m_voidHandle.postRestoredState();
+	m_fullHandle.postRestoredState();
+}
+
+// On ecrit dans un fichier temporaire, puis on le renomme, pour qu'un arret pendant l'ecriture
+// ne detruise pas le point de reprise precedent.
+static void writeCheckpoint(const std::string& checkpointPath, const ZeroHandle::Checkpoint& checkpoint) {
+	std::string tmpPath = checkpointPath + ".tmp";
+	std::ofstream stream(tmpPath, std::ios::binary | std::ios::trunc);
+	writeCheckpointBinary(stream, checkpoint);
+	stream.close();
+	
+	if (stream.fail() || std::rename(tmpPath.c_str(), checkpointPath.c_str())!=0) {
+		std::cout << "Could not write checkpoint " << checkpointPath << std::endl;
+		std::remove(tmpPath.c_str());
+	}
+}
+
 void ZeroHandle::updateMarkov() {
 	DeterministMarkov markov(2+2*(m_numTrackVoid*m_numTrackVoid+m_numTrackFull*m_numTrackFull));
 	
@@ -137,6 +185,7 @@ void ZeroHandle::updateMarkov() {
 	buildMarkovPart(markov, 0);
 	buildMarkovPart(markov, 3);
 	
+	statistics().count(Statistics::MARKOV_REBUILDS);
 	m_markov = std::move(DeterministMarkovPower(std::move(markov), 1+2*(m_numTrackVoid*m_numTrackVoid+m_numTrackFull*m_numTrackFull)));
 }
 
@@ -163,6 +212,7 @@ unsigned int ZeroHandle::getDepth() const {
 void ZeroHandle::moveArrowThroughout(PassArrowsThroughtZeroHandleCommand* cmd, ArrowBox& src, std::list<ArrowBox::ArrowInArrowBox*>::iterator arrow, int index,
 			unsigned int beginI, unsigned int beginJ) {
 	unsigned int add;
+	statistics().count(Statistics::ZERO_HANDLE_TRANSFERS);
 	
 	if (&src==&m_fullHandle.getFirstArrowBox()) {
 		add = 0;
@@ -202,50 +252,145 @@ void ZeroHandle::moveArrowThroughout(PassArrowsThroughtZeroHandleCommand* cmd, A
 	}
 }
 
-void ZeroHandle::proposition28() {
+struct HandleTask {
+	const std::function<void(OneHandle&)>* step;
+	OneHandle* oneHandle;
+	DisplayCommandBuffer* buffer; // nullptr pour envoyer directement a l'affichage
+	// Contexte du thread qui a lance l'etape
+	DisplayContext* display;
+	CancellationToken* cancellation;
+	Statistics* stats;
+	bool cancelled;
+	WorkCancelled::Reason reason;
+	
+	HandleTask(const std::function<void(OneHandle&)>& s, OneHandle& handle, DisplayCommandBuffer* b) :
+		step(&s), oneHandle(&handle), buffer(b), display(getDisplayContext()), cancellation(getCancellationToken()), stats(&statistics()),
+		cancelled(false), reason(WorkCancelled::REQUESTED) {}
+};
+
+static void* runHandleTask(void* arg) {
+	HandleTask* task = static_cast<HandleTask*>(arg);
+	DisplayContext* display = getDisplayContext();
+	CancellationToken* cancellation = getCancellationToken();
+	Statistics* stats = &statistics();
+	
+	setDisplayContext(task->display);
+	setCancellationToken(task->cancellation);
+	setThreadStatistics(task->stats);
+	setDisplayCommandBuffer(task->buffer);
+	try {
+		(*task->step)(*task->oneHandle);
+	} catch (const WorkCancelled& e) {
+		task->cancelled = true;
+		task->reason = e.getReason();
+	}
+	setDisplayCommandBuffer(nullptr);
+	setThreadStatistics(stats);
+	setCancellationToken(cancellation);
+	setDisplayContext(display);
+	return nullptr;
+}
+
+// Les deux anses ne partagent que la table de Markov, qui n'est que lue entre deux appels a updateMarkov.
+// On execute donc l'etape sur les deux anses en parallele. L'anse vide envoie ses commandes d'affichage
+// directement, l'anse pleine retient les siennes jusqu'a ce que l'anse vide ait termine, pour garder
+// l'ordre du traitement sequentiel.
+void ZeroHandle::runOnBothHandles(const std::function<void(OneHandle&)>& step) {
+	DisplayCommandBuffer fullBuffer(*getDisplayContext());
+	HandleTask voidTask(step, m_voidHandle, nullptr);
+	HandleTask fullTask(step, m_fullHandle, &fullBuffer);
+	
+	pthread_t fullThread;
+	if (pthread_create(&fullThread, NULL, runHandleTask, &fullTask)!=0) {
+		step(m_voidHandle);
+		step(m_fullHandle);
+		return;
+	}
+	
+	runHandleTask(&voidTask);
+	fullBuffer.release();
+	pthread_join(fullThread, NULL);
+	fullBuffer.flush();
+	
+	// Les commandes deja produites sont envoyees pour que l'affichage reste coherent avec les anses
+	if (voidTask.cancelled)
+		throw WorkCancelled(voidTask.reason);
+	if (fullTask.cancelled)
+		throw WorkCancelled(fullTask.reason);
+}
+
+void ZeroHandle::proposition28(const std::string& checkpointPath, Checkpoint* completed) {
 	unsigned int depth = getDepth();
 	printDepth();
+	statistics().reset();
+	// L'etat d'une profondeur terminee n'est copie que pour l'appelant ou le fichier de reprise
+	Checkpoint snapshot;
+	Checkpoint* last = (completed!=nullptr) ? completed : ((checkpointPath.empty()) ? nullptr : &snapshot);
+	if (completed!=nullptr)
+		*completed = getCheckpoint(depth);
 		
 	while (depth!=std::numeric_limits<unsigned int>::max()) {
 		// Step 1
-		m_voidHandle.transferArrowsToFirstArrowBox();
-		m_voidHandle.lemma30(*this);
-		m_fullHandle.transferArrowsToFirstArrowBox();
-		m_fullHandle.lemma30(*this);
-		updateMarkov();
+		cancellationPoint();
+		{
+			Statistics::StepTimer timer(Statistics::STEP_1);
+			runOnBothHandles([this](OneHandle& oneHandle) {
+				oneHandle.transferArrowsToFirstArrowBox();
+				oneHandle.lemma30(*this);
+			});
+			updateMarkov();
+		}
 		
 		// Step 2
-		m_voidHandle.removeDepthMArrows(*this, depth, true);
-		m_fullHandle.removeDepthMArrows(*this, depth, true);
+		cancellationPoint();
+		{
+			Statistics::StepTimer timer(Statistics::STEP_2);
+			runOnBothHandles([this, depth](OneHandle& oneHandle) {oneHandle.removeDepthMArrows(*this, depth, true);});
+		}
 		
-		// Step 3
-		m_voidHandle.lemma30(*this);
-		m_voidHandle.removeDepthMArrows(*this, depth, true);
-		m_voidHandle.emptyArrowBoxThroughZeroHandle(*this, true);
-		updateMarkov();
-		m_fullHandle.lemma30(*this);
-		m_fullHandle.removeDepthMArrows(*this, depth, true);
-		m_fullHandle.emptyArrowBoxThroughZeroHandle(*this, true);
-		updateMarkov();
-		m_voidHandle.transferArrowsToFirstArrowBox();
-		m_voidHandle.lemma30(*this);
-		m_voidHandle.removeDepthMArrows(*this, depth, true);
-		m_voidHandle.emptyArrowBoxThroughZeroHandle(*this, false);
-		updateMarkov();
-		m_fullHandle.transferArrowsToFirstArrowBox();
-		m_fullHandle.lemma30(*this);
-		m_fullHandle.removeDepthMArrows(*this, depth, true);
-		m_fullHandle.emptyArrowBoxThroughZeroHandle(*this, false);
-		updateMarkov();
+		// Step 3 (sequentiel: les fleches passent d'une anse a l'autre)
+		cancellationPoint();
+		{
+			Statistics::StepTimer timer(Statistics::STEP_3);
+			m_voidHandle.lemma30(*this);
+			m_voidHandle.removeDepthMArrows(*this, depth, true);
+			m_voidHandle.emptyArrowBoxThroughZeroHandle(*this, true);
+			updateMarkov();
+			m_fullHandle.lemma30(*this);
+			m_fullHandle.removeDepthMArrows(*this, depth, true);
+			m_fullHandle.emptyArrowBoxThroughZeroHandle(*this, true);
+			updateMarkov();
+			m_voidHandle.transferArrowsToFirstArrowBox();
+			m_voidHandle.lemma30(*this);
+			m_voidHandle.removeDepthMArrows(*this, depth, true);
+			m_voidHandle.emptyArrowBoxThroughZeroHandle(*this, false);
+			updateMarkov();
+			m_fullHandle.transferArrowsToFirstArrowBox();
+			m_fullHandle.lemma30(*this);
+			m_fullHandle.removeDepthMArrows(*this, depth, true);
+			m_fullHandle.emptyArrowBoxThroughZeroHandle(*this, false);
+			updateMarkov();
+		}
 		
 		// Step 4
-		m_voidHandle.removeDepthMArrows(*this, depth, false);
-		m_fullHandle.removeDepthMArrows(*this, depth, false);
+		cancellationPoint();
+		{
+			Statistics::StepTimer timer(Statistics::STEP_4);
+			runOnBothHandles([this, depth](OneHandle& oneHandle) {oneHandle.removeDepthMArrows(*this, depth, false);});
+		}
+		statistics().endDepth(depth);
+		postKeyframeCommand();
 		
 		unsigned int newDepth = getDepth();
 		printDepth();
 		assert(newDepth > depth);
 		depth = newDepth;
+		
+		if (last!=nullptr) {
+			*last = getCheckpoint(depth);
+			if (!checkpointPath.empty())
+				writeCheckpoint(checkpointPath, *last);
+		}
 	}
 }
 
@@ -258,53 +403,57 @@ void ZeroHandle::printDepth() const {
 }
 
 
-void ZeroHandleRenderer::getLenghtPoints(unsigned int i, float& t0, float& t1, float& t2, float& t3, float& t4, float& t5, float& t6, float& t7, float& t8) {
-	if (i < m_numTrackFull) {
-		t0 = m_fullWestGapTracks[0].getCurve().getLenght();
-		t1 = t0;
-		t2 = t1;
-		t3 = t2;
-		t4 = t3;
-		t5 = t4;
-		t6 = t5;
-		t7 = t6;
-		t8 = t7;
-	} else if (i < m_numTrackFull+m_numTrackVoid) {
-		i-= m_numTrackFull;
-		t0 =      m_voidEastGapTracks[0].getCurve().getLenght(); // NOTE: toutes les voies devraient avoir la meme longueur
-		t1 = t0 + 1.0;
-		t2 = t1 + m_rightVoidHandleTracks[0].getCurve().getLenght();
-		t3 = t2 + 1.0;
-		t4 = t3 + m_lowerVoidHandleTracks[0].getCurve().getLenght();
-		t5 = t4 + 1.0;
-		t6 = t5 + m_southTracks[0].getCurve().getLenght();
-		t7 = t6;
-		t8 = t7;
-	} else if (i < 2*m_numTrackFull+m_numTrackVoid) {
-		i -= (m_numTrackFull+m_numTrackVoid);
-		t0 =      m_fullEastGapTracks[0].getCurve().getLenght();
-		t1 = t0 + 1.0;
-		t2 = t1 + m_rightFullHandleTracks[0].getCurve().getLenght();
-		t3 = t2 + 1.0;
-		t4 = t3 + m_lowerFullHandleTracks[0].getCurve().getLenght();
-		t5 = t4 + 1.0;
-		t6 = t5 + m_leftFullHandleTracks[0].getCurve().getLenght();
-		t7 = t6 + 1.0;
-		t8 = t7 + m_westTracks[0].getCurve().getLenght();
-	} else {
-		i -= (2*m_numTrackFull+m_numTrackVoid);
-		t0 =      m_voidWestGapTracks[0].getCurve().getLenght();
-		t1 = t0 + 1.0;
-		t2 = t1 + m_northTracks[0].getCurve().getLenght();
-		t3 = t2;
-		t4 = t3;
-		t5 = t4;
-		t6 = t5;
-		t7 = t6;
-		t8 = t7;
+void ZeroHandleRenderer::updateLenghtPoints() {
+	std::fill_n(&m_lenghtPoints[0][0], 4*9, 0.0);
+	
+	if (!m_fullWestGapTracks.empty()) {
+		float* t = m_lenghtPoints[0];
+		t[0] = getFrameLenght(m_fullWestGapTracks[0].getCurve());
+		std::fill_n(t+1, 8, t[0]);
+		
+		t = m_lenghtPoints[2];
+		t[0] =        getFrameLenght(m_fullEastGapTracks[0].getCurve());
+		t[1] = t[0] + 1.0;
+		t[2] = t[1] + m_rightFullHandleTracks[0].getCurve().getLenght();
+		t[3] = t[2] + 1.0;
+		t[4] = t[3] + getFrameLenght(m_lowerFullHandleTracks[0].getCurve());
+		t[5] = t[4] + 1.0;
+		t[6] = t[5] + m_leftFullHandleTracks[0].getCurve().getLenght();
+		t[7] = t[6] + 1.0;
+		t[8] = t[7] + m_westTracks[0].getCurve().getLenght();
+	}
+	
+	if (!m_voidEastGapTracks.empty()) {
+		float* t = m_lenghtPoints[1];
+		t[0] =        getFrameLenght(m_voidEastGapTracks[0].getCurve()); // NOTE: toutes les voies devraient avoir la meme longueur
+		t[1] = t[0] + 1.0;
+		t[2] = t[1] + m_rightVoidHandleTracks[0].getCurve().getLenght();
+		t[3] = t[2] + 1.0;
+		t[4] = t[3] + getFrameLenght(m_lowerVoidHandleTracks[0].getCurve());
+		t[5] = t[4] + 1.0;
+		t[6] = t[5] + m_southTracks[0].getCurve().getLenght();
+		t[7] = t[6];
+		t[8] = t[7];
+		
+		t = m_lenghtPoints[3];
+		t[0] =        getFrameLenght(m_voidWestGapTracks[0].getCurve());
+		t[1] = t[0] + 1.0;
+		t[2] = t[1] + m_northTracks[0].getCurve().getLenght();
+		std::fill_n(t+3, 6, t[2]);
 	}
 }
 
+const float* ZeroHandleRenderer::getLenghtPoints(unsigned int i) const {
+	if (i < m_numTrackFull)
+		return m_lenghtPoints[0];
+	else if (i < m_numTrackFull+m_numTrackVoid)
+		return m_lenghtPoints[1];
+	else if (i < 2*m_numTrackFull+m_numTrackVoid)
+		return m_lenghtPoints[2];
+	else
+		return m_lenghtPoints[3];
+}
+
 ShowableCurve& ZeroHandleRenderer::getInterpolatedTrack(float& newT, unsigned int trackStart, unsigned int trackEnd, float time, const float t[19]) {
 	if (trackStart > trackEnd) {
 		std::swap(trackStart, trackEnd);
@@ -384,9 +533,8 @@ ShowableCurve& ZeroHandleRenderer::getInterpolatedTrack(float& newT, unsigned in
 		track = &m_westTracks[trackStart].getCurve();
 		newT = (time-t[7])/(t[8]-t[7]);
 	} else if (time<t[9]) {
-		auto it = m_pairTrackMap.find(ZeroHandle::UnorderedIdempotentsPair(indexStart, indexEnd));
-		assert(it!=m_pairTrackMap.end());
-		track = &it->second.getCurve();
+		assert(indexStart<=indexEnd && indexEnd<m_pairTracks.size());
+		track = &m_pairTracks[indexStart].getCurve();
 		newT = (time-t[8])/(t[9]-t[8]);
 	} else { 
 		time = 1.0-time;
@@ -443,6 +591,7 @@ ShowableCurve& ZeroHandleRenderer::getInterpolatedTrack(float& newT, unsigned in
 ZeroHandleRenderer::ZeroHandleRenderer(RendererGL& rendererGL, const Pairing& pairing, ZeroHandle& zeroHandle,
 				std::list<std::pair<unsigned int, unsigned int>>& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& voidArrows,
 				std::list<std::pair<unsigned int, unsigned int>>& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& fullArrows) :
+	m_rendererGL(rendererGL),
 	m_voidHandle(rendererGL, zeroHandle.m_voidHandle, voidArrowsData, voidArrows, 0.5, 1.5, 0, *this),
 	m_fullHandle(rendererGL, zeroHandle.m_fullHandle, fullArrowsData, fullArrows, 0.5, 0.5, 2, *this),
 	m_handleLenght(std::max(m_voidHandle.lenght(), m_fullHandle.lenght()-1.0f)),
@@ -527,17 +676,14 @@ ZeroHandleRenderer::ZeroHandleRenderer(RendererGL& rendererGL, const Pairing& pa
 	assert(pairing.size() == 2*(m_numTrackVoid+m_numTrackFull));
 	
 	zeroHandle.m_renderer = this;
+	m_pairTracks.resize(pairing.size());
 	for (unsigned int i=0; i<pairing.size(); i++) {
 		unsigned int j = pairing[i];
 		
-		std::pair<std::map<ZeroHandle::UnorderedIdempotentsPair, TrackBezier>::iterator, bool> res = m_pairTrackMap.insert(
-				std::make_pair(ZeroHandle::UnorderedIdempotentsPair(i, j), TrackBezier()));
-		if (res.second) {
+		if (i<=j) {
 			float p0x, p0y, p1x, p1y;
 			Direction d0, d1;
 			
-			if (i>j) std::swap(i, j);
-			
 			if (i < m_numTrackFull) {
 				d0  = EAST;
 				p0x = 0.5;
@@ -575,13 +721,13 @@ ZeroHandleRenderer::ZeroHandleRenderer(RendererGL& rendererGL, const Pairing& pa
 			}
 			
 			if (d0!=d1)
-				res.first->second = std::move(TrackBezier(rendererGL, p0x, p0y, p1x, p1y, trackColor.r, trackColor.g, trackColor.b, 0, d0, d1));
+				m_pairTracks[i] = std::move(TrackBezier(rendererGL, p0x, p0y, p1x, p1y, trackColor.r, trackColor.g, trackColor.b, 0, d0, d1));
 			else {
 				float tx, ty;
 				getUnitTangentFromDirection(d0, tx, ty);
 				tx /= 2*(m_numTrackVoid+1); tx = -tx;
 				ty /= 2*(m_numTrackFull+1); ty = -ty;
-				res.first->second = std::move(TrackBezier(rendererGL, p0x, p0y, p1x, p1y, tx, ty, tx, ty, trackColor.r, trackColor.g, trackColor.b, 0));
+				m_pairTracks[i] = std::move(TrackBezier(rendererGL, p0x, p0y, p1x, p1y, tx, ty, tx, ty, trackColor.r, trackColor.g, trackColor.b, 0));
 			}
 		}
 	}
@@ -743,104 +889,230 @@ ZeroHandleRenderer::ZeroHandleRenderer(RendererGL& rendererGL, const Pairing& pa
 		m_fullWestGapBorder[i].show(rendererGL);
 	}
 	
+	for (int i=0; i<FRAME_TRANSLATIONS; i++)
+		m_frameTranslations[i] = rendererGL.allocateTranslation();
+	updateFrameTranslations();
+	
+	const unsigned int right    = m_frameTranslations[RIGHT_TRANSLATION];
+	const unsigned int voidEast = m_frameTranslations[VOID_EAST_GAP_TRANSLATION];
+	const unsigned int voidWest = m_frameTranslations[VOID_WEST_GAP_TRANSLATION];
+	const unsigned int fullEast = m_frameTranslations[FULL_EAST_GAP_TRANSLATION];
+	const unsigned int fullWest = m_frameTranslations[FULL_WEST_GAP_TRANSLATION];
+	
+	// Les pieces du bas s'etirent jusqu'au cote droit, celles des trous entre les 1-anses et leurs cotes
+	m_lowerVoidHandleQuad.setTranslation(0, right);
+	m_lowerFullHandleQuad.setTranslation(0, right);
+	m_rightFullHandleQuad.setTranslation(right, right);
+	m_rightVoidHandleQuad.setTranslation(right, right);
+	m_voidEastGapQuad.setTranslation(0, voidEast);
+	m_voidWestGapQuad.setTranslation(voidWest, right);
+	m_fullEastGapQuad.setTranslation(0, fullEast);
+	m_fullWestGapQuad.setTranslation(fullWest, right);
+	for (int i=0; i<2; i++) {
+		m_lowerVoidHandleBorder[i].setTranslation(0, right);
+		m_lowerFullHandleBorder[i].setTranslation(0, right);
+		m_rightFullHandleBorder[i].setTranslation(right, right);
+		m_rightVoidHandleBorder[i].setTranslation(right, right);
+		m_voidEastGapBorder[i].setTranslation(0, voidEast);
+		m_voidWestGapBorder[i].setTranslation(voidWest, right);
+		m_fullEastGapBorder[i].setTranslation(0, fullEast);
+		m_fullWestGapBorder[i].setTranslation(fullWest, right);
+	}
+	
+	for (unsigned int j=0; j<m_numTrackFull; j++) {
+		m_lowerFullHandleTracks[j].getCurve().setTranslation(right, 0);
+		m_lowerRightCornerFullHandleTracks[j].getCurve().setTranslation(right, right);
+		m_rightFullHandleTracks[j].getCurve().setTranslation(right, right);
+		m_upperRightCornerFullHandleTracks[j].getCurve().setTranslation(right, right);
+		m_fullEastGapTracks[j].getCurve().setTranslation(fullEast, 0);
+		m_fullWestGapTracks[j].getCurve().setTranslation(fullWest, right);
+	}
+	
+	for (unsigned int j=0; j<m_numTrackVoid; j++) {
+		m_lowerVoidHandleTracks[j].getCurve().setTranslation(right, 0);
+		m_lowerRightCornerVoidHandleTracks[j].getCurve().setTranslation(right, right);
+		m_rightVoidHandleTracks[j].getCurve().setTranslation(right, right);
+		m_upperRightCornerVoidHandleTracks[j].getCurve().setTranslation(right, right);
+		m_voidEastGapTracks[j].getCurve().setTranslation(voidEast, 0);
+		m_voidWestGapTracks[j].getCurve().setTranslation(voidWest, right);
+	}
+	
+	layoutFrame();
 	m_voidHandle.changeBasePoints(0.5-0.5*(m_voidHandle.lenght()-m_handleLenght), 1.5);
 	m_fullHandle.changeBasePoints(1.0-0.5*(m_fullHandle.lenght()-m_handleLenght), 0.5);
+	updateLenghtPoints();
 }
 
-void ZeroHandleRenderer::updateLenght() {
-	m_handleLenght = std::max(m_voidHandle.lenght(), m_fullHandle.lenght()-1.0f);
+ZeroHandleRenderer::~ZeroHandleRenderer() {
+	for (int i=0; i<FRAME_TRANSLATIONS; i++) {
+		if (m_frameTranslations[i]!=0)
+			m_rendererGL.freeTranslation(m_frameTranslations[i]);
+	}
+}
+
+void ZeroHandleRenderer::getFramePositions(float positions[FRAME_TRANSLATIONS]) const {
+	const float diffFull = m_handleLenght-m_fullHandle.lenght();
+	const float diffVoid = m_handleLenght-m_voidHandle.lenght();
+	
+	positions[RIGHT_TRANSLATION]         = m_handleLenght;
+	positions[VOID_EAST_GAP_TRANSLATION] = 0.5*diffVoid;
+	positions[VOID_WEST_GAP_TRANSLATION] = m_voidHandle.lenght()+0.5*diffVoid;
+	positions[FULL_EAST_GAP_TRANSLATION] = 0.5*diffFull;
+	positions[FULL_WEST_GAP_TRANSLATION] = m_fullHandle.lenght()+0.5*diffFull;
+}
+
+bool ZeroHandleRenderer::updateFrameTranslations() {
+	float positions[FRAME_TRANSLATIONS];
+	getFramePositions(positions);
+	
+	bool complete = true;
+	for (int i=0; i<FRAME_TRANSLATIONS; i++) {
+		if (m_frameTranslations[i]!=0)
+			m_rendererGL.setTranslation(m_frameTranslations[i], positions[i], 0.0);
+		else
+			complete = false;
+	}
+	return complete;
+}
+
+void ZeroHandleRenderer::layoutFrame() {
+	float positions[FRAME_TRANSLATIONS];
+	getFramePositions(positions);
+	// Nulles quand les translations suivent les positions
+	for (int i=0; i<FRAME_TRANSLATIONS; i++)
+		positions[i] -= m_rendererGL.getTranslation(m_frameTranslations[i])[0];
+	
+	const float right    = positions[RIGHT_TRANSLATION];
+	const float voidEast = positions[VOID_EAST_GAP_TRANSLATION];
+	const float voidWest = positions[VOID_WEST_GAP_TRANSLATION];
+	const float fullEast = positions[FULL_EAST_GAP_TRANSLATION];
+	const float fullWest = positions[FULL_WEST_GAP_TRANSLATION];
 	
 	const float deltaFull = 1.0/(m_westTracks.size()+1);
-	const float diffFull  = m_handleLenght-m_fullHandle.lenght();
 	const float deltaVoid = 1.0/(m_southTracks.size()+1);
-	const float diffVoid  = m_handleLenght-m_voidHandle.lenght();
-	
-	m_lowerVoidHandleQuad.changePoints(-0.5+0.5*deltaVoid, m_handleLenght+1.5-0.5*deltaVoid, -1.5+0.5*deltaVoid, -0.5-0.5*deltaVoid);
-	m_lowerVoidHandleBorder[0].changePoints(-0.5+0.5*deltaVoid, -1.5+0.5*deltaVoid, m_handleLenght+1.5-0.5*deltaVoid, -1.5+0.5*deltaVoid);
-	m_lowerVoidHandleBorder[1].changePoints(0.5-0.5*deltaVoid, -0.5-0.5*deltaVoid, m_handleLenght+0.5+0.5*deltaVoid, -0.5-0.5*deltaVoid);
-	m_lowerFullHandleQuad.changePoints(-1.5+0.5*deltaFull, m_handleLenght+2.5-0.5*deltaFull, -2.5+0.5*deltaFull, -1.5-0.5*deltaFull);
-	m_lowerFullHandleBorder[0].changePoints(-1.5+0.5*deltaFull, -2.5+0.5*deltaFull, m_handleLenght+2.5-0.5*deltaFull, -2.5+0.5*deltaFull);
-	m_lowerFullHandleBorder[1].changePoints(-0.5-0.5*deltaFull, -1.5-0.5*deltaFull, m_handleLenght+1.5+0.5*deltaFull, -1.5-0.5*deltaFull);
-	
-	m_rightFullHandleQuad.changePoints(m_handleLenght+1.5+0.5*deltaFull, m_handleLenght+2.5-0.5*deltaFull, -1.5-0.5*deltaFull, 0.5-0.5*deltaFull);
-	m_rightFullHandleBorder[0].changePoints(m_handleLenght+1.5+0.5*deltaFull, -1.5-0.5*deltaFull, m_handleLenght+1.5+0.5*deltaFull, -0.5+0.5*deltaFull);
-	m_rightFullHandleBorder[1].changePoints(m_handleLenght+2.5-0.5*deltaFull, -2.5+0.5*deltaFull, m_handleLenght+2.5-0.5*deltaFull, 0.5-0.5*deltaFull);
-	m_rightVoidHandleQuad.changePoints(m_handleLenght+0.5+0.5*deltaVoid, m_handleLenght+1.5-0.5*deltaVoid, -0.5-0.5*deltaVoid, 1.5-0.5*deltaVoid);
-	m_rightVoidHandleBorder[0].changePoints(m_handleLenght+0.5+0.5*deltaVoid, -0.5-0.5*deltaVoid, m_handleLenght+0.5+0.5*deltaVoid, 0.5+0.5*deltaVoid); 
-	m_rightVoidHandleBorder[1].changePoints(m_handleLenght+1.5-0.5*deltaVoid, -1.5+0.5*deltaVoid, m_handleLenght+1.5-0.5*deltaVoid, 1.5-0.5*deltaVoid);
+	
+	m_lowerVoidHandleQuad.changePoints(-0.5+0.5*deltaVoid, right+1.5-0.5*deltaVoid, -1.5+0.5*deltaVoid, -0.5-0.5*deltaVoid);
+	m_lowerVoidHandleBorder[0].changePoints(-0.5+0.5*deltaVoid, -1.5+0.5*deltaVoid, right+1.5-0.5*deltaVoid, -1.5+0.5*deltaVoid);
+	m_lowerVoidHandleBorder[1].changePoints(0.5-0.5*deltaVoid, -0.5-0.5*deltaVoid, right+0.5+0.5*deltaVoid, -0.5-0.5*deltaVoid);
+	m_lowerFullHandleQuad.changePoints(-1.5+0.5*deltaFull, right+2.5-0.5*deltaFull, -2.5+0.5*deltaFull, -1.5-0.5*deltaFull);
+	m_lowerFullHandleBorder[0].changePoints(-1.5+0.5*deltaFull, -2.5+0.5*deltaFull, right+2.5-0.5*deltaFull, -2.5+0.5*deltaFull);
+	m_lowerFullHandleBorder[1].changePoints(-0.5-0.5*deltaFull, -1.5-0.5*deltaFull, right+1.5+0.5*deltaFull, -1.5-0.5*deltaFull);
+	
+	m_rightFullHandleQuad.changePoints(right+1.5+0.5*deltaFull, right+2.5-0.5*deltaFull, -1.5-0.5*deltaFull, 0.5-0.5*deltaFull);
+	m_rightFullHandleBorder[0].changePoints(right+1.5+0.5*deltaFull, -1.5-0.5*deltaFull, right+1.5+0.5*deltaFull, -0.5+0.5*deltaFull);
+	m_rightFullHandleBorder[1].changePoints(right+2.5-0.5*deltaFull, -2.5+0.5*deltaFull, right+2.5-0.5*deltaFull, 0.5-0.5*deltaFull);
+	m_rightVoidHandleQuad.changePoints(right+0.5+0.5*deltaVoid, right+1.5-0.5*deltaVoid, -0.5-0.5*deltaVoid, 1.5-0.5*deltaVoid);
+	m_rightVoidHandleBorder[0].changePoints(right+0.5+0.5*deltaVoid, -0.5-0.5*deltaVoid, right+0.5+0.5*deltaVoid, 0.5+0.5*deltaVoid); 
+	m_rightVoidHandleBorder[1].changePoints(right+1.5-0.5*deltaVoid, -1.5+0.5*deltaVoid, right+1.5-0.5*deltaVoid, 1.5-0.5*deltaVoid);
 	
 	for (unsigned int j=0; j<m_westTracks.size(); j++) {
 		const unsigned int i=j+1;
-		m_lowerFullHandleTracks[j].changePoints(m_handleLenght+1.5+0.5*deltaFull, -2.5+i*deltaFull, -0.5-0.5*deltaFull, -2.5+i*deltaFull);
-		m_lowerRightCornerFullHandleTracks[j].changePoints(m_handleLenght+2.5-i*deltaFull, -1.5-0.5*deltaFull,
-								m_handleLenght+1.5+0.5*deltaFull, -2.5+i*deltaFull, SOUTH, EAST);
-		m_rightFullHandleTracks[j].changePoints(m_handleLenght+2.5-i*deltaFull, -0.5+0.5*deltaFull, m_handleLenght+2.5-i*deltaFull, -1.5-0.5*deltaFull);
-		m_upperRightCornerFullHandleTracks[j].changePoints(m_handleLenght+1.5+0.5*deltaFull, 0.5-i*deltaFull,
-								m_handleLenght+2.5-i*deltaFull, -0.5+0.5*deltaFull, WEST, NORTH);
+		m_lowerFullHandleTracks[j].changePoints(right+1.5+0.5*deltaFull, -2.5+i*deltaFull, -0.5-0.5*deltaFull, -2.5+i*deltaFull);
+		m_lowerRightCornerFullHandleTracks[j].changePoints(right+2.5-i*deltaFull, -1.5-0.5*deltaFull,
+								right+1.5+0.5*deltaFull, -2.5+i*deltaFull, SOUTH, EAST);
+		m_rightFullHandleTracks[j].changePoints(right+2.5-i*deltaFull, -0.5+0.5*deltaFull, right+2.5-i*deltaFull, -1.5-0.5*deltaFull);
+		m_upperRightCornerFullHandleTracks[j].changePoints(right+1.5+0.5*deltaFull, 0.5-i*deltaFull,
+								right+2.5-i*deltaFull, -0.5+0.5*deltaFull, WEST, NORTH);
 		
-		m_fullEastGapTracks[j].changePoints(1.0+0.5*diffFull, 0.5-i*deltaFull, 0.5, 0.5-i*deltaFull);
-		m_fullWestGapTracks[j].changePoints(1.0+m_fullHandle.lenght()+0.5*diffFull, 0.5-i*deltaFull, 1.5+m_handleLenght+0.5*deltaFull, 0.5-i*deltaFull);
+		m_fullEastGapTracks[j].changePoints(1.0+fullEast, 0.5-i*deltaFull, 0.5, 0.5-i*deltaFull);
+		m_fullWestGapTracks[j].changePoints(1.0+fullWest, 0.5-i*deltaFull, right+1.5+0.5*deltaFull, 0.5-i*deltaFull);
 	}
 	
 	for (unsigned int j=0; j<m_southTracks.size(); j++) {
 		const unsigned int i=j+1;
-		m_lowerVoidHandleTracks[j].changePoints(m_handleLenght+0.5+0.5*deltaVoid, -1.5+i*deltaVoid, 0.5-0.5*deltaVoid, -1.5+i*deltaVoid);
-		m_lowerRightCornerVoidHandleTracks[j].changePoints(m_handleLenght+1.5-i*deltaVoid, -0.5-0.5*deltaVoid,
-								m_handleLenght+0.5+0.5*deltaVoid, -1.5+i*deltaVoid, SOUTH, EAST);
-		m_rightVoidHandleTracks[j].changePoints(m_handleLenght+1.5-i*deltaVoid, 0.5+0.5*deltaVoid, m_handleLenght+1.5-i*deltaVoid, -0.5-0.5*deltaVoid);
-		m_upperRightCornerVoidHandleTracks[j].changePoints(m_handleLenght+0.5+0.5*deltaVoid, 1.5-i*deltaVoid,
-								m_handleLenght+1.5-i*deltaVoid, 0.5+0.5*deltaVoid, WEST, NORTH);
+		m_lowerVoidHandleTracks[j].changePoints(right+0.5+0.5*deltaVoid, -1.5+i*deltaVoid, 0.5-0.5*deltaVoid, -1.5+i*deltaVoid);
+		m_lowerRightCornerVoidHandleTracks[j].changePoints(right+1.5-i*deltaVoid, -0.5-0.5*deltaVoid,
+								right+0.5+0.5*deltaVoid, -1.5+i*deltaVoid, SOUTH, EAST);
+		m_rightVoidHandleTracks[j].changePoints(right+1.5-i*deltaVoid, 0.5+0.5*deltaVoid, right+1.5-i*deltaVoid, -0.5-0.5*deltaVoid);
+		m_upperRightCornerVoidHandleTracks[j].changePoints(right+0.5+0.5*deltaVoid, 1.5-i*deltaVoid,
+								right+1.5-i*deltaVoid, 0.5+0.5*deltaVoid, WEST, NORTH);
 		
-		m_voidEastGapTracks[j].changePoints(0.5+0.5*diffVoid, 1.5-i*deltaVoid, 0.5-0.5*deltaVoid, 1.5-i*deltaVoid);
-		m_voidWestGapTracks[j].changePoints(0.5+m_voidHandle.lenght()+0.5*diffVoid, 1.5-i*deltaVoid, 0.5+m_handleLenght+0.5*deltaVoid, 1.5-i*deltaVoid);
+		m_voidEastGapTracks[j].changePoints(0.5+voidEast, 1.5-i*deltaVoid, 0.5-0.5*deltaVoid, 1.5-i*deltaVoid);
+		m_voidWestGapTracks[j].changePoints(0.5+voidWest, 1.5-i*deltaVoid, right+0.5+0.5*deltaVoid, 1.5-i*deltaVoid);
 	}
 	
-	m_voidEastGapQuad.changePoints(0.5-0.5*deltaVoid, 0.5+0.5*diffVoid, 0.5+0.5*deltaVoid, 1.5-0.5*deltaVoid);
-	m_voidEastGapBorder[0].changePoints(0.5-0.5*deltaVoid, 0.5+0.5*deltaVoid, 0.5+0.5*diffVoid, 0.5+0.5*deltaVoid);
-	m_voidEastGapBorder[1].changePoints(-0.5+0.5*deltaVoid, 1.5-0.5*deltaVoid, 0.5+0.5*diffVoid, 1.5-0.5*deltaVoid);
-	m_voidWestGapQuad.changePoints(0.5+m_voidHandle.lenght()+0.5*diffVoid, 0.5+m_handleLenght+0.5*deltaVoid, 0.5+0.5*deltaVoid, 1.5-0.5*deltaVoid);
-	m_voidWestGapBorder[0].changePoints(0.5+m_voidHandle.lenght()+0.5*diffVoid, 0.5+0.5*deltaVoid, 0.5+m_handleLenght+0.5*deltaVoid, 0.5+0.5*deltaVoid);
-	m_voidWestGapBorder[1].changePoints(0.5+m_voidHandle.lenght()+0.5*diffVoid, 1.5-0.5*deltaVoid, 1.5+m_handleLenght-0.5*deltaVoid, 1.5-0.5*deltaVoid);
+	m_voidEastGapQuad.changePoints(0.5-0.5*deltaVoid, 0.5+voidEast, 0.5+0.5*deltaVoid, 1.5-0.5*deltaVoid);
+	m_voidEastGapBorder[0].changePoints(0.5-0.5*deltaVoid, 0.5+0.5*deltaVoid, 0.5+voidEast, 0.5+0.5*deltaVoid);
+	m_voidEastGapBorder[1].changePoints(-0.5+0.5*deltaVoid, 1.5-0.5*deltaVoid, 0.5+voidEast, 1.5-0.5*deltaVoid);
+	m_voidWestGapQuad.changePoints(0.5+voidWest, right+0.5+0.5*deltaVoid, 0.5+0.5*deltaVoid, 1.5-0.5*deltaVoid);
+	m_voidWestGapBorder[0].changePoints(0.5+voidWest, 0.5+0.5*deltaVoid, right+0.5+0.5*deltaVoid, 0.5+0.5*deltaVoid);
+	m_voidWestGapBorder[1].changePoints(0.5+voidWest, 1.5-0.5*deltaVoid, right+1.5-0.5*deltaVoid, 1.5-0.5*deltaVoid);
 	
-	m_fullEastGapQuad.changePoints(0.5, 1.0+0.5*diffFull, -0.5+0.5*deltaFull, 0.5-0.5*deltaFull);
-	m_fullEastGapBorder[0].changePoints(0.5, -0.5+0.5*deltaFull, 1.0+0.5*diffFull, -0.5+0.5*deltaFull);
-	m_fullEastGapBorder[1].changePoints(0.5, 0.5-0.5*deltaFull, 1.0+0.5*diffFull, 0.5-0.5*deltaFull);
-	m_fullWestGapQuad.changePoints(1.0+m_fullHandle.lenght()+0.5*diffFull, 1.5+m_handleLenght+0.5*deltaFull, -0.5+0.5*deltaFull, 0.5-0.5*deltaFull);
-	m_fullWestGapBorder[0].changePoints(1.0+m_fullHandle.lenght()+0.5*diffFull, -0.5+0.5*deltaFull, 1.5+m_handleLenght+0.5*deltaFull, -0.5+0.5*deltaFull);
-	m_fullWestGapBorder[1].changePoints(1.0+m_fullHandle.lenght()+0.5*diffFull, 0.5-0.5*deltaFull, 2.5+m_handleLenght-0.5*deltaFull, 0.5-0.5*deltaFull);
+	m_fullEastGapQuad.changePoints(0.5, 1.0+fullEast, -0.5+0.5*deltaFull, 0.5-0.5*deltaFull);
+	m_fullEastGapBorder[0].changePoints(0.5, -0.5+0.5*deltaFull, 1.0+fullEast, -0.5+0.5*deltaFull);
+	m_fullEastGapBorder[1].changePoints(0.5, 0.5-0.5*deltaFull, 1.0+fullEast, 0.5-0.5*deltaFull);
+	m_fullWestGapQuad.changePoints(1.0+fullWest, right+1.5+0.5*deltaFull, -0.5+0.5*deltaFull, 0.5-0.5*deltaFull);
+	m_fullWestGapBorder[0].changePoints(1.0+fullWest, -0.5+0.5*deltaFull, right+1.5+0.5*deltaFull, -0.5+0.5*deltaFull);
+	m_fullWestGapBorder[1].changePoints(1.0+fullWest, 0.5-0.5*deltaFull, right+2.5-0.5*deltaFull, 0.5-0.5*deltaFull);
+}
 	
-	m_voidHandle.changeBasePoints(0.5+0.5*diffVoid, 1.5);
-	m_fullHandle.changeBasePoints(1.0+0.5*diffFull, 0.5);
+void ZeroHandleRenderer::updateLenght() {
+	m_handleLenght = std::max(m_voidHandle.lenght(), m_fullHandle.lenght()-1.0f);
+	
+	// Le cadre suit ses translations; il n'est reecrit que s'il en manque
+	if (!updateFrameTranslations())
+		layoutFrame();
+	
+	m_voidHandle.changeBasePoints(0.5+0.5*(m_handleLenght-m_voidHandle.lenght()), 1.5);
+	m_fullHandle.changeBasePoints(1.0+0.5*(m_handleLenght-m_fullHandle.lenght()), 0.5);
+	updateLenghtPoints();
+}
+
+void ZeroHandleRenderer::getFramePoint(const ShowableCurve& track, float& out_x, float& out_y, float t) const {
+	const GLfloat* begin = m_rendererGL.getTranslation(track.getTranslation(0));
+	const GLfloat* end   = m_rendererGL.getTranslation(track.getTranslation(1));
+	track.getPoint(out_x, out_y, t);
+	out_x += (1-t)*begin[0] + t*end[0];
+	out_y += (1-t)*begin[1] + t*end[1];
+}
+
+// Comme Curve::getNormalToPoint, avec la vitesse d'etirement entre les translations des extremites
+void ZeroHandleRenderer::getFrameNormalToPoint(const ShowableCurve& track, float& out_x, float& out_y, float t, float px, float py) const {
+	const GLfloat* begin = m_rendererGL.getTranslation(track.getTranslation(0));
+	const GLfloat* end   = m_rendererGL.getTranslation(track.getTranslation(1));
+	float tx, ty;
+	track.getTangent(tx, ty, t);
+	out_y = tx + (end[0]-begin[0]);
+	out_x = -(ty + (end[1]-begin[1]));
+	
+	float norm = sqrt(out_x*out_x+out_y*out_y);
+	out_x /= norm;
+	out_y /= norm;
+	
+	float x, y;
+	getFramePoint(track, x, y, t);
+	px -= x;
+	py -= y;
+	if (out_x*px+out_y*py < 0.0) {
+		out_x = -out_x;
+		out_y = -out_y;
+	}
+}
+
+float ZeroHandleRenderer::getFrameLenght(ShowableCurve& track) const {
+	if (track.getTranslation(0)==track.getTranslation(1))
+		return track.getLenght();
+	
+	// Seules les lignes s'etirent entre deux translations
+	float x0, y0, x1, y1;
+	getFramePoint(track, x0, y0, 0.0);
+	getFramePoint(track, x1, y1, 1.0);
+	return sqrt((x1-x0)*(x1-x0)+(y1-y0)*(y1-y0));
 }
 
 float ZeroHandleRenderer::getPathLenght(unsigned int trackStartI, unsigned int trackEndI, unsigned int trackStartJ, unsigned int trackEndJ) {
-	float tI0, tI1;
-	getLenghtPoints(trackStartI, tI0, tI0, tI0, tI0, tI0, tI0, tI0, tI0, tI0);
-	tI0 += 1.0;
-	getLenghtPoints(trackEndI, tI1, tI1, tI1, tI1, tI1, tI1, tI1, tI1, tI1);
-	float sumI = tI0+tI1;
-	
-	float tJ0, tJ1;
-	getLenghtPoints(trackStartJ, tJ0, tJ0, tJ0, tJ0, tJ0, tJ0, tJ0, tJ0, tJ0);
-	tJ0 += 1.0;
-	getLenghtPoints(trackEndJ, tJ1, tJ1, tJ1, tJ1, tJ1, tJ1, tJ1, tJ1, tJ1);
-	float sumJ = tJ0+tJ1;
+	float sumI = getLenghtPoints(trackStartI)[8] + 1.0 + getLenghtPoints(trackEndI)[8];
+	float sumJ = getLenghtPoints(trackStartJ)[8] + 1.0 + getLenghtPoints(trackEndJ)[8];
 	
 	return 0.5*(sumI+sumJ);
 }
 
 float ZeroHandleRenderer::getTAfterZeroHandle(unsigned int trackStartI, unsigned int trackEndI, unsigned int trackStartJ, unsigned int trackEndJ) {
-	float tI, tZeroHandleI;
-	getLenghtPoints(trackStartI, tZeroHandleI, tZeroHandleI, tZeroHandleI, tZeroHandleI, tZeroHandleI, tZeroHandleI, tZeroHandleI, tZeroHandleI, tZeroHandleI);
-	tZeroHandleI += 1.0;
-	getLenghtPoints(trackEndI, tI, tI, tI, tI, tI, tI, tI, tI, tI);
-	tZeroHandleI /= tZeroHandleI+tI;
-	
-	float tJ, tZeroHandleJ;
-	getLenghtPoints(trackStartJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ, tZeroHandleJ);
-	tZeroHandleJ += 1.0;
-	getLenghtPoints(trackEndJ, tJ, tJ, tJ, tJ, tJ, tJ, tJ, tJ, tJ);
-	tZeroHandleJ /= tZeroHandleJ+tJ;
+	float tZeroHandleI = getLenghtPoints(trackStartI)[8] + 1.0;
+	tZeroHandleI /= tZeroHandleI+getLenghtPoints(trackEndI)[8];
+	
+	float tZeroHandleJ = getLenghtPoints(trackStartJ)[8] + 1.0;
+	tZeroHandleJ /= tZeroHandleJ+getLenghtPoints(trackEndJ)[8];
 	
 	if ((trackStartI>trackEndI) == (trackStartJ>trackEndJ))
 		return 0.5*(tZeroHandleI+tZeroHandleJ);
@@ -861,17 +1133,17 @@ void ZeroHandleRenderer::setArrowPosInZeroHandle(Arrow::Renderer& arrow, unsigne
 	}
 	
 	float tI[19];
-	getLenghtPoints(trackStartI, tI[0], tI[1], tI[2], tI[3], tI[4], tI[5], tI[6], tI[7], tI[8]);
+	std::copy_n(getLenghtPoints(trackStartI), 9, tI);
 	tI[9] = tI[8]+1.0;
-	getLenghtPoints(trackEndI, tI[10], tI[11], tI[12], tI[13], tI[14], tI[15], tI[16], tI[17], tI[18]);
+	std::copy_n(getLenghtPoints(trackEndI), 9, tI+10);
 	float sum = tI[9]+tI[18];
 	tI[0]/=sum; tI[1]/=sum; tI[2]/=sum; tI[3]/=sum; tI[4]/=sum; tI[5]/=sum; tI[6]/=sum; tI[7]/=sum; tI[8]/=sum; tI[9]/=sum;
 	tI[10]/=sum; tI[11]/=sum; tI[12]/=sum; tI[13]/=sum; tI[14]/=sum; tI[15]/=sum; tI[16]/=sum; tI[17]/=sum; tI[18]/=sum;
 	
 	float tJ[19];
-	getLenghtPoints(trackStartJ, tJ[0], tJ[1], tJ[2], tJ[3], tJ[4], tJ[5], tJ[6], tJ[7], tJ[8]);
+	std::copy_n(getLenghtPoints(trackStartJ), 9, tJ);
 	tJ[9] = tJ[8]+1.0;
-	getLenghtPoints(trackEndJ, tJ[10], tJ[11], tJ[12], tJ[13], tJ[14], tJ[15], tJ[16], tJ[17], tJ[18]);
+	std::copy_n(getLenghtPoints(trackEndJ), 9, tJ+10);
 	sum = tJ[9]+tJ[18];
 	tJ[0]/=sum; tJ[1]/=sum; tJ[2]/=sum; tJ[3]/=sum; tJ[4]/=sum; tJ[5]/=sum; tJ[6]/=sum; tJ[7]/=sum; tJ[8]/=sum; tJ[9]/=sum;
 	tJ[10]/=sum; tJ[11]/=sum; tJ[12]/=sum; tJ[13]/=sum; tJ[14]/=sum; tJ[15]/=sum; tJ[16]/=sum; tJ[17]/=sum; tJ[18]/=sum;
@@ -899,10 +1171,10 @@ void ZeroHandleRenderer::setArrowPosInZeroHandle(Arrow::Renderer& arrow, unsigne
 	ShowableCurve& trackJ = getInterpolatedTrack(timeJ, trackStartJ, trackEndJ, timeJ, tJ);
 	
 	float px0, py0, px1, py1, tx0, ty0, tx1, ty1;
-	trackI.getPoint(px0, py0, timeI);
-	trackJ.getPoint(px1, py1, timeJ);
-	trackI.getNormalToPoint(tx0, ty0, timeI, px1, py1);
-	trackJ.getNormalToPoint(tx1, ty1, timeJ, px0, py0);
+	getFramePoint(trackI, px0, py0, timeI);
+	getFramePoint(trackJ, px1, py1, timeJ);
+	getFrameNormalToPoint(trackI, tx0, ty0, timeI, px1, py1);
+	getFrameNormalToPoint(trackJ, tx1, ty1, timeJ, px0, py0);
 	arrow.changePoints(px0, py0, px1, py1, tx0, ty0, tx1, ty1);
 }
 
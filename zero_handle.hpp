@@ -1,9 +1,10 @@
 #ifndef __ZERO_HANDLE_HPP__
 #define __ZERO_HANDLE_HPP__
 
-#include <map>
 #include <vector>
 #include <list>
+#include <functional>
+#include <string>
 
 class ZeroHandle;
 class ZeroHandleRenderer;
@@ -18,18 +19,9 @@ class ZeroHandleRenderer;
 
 class ZeroHandle {
 private:
-	class UnorderedIdempotentsPair {
-		unsigned int m_idem0;
-		unsigned int m_idem1;
-		
-	public:
-		UnorderedIdempotentsPair(unsigned int idem0, unsigned int idem1) : m_idem0((idem0<idem1) ? idem0 : idem1), m_idem1((idem0<idem1) ? idem1 : idem0) {}
-		
-		bool operator<(const UnorderedIdempotentsPair& other) const {return (m_idem0==other.m_idem0) ? (m_idem1<other.m_idem1) : (m_idem0<other.m_idem0);}
-	};
-	
 	const unsigned int m_numTrackVoid;
 	const unsigned int m_numTrackFull;
+	const FUMatrix m_matrix;
 	Pairing m_pairing;
 	ZeroHandleRenderer* m_renderer = nullptr;
 	OneHandle m_voidHandle;
@@ -41,12 +33,27 @@ private:
 	unsigned int getMarkovIndex(unsigned int i, unsigned int j, const OneHandle& oneHandle, bool isPost) const;
 	unsigned int getCorrectedIndexFromEdge(unsigned int index, int edge) const;
 	void buildMarkovPart(DeterministMarkov& markov, int edge) const;
+	void runOnBothHandles(const std::function<void(OneHandle&)>& step);
 	
 public:
+	// Point de reprise ecrit par la proposition 28 a la fin de chaque profondeur
+	struct Checkpoint {
+		unsigned int k;
+		FUMatrix matrix;
+		unsigned int depth;
+		OneHandle::Checkpoint voidHandle;
+		OneHandle::Checkpoint fullHandle;
+	};
+	
 	ZeroHandle(unsigned int k, const FUMatrix& matrix, std::list<Arrow>&& voidArrows, std::list<Arrow>&& fullArrows,
 			std::list<std::pair<unsigned int, unsigned int>>& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& voidArrowsPtr,
 			std::list<std::pair<unsigned int, unsigned int>>& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& fullArrowsPtr);
+	ZeroHandle(Checkpoint&& checkpoint,
+			std::list<std::pair<unsigned int, unsigned int>>& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& voidArrowsPtr,
+			std::list<std::pair<unsigned int, unsigned int>>& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& fullArrowsPtr);
 	
+	Checkpoint getCheckpoint(unsigned int depth) const;
+	void postRestoredState();
 	void updateMarkov();
 	bool trackPairEndsClockwise(std::pair<unsigned int, unsigned int> tracks, const OneHandle& oneHandle, bool isPost) const;
 	bool trackPairEndsAntiClockwise(std::pair<unsigned int, unsigned int> tracks, const OneHandle& oneHandle, bool isPost) const;
@@ -55,7 +62,8 @@ public:
 	void moveArrowThroughout(PassArrowsThroughtZeroHandleCommand* cmd, ArrowBox& src, std::list<ArrowBox::ArrowInArrowBox*>::iterator arrow, int index,
 			unsigned int beginI, unsigned int beginJ);
 	
-	void proposition28();
+	// Si completed n'est pas nul, il recoit l'etat au debut puis a la fin de chaque profondeur terminee
+	void proposition28(const std::string& checkpointPath = std::string(), Checkpoint* completed = nullptr);
 	
 	const Pairing& getPairing() {return m_pairing;}
 	ZeroHandleRenderer& getRenderer() {assert(m_renderer!=nullptr); return *m_renderer;}
@@ -71,13 +79,29 @@ public:
 
 class ZeroHandleRenderer {
 private:
+	// Translations du cadre: un changement de longueur des anses ne deplace qu'elles
+	enum FrameTranslation {
+		RIGHT_TRANSLATION         = 0, // Cote droit des anses, a m_handleLenght
+		VOID_EAST_GAP_TRANSLATION = 1, // Debut de la 1-anse vide
+		VOID_WEST_GAP_TRANSLATION = 2, // Fin de la 1-anse vide
+		FULL_EAST_GAP_TRANSLATION = 3, // Debut de la 1-anse pleine
+		FULL_WEST_GAP_TRANSLATION = 4, // Fin de la 1-anse pleine
+		FRAME_TRANSLATIONS        = 5
+	};
+	
+	RendererGL& m_rendererGL;
 	OneHandleRenderer m_voidHandle;
 	OneHandleRenderer m_fullHandle;
 	float m_handleLenght;
 	const unsigned int m_numTrackVoid;
 	const unsigned int m_numTrackFull;
+	// Longueurs cumulees des troncons d'un chemin, pour chaque cote de la 0-anse; ne changent qu'avec updateLenght
+	float m_lenghtPoints[4][9];
+	// 0 pour une translation qui n'a pas pu etre allouee: les pieces qui la suivent sont alors reecrites
+	unsigned int m_frameTranslations[FRAME_TRANSLATIONS];
 	
-	std::map<ZeroHandle::UnorderedIdempotentsPair, TrackBezier> m_pairTrackMap;
+	// Voie de chaque paire de l'appariement, a l'indice de son plus petit idempotent
+	std::vector<TrackBezier> m_pairTracks;
 	ShowableLine m_line[8];
 	Quad m_quad;
 	
@@ -136,13 +160,27 @@ private:
 	std::vector<TrackLine> m_fullEastGapTracks;
 	std::vector<TrackLine> m_fullWestGapTracks;
 	
-	void getLenghtPoints(unsigned int i, float& t0, float& t1, float& t2, float& t3, float& t4, float& t5, float& t6, float& t7, float& t8);
+	// Position en x de chaque translation du cadre
+	void getFramePositions(float positions[FRAME_TRANSLATIONS]) const;
+	// Renvoie false si une translation manque
+	bool updateFrameTranslations();
+	// Reecrit les pieces qui dependent de m_handleLenght, relativement a leurs translations
+	void layoutFrame();
+	
+	// Les voies du cadre sont relatives aux translations de leurs extremites
+	void getFramePoint(const ShowableCurve& track, float& out_x, float& out_y, float t) const;
+	void getFrameNormalToPoint(const ShowableCurve& track, float& out_x, float& out_y, float t, float px, float py) const;
+	float getFrameLenght(ShowableCurve& track) const;
+	
+	void updateLenghtPoints();
+	const float* getLenghtPoints(unsigned int i) const;
 	ShowableCurve& getInterpolatedTrack(float& newT, unsigned int trackStart, unsigned int trackEnd, float time, const float t[19]);
 	
 public:
 	ZeroHandleRenderer(RendererGL& rendererGL, const Pairing& pairing, ZeroHandle& zeroHandle,
 			std::list<std::pair<unsigned int, unsigned int>>& voidArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& voidArrows,
 			std::list<std::pair<unsigned int, unsigned int>>& fullArrowsData, std::list<ArrowBox::ArrowInArrowBox*>& fullArrows);
+	~ZeroHandleRenderer();
 	
 	void updateLenght();
 	float lenght() const {return m_handleLenght;}